@@ -17,6 +17,7 @@
 #include <iostream>
 #include <fstream>
 #include <cstdlib>
+#include <algorithm>
 #include <utility>
 
 #if defined(__cplusplus) && __cplusplus >= 201703L && defined(__has_include)
@@ -33,6 +34,8 @@
 
 #include <geoflow/geoflow.hpp>
 #include <geoflow/plugin_manager.hpp>
+#include <geoflow/memory.hpp>
+#include <geoflow/parallel.hpp>
 
 #ifdef GF_BUILD_WITH_GUI
   #include <geoflow/gui/gfImNodes.hpp>
@@ -49,6 +52,23 @@ using namespace geoflow;
 void load_plugins(PluginManager& plugin_manager, NodeRegisterMap& node_registers, std::string& plugin_dir, bool verbose=false) {
   auto R_core = NodeRegister::create("Core");
   R_core->register_node<nodes::core::NestNode>("NestedFlowchart");
+  R_core->register_node<nodes::core::SpatialIndexNode>("SpatialIndex");
+  R_core->register_node<nodes::core::NeighbourIndexNode>("NeighbourIndex");
+  R_core->register_node<nodes::core::SpaceFillingCurveSortNode>("SpaceFillingCurveSort");
+  R_core->register_node<nodes::core::SelectRangeNode>("SelectRange");
+  R_core->register_node<nodes::core::SelectionAndNode>("SelectionAnd");
+  R_core->register_node<nodes::core::SelectionOrNode>("SelectionOr");
+  R_core->register_node<nodes::core::SelectionNotNode>("SelectionNot");
+  R_core->register_node<nodes::core::ApplySelectionNode>("ApplySelection");
+  R_core->register_node<nodes::core::QuantizePointsNode>("QuantizePoints");
+  R_core->register_node<nodes::core::DequantizePointsNode>("DequantizePoints");
+  R_core->register_node<nodes::core::MapPointsNode>("MapPoints");
+  R_core->register_node<nodes::core::OpenMappedPointsNode>("OpenMappedPoints");
+  R_core->register_node<nodes::core::MapXYZFileNode>("MapXYZFile");
+  R_core->register_node<nodes::core::RasterizePointsNode>("RasterizePoints");
+  R_core->register_node<nodes::core::RasterDifferenceNode>("RasterDifference");
+  R_core->register_node<nodes::core::AttributeCalculatorNode>("AttributeCalculator");
+  R_core->register_node<nodes::core::TriangulatePolygonsNode>("TriangulatePolygons");
   node_registers.emplace(R_core);
 
   #ifdef GF_BUILD_WITH_GUI
@@ -71,6 +91,23 @@ void load_plugins(PluginManager& plugin_manager, NodeRegisterMap& node_registers
   }
 }
 
+void print_estimate(NodeManager& flowchart) {
+  auto estimate = flowchart.estimate_run_all();
+  double runtime_ms = estimate.sequential_ms;
+  if (flowchart.is_parallel())
+    runtime_ms = std::max(estimate.critical_path_ms, estimate.sequential_ms / thread_count());
+  std::cout << "Estimated runtime: " << runtime_ms / 1000 << "s";
+  if (flowchart.is_parallel())
+    std::cout << " (" << estimate.sequential_ms / 1000 << "s sequential, " << thread_count() << " threads)";
+  std::cout << "\nCritical path (" << estimate.critical_path_ms / 1000 << "s):";
+  for (auto& node : estimate.critical_path) {
+    std::cout << (&node == &estimate.critical_path.front() ? " " : " -> ") << node->get_name();
+  }
+  std::cout << "\n";
+  if (estimate.unknown_count)
+    std::cout << estimate.unknown_count << " nodes have no timing history\n";
+}
+
 int main(int argc, const char * argv[]) {
 
   std::string flowchart_path = "flowchart.json";
@@ -78,6 +115,7 @@ int main(int argc, const char * argv[]) {
   std::string log_filename = "";
   fs::path launch_path{fs::current_path()};
   fs::path flowchart_folder = launch_path;
+  int exit_code = 0;
   
   if(const char* env_p = std::getenv("GF_PLUGIN_FOLDER")) {
     plugin_folder = env_p;
@@ -100,6 +138,36 @@ int main(int argc, const char * argv[]) {
         return std::string("Path to log file does not exist");
       } else return std::string();
     });
+    size_t threads = 0;
+    bool pin_threads = false;
+    cli.add_option("-t,--threads", threads, "Number of worker threads (default: one per hardware thread)");
+    cli.add_flag("--pin-threads", pin_threads, "Bind each worker thread to its own CPU");
+    bool parallel = false;
+    cli.add_flag("--parallel", parallel, "Process independent nodes in parallel");
+    std::string mem_budget;
+    cli.add_option("--mem-budget", mem_budget, "Only start nodes while their estimated memory use fits in this budget, eg. 200G (implies --parallel)")
+      ->check([](const std::string& text) {
+        try {
+          parse_memory_size(text);
+        } catch (const std::invalid_argument& e) {
+          return std::string(e.what());
+        }
+        return std::string();
+      });
+    std::vector<std::string> targets;
+    cli.add_option("--target", targets, "Only run the nodes needed to compute this node (repeatable)");
+    bool pull = false;
+    cli.add_flag("--pull", pull, "Only run the nodes needed by nodes with marked outputs and by nodes without outputs (eg. writers)");
+    bool keep_duplicates = false;
+    cli.add_flag("--keep-duplicates", keep_duplicates, "Do not merge equivalent nodes before running");
+    bool estimate = false;
+    cli.add_flag("--estimate", estimate, "Print the predicted runtime and critical path from the timing history before running");
+    double timeout = 0;
+    cli.add_option("--timeout", timeout, "Stop starting nodes after this many seconds, the outputs of the nodes that finished are kept")
+      ->check(CLI::PositiveNumber);
+    double node_timeout = 0;
+    cli.add_option("--node-timeout", node_timeout, "Cancel nodes that process for longer than this many seconds; the outputs of a node that stops early because of it are discarded")
+      ->check(CLI::PositiveNumber);
 
     auto sc_flowchart = cli.add_subcommand("", "Load flowchart");
     CLI::Option* opt_flowchart_path = sc_flowchart->add_option("flowchart", flowchart_path, "Flowchart file");
@@ -125,6 +193,7 @@ int main(int argc, const char * argv[]) {
         flowchart_path = abs_path.string();
         fs::current_path(flowchart_folder);
         flowchart.load_json(flowchart_path);
+        flowchart.load_profile(NodeManager::profile_path(flowchart_path));
         fs::current_path(launch_path);
       }
     });
@@ -148,6 +217,13 @@ int main(int argc, const char * argv[]) {
     } catch (const CLI::ParseError &e) {
       return cli.exit(e);
     }
+    set_thread_count(threads);
+    set_thread_affinity(pin_threads);
+    if (!mem_budget.empty()) {
+      parallel = true;
+      flowchart.set_memory_budget(parse_memory_size(mem_budget));
+    }
+    flowchart.set_parallel(parallel);
     // if(*opt_plugin_folder) {
     //   std::cout << "Setting plugin folder to " << plugin_folder << "\n";
     // }
@@ -190,6 +266,33 @@ int main(int argc, const char * argv[]) {
       }
     }
 
+    #ifndef GF_BUILD_WITH_GUI
+      auto problems = flowchart.validate();
+      if (problems.size()) {
+        std::cout << "Flowchart has " << problems.size() << " problem(s), not running it:\n";
+        for (auto& problem : problems) {
+          std::cout << "  " << problem << "\n";
+        }
+        return 1;
+      }
+      if (!keep_duplicates) {
+        for (auto& [removed, kept] : flowchart.merge_equivalent_nodes()) {
+          std::cout << "Merged " << removed << " into " << kept << "\n";
+          std::replace(targets.begin(), targets.end(), removed, kept);
+        }
+      }
+    #endif
+
+    std::vector<NodeHandle> target_nodes;
+    for (auto& name : targets) {
+      auto node = flowchart.get_nodes().find(name);
+      if (node == flowchart.get_nodes().end()) {
+        std::cout << "No node named " << name << " in the flowchart\n";
+        return 1;
+      }
+      target_nodes.push_back(node->second);
+    }
+
     std::ofstream logfile;
     if(*opt_log) {
       logfile.open(log_filename);
@@ -204,7 +307,22 @@ int main(int argc, const char * argv[]) {
         load_plugins(plugin_manager, node_registers, plugin_folder);
       launch_gui(flowchart, flowchart_path);
     #else
-      flowchart.run_all();
+      if (estimate) print_estimate(flowchart);
+      auto cancellation = std::make_shared<CancellationToken>();
+      if (timeout > 0) cancellation->set_timeout(timeout);
+      flowchart.set_cancellation_token(cancellation);
+      flowchart.set_node_timeout(node_timeout * 1000);
+      if (targets.size() || pull) {
+        flowchart.run_targets(target_nodes);
+      } else {
+        flowchart.run_all();
+      }
+      if (!flowchart.dump_profile(NodeManager::profile_path(flowchart_path)))
+        std::cout << "Could not write timing profile " << NodeManager::profile_path(flowchart_path) << "\n";
+      if (cancellation->is_cancelled()) {
+        std::cout << "Run stopped after " << timeout << "s, not all nodes were processed\n";
+        exit_code = 1;
+      }
     #endif
   }
   // NOTICE that we first must destroy any related node_registers before we can unload the plugin_manager!
@@ -213,5 +331,5 @@ int main(int argc, const char * argv[]) {
   std::cout.rdbuf(cout_rdbuf);
   std::cerr.rdbuf(cerr_rdbuf);
   
-  return 0;
+  return exit_code;
 }
@@ -1,7 +1,20 @@
 file(READ ${PROJECT_SOURCE_DIR}/src/geoflow/common.hpp s1)
 file(READ ${PROJECT_SOURCE_DIR}/src/geoflow/parameters.hpp s2)
 file(READ ${PROJECT_SOURCE_DIR}/src/geoflow/geoflow.hpp s3)
-string(CONCAT GF_SHARED_HEADERS ${s1} ${s2} ${s3})
+file(READ ${PROJECT_SOURCE_DIR}/src/geoflow/spatial_index.hpp s4)
+file(READ ${PROJECT_SOURCE_DIR}/src/geoflow/neighbour_index.hpp s5)
+file(READ ${PROJECT_SOURCE_DIR}/src/geoflow/parallel.hpp s6)
+file(READ ${PROJECT_SOURCE_DIR}/src/geoflow/space_filling_curve.hpp s7)
+file(READ ${PROJECT_SOURCE_DIR}/src/geoflow/selection.hpp s8)
+file(READ ${PROJECT_SOURCE_DIR}/src/geoflow/quantized_points.hpp s9)
+file(READ ${PROJECT_SOURCE_DIR}/src/geoflow/mapped_file.hpp s10)
+file(READ ${PROJECT_SOURCE_DIR}/src/geoflow/mapped_points.hpp s11)
+file(READ ${PROJECT_SOURCE_DIR}/src/geoflow/raster.hpp s12)
+file(READ ${PROJECT_SOURCE_DIR}/src/geoflow/expression.hpp s13)
+file(READ ${PROJECT_SOURCE_DIR}/src/geoflow/triangulate.hpp s14)
+file(READ ${PROJECT_SOURCE_DIR}/src/geoflow/kernels.hpp s15)
+file(READ ${PROJECT_SOURCE_DIR}/src/geoflow/memory.hpp s16)
+string(CONCAT GF_SHARED_HEADERS ${s1} ${s2} ${s3} ${s4} ${s5} ${s6} ${s7} ${s8} ${s9} ${s10} ${s11} ${s12} ${s13} ${s14} ${s15} ${s16})
 string(MD5 GF_SHARED_HEADERS_HASH ${GF_SHARED_HEADERS})
 message(STATUS "Setting Geoflow shared header hash to ${GF_SHARED_HEADERS_HASH}")
 file(WRITE ${OUTPUT_FILE} "#define GF_SHARED_HEADERS_HASH \"${GF_SHARED_HEADERS_HASH}\"\n")
\ No newline at end of file
@@ -15,8 +15,14 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
 
 #include "common.hpp"
+#include "kernels.hpp"
+#include "triangulate.hpp"
 
 namespace geoflow
 {
@@ -75,8 +81,8 @@ void Box::add(Box &otherBox)
 }
 void Box::add(vec3f &vec)
 {
-  for (auto &p : vec)
-    add(p);
+  if (!vec.empty())
+    add(kernels::bbox(vec));
 }
 float Box::size_x() const
 {
@@ -109,6 +115,7 @@ arr3f Box::center() const
 
 const Box &Geometry::box()
 {
+  std::lock_guard<BoxLock> lock(box_lock_);
   if (!bbox.has_value())
   {
     compute_box();
@@ -217,12 +224,9 @@ void TriangleCollection::compute_box()
   if (!bbox.has_value())
   {
     bbox = Box();
-    for (auto &t : *this)
-    {
-      bbox->add(t[0]);
-      bbox->add(t[1]);
-      bbox->add(t[2]);
-    }
+    // the triangles are stored as one contiguous array of vertices
+    if (!empty())
+      bbox->add(kernels::bbox(ConstRingView(&front()[0], &front()[0] + 3 * size())));
   }
 }
 float *TriangleCollection::get_data_ptr()
@@ -251,54 +255,56 @@ float *SegmentCollection::get_data_ptr()
   return (*this)[0][0].data();
 }
 
-size_t LineStringCollection::vertex_count() const
+RingView VertexRangeCollection::operator[](size_t i)
 {
-  size_t result = 0;
-  for (auto &vec : *this)
-  {
-    result += vec.size();
-  }
-  return result;
+  return RingView(vertices_.data() + offsets_[i], vertices_.data() + offsets_[i + 1]);
 }
-void LineStringCollection::compute_box()
+ConstRingView VertexRangeCollection::operator[](size_t i) const
 {
-  if (!bbox.has_value())
-  {
-    bbox = Box();
-    for (auto &vec : *this)
-    {
-      bbox->add(vec);
-    }
-  }
+  return ConstRingView(vertices_.data() + offsets_[i], vertices_.data() + offsets_[i + 1]);
 }
-float *LineStringCollection::get_data_ptr()
+void VertexRangeCollection::push_back(const vec3f& range)
 {
-  return (*this)[0][0].data();
+  push_back(range.begin(), range.end());
 }
-
-size_t LinearRingCollection::vertex_count() const
+void VertexRangeCollection::reserve(size_t range_count, size_t vertex_count)
 {
-  size_t result = 0;
-  for (auto &vec : *this)
-  {
-    result += vec.size();
-  }
-  return result;
+  offsets_.reserve(range_count + 1);
+  vertices_.reserve(vertex_count);
+}
+void VertexRangeCollection::clear()
+{
+  vertices_.clear();
+  offsets_.assign(1, 0);
+  bbox.reset();
+}
+vec3f& VertexRangeCollection::vertices()
+{
+  return vertices_;
+}
+const vec3f& VertexRangeCollection::vertices() const
+{
+  return vertices_;
+}
+const std::vector<size_t>& VertexRangeCollection::offsets() const
+{
+  return offsets_;
+}
+size_t VertexRangeCollection::vertex_count() const
+{
+  return vertices_.size();
 }
-void LinearRingCollection::compute_box()
+void VertexRangeCollection::compute_box()
 {
   if (!bbox.has_value())
   {
     bbox = Box();
-    for (auto &vec : *this)
-    {
-      bbox->add(vec);
-    }
+    bbox->add(vertices_);
   }
 }
-float *LinearRingCollection::get_data_ptr()
+float *VertexRangeCollection::get_data_ptr()
 {
-  return (*this)[0][0].data();
+  return vertices_[0].data();
 }
 
 void Mesh::push_polygon(LinearRing& polygon, int label) {
@@ -328,6 +334,244 @@ const std::vector<int>& Mesh::get_labels() const {
 //   return attributes_;
 // };
 
+void IndexedMesh::compute_box()
+{
+  if (!bbox.has_value())
+  {
+    bbox = Box();
+    bbox->add(vertices_);
+  }
+}
+uint32_t IndexedMesh::push_vertex(const arr3f& vertex)
+{
+  vertices_.push_back(vertex);
+  return uint32_t(vertices_.size() - 1);
+}
+void IndexedMesh::push_face(const std::vector<uint32_t>& exterior, int label)
+{
+  push_face(exterior, {}, label);
+}
+void IndexedMesh::push_face(const std::vector<uint32_t>& exterior, const std::vector<std::vector<uint32_t>>& interiors, int label)
+{
+  indices_.insert(indices_.end(), exterior.begin(), exterior.end());
+  ring_offsets_.push_back(indices_.size());
+  for (auto& interior : interiors)
+  {
+    indices_.insert(indices_.end(), interior.begin(), interior.end());
+    ring_offsets_.push_back(indices_.size());
+  }
+  face_offsets_.push_back(ring_offsets_.size() - 1);
+  labels_.push_back(label);
+}
+void IndexedMesh::clear()
+{
+  vertices_.clear();
+  indices_.clear();
+  ring_offsets_.assign(1, 0);
+  face_offsets_.assign(1, 0);
+  labels_.clear();
+  bbox.reset();
+}
+size_t IndexedMesh::face_count() const
+{
+  return face_offsets_.size() - 1;
+}
+size_t IndexedMesh::ring_count(size_t face) const
+{
+  return face_offsets_[face + 1] - face_offsets_[face];
+}
+IndexedMesh::IndexRing IndexedMesh::face_ring(size_t face, size_t ring) const
+{
+  auto r = face_offsets_[face] + ring;
+  return IndexRing(indices_.data() + ring_offsets_[r], indices_.data() + ring_offsets_[r + 1]);
+}
+int IndexedMesh::face_label(size_t face) const
+{
+  return labels_[face];
+}
+vec3f& IndexedMesh::vertices()
+{
+  return vertices_;
+}
+const vec3f& IndexedMesh::vertices() const
+{
+  return vertices_;
+}
+const std::vector<uint32_t>& IndexedMesh::indices() const
+{
+  return indices_;
+}
+std::vector<int>& IndexedMesh::labels()
+{
+  return labels_;
+}
+const std::vector<int>& IndexedMesh::labels() const
+{
+  return labels_;
+}
+LinearRing IndexedMesh::face_polygon(size_t face) const
+{
+  LinearRing polygon;
+  for (auto& i : face_ring(face))
+    polygon.push_back(vertices_[i]);
+  for (size_t r = 1; r < ring_count(face); ++r)
+  {
+    vec3f interior;
+    for (auto& i : face_ring(face, r))
+      interior.push_back(vertices_[i]);
+    polygon.interior_rings().push_back(interior);
+  }
+  return polygon;
+}
+Mesh IndexedMesh::to_mesh() const
+{
+  Mesh mesh;
+  for (size_t f = 0; f < face_count(); ++f)
+  {
+    auto polygon = face_polygon(f);
+    mesh.push_polygon(polygon, labels_[f]);
+  }
+  return mesh;
+}
+std::vector<uint32_t> IndexedMesh::triangle_indices() const
+{
+  std::vector<uint32_t> triangles;
+  Triangulator triangulator;
+  for (size_t f = 0; f < face_count(); ++f)
+  {
+    auto ring = face_ring(f);
+    if (ring_count(f) == 1 && ring.size() == 3)
+      triangles.insert(triangles.end(), ring.begin(), ring.end());
+    else
+      triangulator.triangulate(*this, f, triangles);
+  }
+  return triangles;
+}
+std::vector<uint32_t> IndexedMesh::edge_indices() const
+{
+  std::vector<uint32_t> edges;
+  edges.reserve(2 * indices_.size());
+  for (size_t r = 0; r + 1 < ring_offsets_.size(); ++r)
+  {
+    auto first = ring_offsets_[r], last = ring_offsets_[r + 1];
+    for (size_t i = first; i < last; ++i)
+    {
+      edges.push_back(indices_[i]);
+      edges.push_back(indices_[i + 1 == last ? first : i + 1]);
+    }
+  }
+  return edges;
+}
+size_t IndexedMesh::vertex_count() const
+{
+  return vertices_.size();
+}
+float *IndexedMesh::get_data_ptr()
+{
+  return vertices_[0].data();
+}
+
+namespace
+{
+// Assigns indices to vertices, merging vertices that fall in the same grid cell
+// (or that are bitwise identical when no tolerance is given).
+class VertexWelder
+{
+  typedef std::array<int64_t, 3> Key;
+  struct KeyHash
+  {
+    size_t operator()(const Key& k) const
+    {
+      // large primes spatial hash, see Teschner et al. (2003)
+      return size_t(uint64_t(k[0]) * 73856093) ^ size_t(uint64_t(k[1]) * 19349663) ^ size_t(uint64_t(k[2]) * 83492791);
+    }
+  };
+  IndexedMesh& mesh_;
+  float inv_tolerance_;
+  std::unordered_map<Key, uint32_t, KeyHash> index_;
+
+  Key key(const arr3f& p) const
+  {
+    if (inv_tolerance_ == 0)
+    {
+      uint32_t b[3];
+      std::memcpy(b, p.data(), sizeof(b));
+      return {b[0], b[1], b[2]};
+    }
+    return {
+      std::llround(double(p[0]) * inv_tolerance_),
+      std::llround(double(p[1]) * inv_tolerance_),
+      std::llround(double(p[2]) * inv_tolerance_)};
+  }
+
+public:
+  VertexWelder(IndexedMesh& mesh, float tolerance, size_t expected_vertices)
+    : mesh_(mesh), inv_tolerance_(tolerance > 0 ? 1 / tolerance : 0)
+  {
+    index_.reserve(expected_vertices);
+  }
+  uint32_t operator()(const arr3f& p)
+  {
+    auto [it, inserted] = index_.emplace(key(p), 0);
+    if (inserted)
+      it->second = mesh_.push_vertex(p);
+    return it->second;
+  }
+  // index a ring, skipping consecutive duplicates that result from the welding
+  template <typename Ring> std::vector<uint32_t> ring(const Ring& ring)
+  {
+    std::vector<uint32_t> indices;
+    indices.reserve(ring.size());
+    for (auto& p : ring)
+    {
+      auto i = (*this)(p);
+      if (indices.empty() || indices.back() != i)
+        indices.push_back(i);
+    }
+    while (indices.size() > 1 && indices.front() == indices.back())
+      indices.pop_back();
+    return indices;
+  }
+};
+} // namespace
+
+IndexedMesh weld_vertices(const Mesh& mesh, float tolerance)
+{
+  IndexedMesh result;
+  size_t n = 0;
+  for (auto& polygon : mesh.get_polygons())
+    n += polygon.size();
+  VertexWelder weld(result, tolerance, n);
+  auto& labels = mesh.get_labels();
+  auto& polygons = mesh.get_polygons();
+  for (size_t i = 0; i < polygons.size(); ++i)
+  {
+    auto exterior = weld.ring(polygons[i]);
+    if (exterior.size() < 3) continue;
+    std::vector<std::vector<uint32_t>> interiors;
+    for (auto& interior : polygons[i].interior_rings())
+    {
+      auto indices = weld.ring(interior);
+      if (indices.size() >= 3)
+        interiors.push_back(std::move(indices));
+    }
+    result.push_face(exterior, interiors, i < labels.size() ? labels[i] : 0);
+  }
+  return result;
+}
+IndexedMesh weld_vertices(const TriangleCollection& triangles, float tolerance)
+{
+  IndexedMesh result;
+  VertexWelder weld(result, tolerance, triangles.size() * 3);
+  for (auto& triangle : triangles)
+  {
+    auto indices = weld.ring(triangle);
+    if (indices.size() == 3)
+      result.push_face(indices);
+  }
+  return result;
+}
+
 void MultiTriangleCollection::push_back(
   TriangleCollection& trianglecollection)
 {
@@ -345,16 +589,16 @@ size_t MultiTriangleCollection::tri_size() const
 }
 size_t MultiTriangleCollection::attr_size() const
 {
-  return attributes_.size();
+  return attributes_.row_count();
 }
 
 bool MultiTriangleCollection::has_attributes()
 {
-  return !attributes_.empty();
+  return attributes_.row_count() != 0;
 }
 bool MultiTriangleCollection::has_attributes() const
 {
-  return !attributes_.empty();
+  return attributes_.row_count() != 0;
 }
 
 std::vector<TriangleCollection>& MultiTriangleCollection::get_tricollections()
@@ -366,11 +610,11 @@ const std::vector<TriangleCollection>& MultiTriangleCollection::get_tricollectio
   return trianglecollections_;
 }
 
-std::vector<AttributeMap>& MultiTriangleCollection::get_attributes()
+AttributeTable& MultiTriangleCollection::get_attributes()
 {
   return attributes_;
 }
-const std::vector<AttributeMap>& MultiTriangleCollection::get_attributes() const
+const AttributeTable& MultiTriangleCollection::get_attributes() const
 {
   return attributes_;
 }
@@ -384,13 +628,323 @@ const TriangleCollection& MultiTriangleCollection::tri_at(size_t i) const
   return trianglecollections_.at(i);
 }
 
-AttributeMap& MultiTriangleCollection::attr_at(size_t i)
+AttributeRow MultiTriangleCollection::attr_at(size_t i) const
+{
+  if (i >= attributes_.row_count())
+    throw std::out_of_range("MultiTriangleCollection::attr_at");
+  return AttributeRow(attributes_, i);
+}
+
+namespace
+{
+// a float has a 24 bit significand, larger ints would be rounded
+bool exact_as_float(int value)
+{
+  return value >= -(1 << 24) && value <= (1 << 24);
+}
+} // namespace
+
+AttributeColumn::AttributeColumn(AttributeType type) : type_(type) {}
+AttributeType AttributeColumn::type() const
+{
+  return type_;
+}
+size_t AttributeColumn::size() const
+{
+  return is_null_.size();
+}
+void AttributeColumn::reserve(size_t n)
+{
+  is_null_.reserve(n);
+  switch (type_)
+  {
+  case GF_ATTRIBUTE_BOOL: bools_.reserve(n); break;
+  case GF_ATTRIBUTE_INT: ints_.reserve(n); break;
+  case GF_ATTRIBUTE_FLOAT: floats_.reserve(n); break;
+  case GF_ATTRIBUTE_STRING: string_codes_.reserve(n); break;
+  }
+}
+void AttributeColumn::widen(AttributeType type)
+{
+  if (type_ == GF_ATTRIBUTE_STRING || type == GF_ATTRIBUTE_STRING)
+    throw std::invalid_argument("Can not widen string attribute column");
+  // BOOL < INT < FLOAT
+  auto rank = [](AttributeType t) { return t == GF_ATTRIBUTE_BOOL ? 0 : t == GF_ATTRIBUTE_INT ? 1 : 2; };
+  if (rank(type) <= rank(type_))
+    return;
+  if (type == GF_ATTRIBUTE_FLOAT)
+  {
+    if (type_ == GF_ATTRIBUTE_BOOL)
+      floats_.assign(bools_.begin(), bools_.end());
+    else
+    {
+      for (auto v : ints_)
+        if (!exact_as_float(v))
+          throw std::invalid_argument("Can not widen int attribute column to float, " + std::to_string(v) + " is not exactly representable");
+      floats_.assign(ints_.begin(), ints_.end());
+    }
+  } else {
+    ints_.assign(bools_.begin(), bools_.end());
+  }
+  vec1b().swap(bools_);
+  if (type == GF_ATTRIBUTE_FLOAT)
+    vec1i().swap(ints_);
+  type_ = type;
+}
+bool AttributeColumn::accepts(const attribute_value& value) const
+{
+  if (type_ == GF_ATTRIBUTE_STRING)
+    return true;
+  if (std::holds_alternative<std::string>(value))
+    return false;
+  if (type_ == GF_ATTRIBUTE_FLOAT && std::holds_alternative<int>(value))
+    return exact_as_float(std::get<int>(value));
+  // widening to float
+  if (type_ == GF_ATTRIBUTE_INT && std::holds_alternative<float>(value))
+    for (size_t i = 0; i < ints_.size(); ++i)
+      if (!is_null_[i] && !exact_as_float(ints_[i]))
+        return false;
+  return true;
+}
+void AttributeColumn::push_back()
+{
+  is_null_.push_back(true);
+  switch (type_)
+  {
+  case GF_ATTRIBUTE_BOOL: bools_.push_back(false); break;
+  case GF_ATTRIBUTE_INT: ints_.push_back(0); break;
+  case GF_ATTRIBUTE_FLOAT: floats_.push_back(0); break;
+  case GF_ATTRIBUTE_STRING: string_codes_.push_back(0); break;
+  }
+}
+void AttributeColumn::push_back(const attribute_value& value)
+{
+  push_back();
+  set(size() - 1, value);
+}
+void AttributeColumn::set(size_t row, const attribute_value& value)
+{
+  std::visit([this, row](auto&& v) { set(row, v); }, value);
+}
+void AttributeColumn::set(size_t row, float value)
+{
+  if (type_ == GF_ATTRIBUTE_BOOL || type_ == GF_ATTRIBUTE_INT)
+    widen(GF_ATTRIBUTE_FLOAT);
+  switch (type_)
+  {
+  case GF_ATTRIBUTE_BOOL: case GF_ATTRIBUTE_INT: break;
+  case GF_ATTRIBUTE_FLOAT: floats_[row] = value; break;
+  case GF_ATTRIBUTE_STRING: set(row, std::to_string(value)); return;
+  }
+  is_null_[row] = false;
+}
+void AttributeColumn::set(size_t row, int value)
+{
+  if (type_ == GF_ATTRIBUTE_BOOL)
+    widen(GF_ATTRIBUTE_INT);
+  switch (type_)
+  {
+  case GF_ATTRIBUTE_BOOL: break;
+  case GF_ATTRIBUTE_INT: ints_[row] = value; break;
+  case GF_ATTRIBUTE_FLOAT:
+    if (!exact_as_float(value))
+      throw std::invalid_argument("Can not store " + std::to_string(value) + " in float attribute column, it is not exactly representable");
+    floats_[row] = float(value);
+    break;
+  case GF_ATTRIBUTE_STRING: set(row, std::to_string(value)); return;
+  }
+  is_null_[row] = false;
+}
+void AttributeColumn::set(size_t row, bool value)
+{
+  switch (type_)
+  {
+  case GF_ATTRIBUTE_BOOL: bools_[row] = value; break;
+  case GF_ATTRIBUTE_INT: ints_[row] = value; break;
+  case GF_ATTRIBUTE_FLOAT: floats_[row] = value; break;
+  case GF_ATTRIBUTE_STRING: set(row, std::string(value ? "true" : "false")); return;
+  }
+  is_null_[row] = false;
+}
+void AttributeColumn::set(size_t row, const std::string& value)
+{
+  if (type_ != GF_ATTRIBUTE_STRING)
+    throw std::invalid_argument("Can not store string in non-string attribute column");
+  auto [it, inserted] = dictionary_index_.emplace(value, uint32_t(dictionary_.size()));
+  if (inserted)
+    dictionary_.push_back(value);
+  string_codes_[row] = it->second;
+  is_null_[row] = false;
+}
+void AttributeColumn::set(size_t row, const char* value)
+{
+  set(row, std::string(value));
+}
+void AttributeColumn::set_null(size_t row)
+{
+  is_null_[row] = true;
+}
+bool AttributeColumn::is_null(size_t row) const
+{
+  return is_null_[row];
+}
+attribute_value AttributeColumn::get(size_t row) const
+{
+  switch (type_)
+  {
+  case GF_ATTRIBUTE_BOOL: return bool(bools_[row]);
+  case GF_ATTRIBUTE_INT: return ints_[row];
+  case GF_ATTRIBUTE_FLOAT: return floats_[row];
+  default: return get_string(row);
+  }
+}
+const vec1b& AttributeColumn::bools() const
+{
+  return bools_;
+}
+const vec1i& AttributeColumn::ints() const
+{
+  return ints_;
+}
+const vec1f& AttributeColumn::floats() const
+{
+  return floats_;
+}
+const std::vector<uint32_t>& AttributeColumn::string_codes() const
+{
+  return string_codes_;
+}
+const vec1s& AttributeColumn::dictionary() const
+{
+  return dictionary_;
+}
+const std::string& AttributeColumn::get_string(size_t row) const
+{
+  static const std::string empty;
+  if (is_null_[row])
+    return empty;
+  return dictionary_[string_codes_[row]];
+}
+
+size_t AttributeTable::add_column(const std::string& name, AttributeType type)
+{
+  auto [it, inserted] = column_index_.emplace(name, columns_.size());
+  if (inserted)
+  {
+    names_.push_back(name);
+    columns_.emplace_back(type);
+    auto& column = columns_.back();
+    column.reserve(row_count_);
+    for (size_t i = 0; i < row_count_; ++i)
+      column.push_back();
+  }
+  return it->second;
+}
+bool AttributeTable::has_column(const std::string& name) const
+{
+  return column_index_.count(name) != 0;
+}
+size_t AttributeTable::column_index(const std::string& name) const
+{
+  return column_index_.at(name);
+}
+AttributeColumn& AttributeTable::column(size_t i)
+{
+  return columns_[i];
+}
+const AttributeColumn& AttributeTable::column(size_t i) const
+{
+  return columns_[i];
+}
+AttributeColumn& AttributeTable::column(const std::string& name)
+{
+  return columns_[column_index(name)];
+}
+const AttributeColumn& AttributeTable::column(const std::string& name) const
+{
+  return columns_[column_index(name)];
+}
+const vec1s& AttributeTable::column_names() const
+{
+  return names_;
+}
+size_t AttributeTable::column_count() const
+{
+  return columns_.size();
+}
+size_t AttributeTable::row_count() const
+{
+  return row_count_;
+}
+void AttributeTable::reserve(size_t row_count)
+{
+  for (auto& column : columns_)
+    column.reserve(row_count);
+}
+size_t AttributeTable::append_row()
+{
+  for (auto& column : columns_)
+    column.push_back();
+  return row_count_++;
+}
+void AttributeTable::clear()
+{
+  columns_.clear();
+  names_.clear();
+  column_index_.clear();
+  row_count_ = 0;
+}
+void AttributeTable::push_back(const AttributeMap& attributemap)
+{
+  for (auto& [name, values] : attributemap)
+  {
+    if (values.size() > 1)
+      throw std::invalid_argument("Attribute '" + name + "' has multiple values, AttributeTable stores one value per row");
+    if (values.empty())
+      continue;
+    auto it = column_index_.find(name);
+    if (it != column_index_.end() && !columns_[it->second].accepts(values.front()))
+      throw std::invalid_argument("Can not store the value of attribute '" + name + "' in its column without loss");
+  }
+  auto row = append_row();
+  for (auto& [name, values] : attributemap)
+  {
+    if (values.empty())
+      continue;
+    auto& value = values.front();
+    auto c = add_column(name, AttributeType(value.index()));
+    columns_[c].set(row, value);
+  }
+}
+AttributeMap AttributeTable::row_map(size_t row) const
+{
+  AttributeMap attributemap;
+  for (size_t c = 0; c < columns_.size(); ++c)
+  {
+    if (!columns_[c].is_null(row))
+      attributemap[names_[c]].push_back(columns_[c].get(row));
+  }
+  return attributemap;
+}
+
+AttributeRow::AttributeRow(const AttributeTable& table, size_t row)
+  : table_(&table), row_(row) {}
+size_t AttributeRow::index() const
+{
+  return row_;
+}
+std::optional<attribute_value> AttributeRow::get(const std::string& name) const
 {
-  return attributes_.at(i);
+  if (!table_->has_column(name))
+    return std::nullopt;
+  auto& column = table_->column(name);
+  if (column.is_null(row_))
+    return std::nullopt;
+  return column.get(row_);
 }
-const AttributeMap& MultiTriangleCollection::attr_at(size_t i) const
+AttributeMap AttributeRow::to_map() const
 {
-  return attributes_.at(i);
+  return table_->row_map(row_);
 }
 
 } // namespace geoflow
@@ -17,6 +17,9 @@
 #pragma once
 
 #include <array>
+#include <atomic>
+#include <cstdint>
+#include <iterator>
 #include <vector>
 #include <optional>
 #include <unordered_map>
@@ -24,6 +27,8 @@
 #include <typeinfo>
 #include <typeindex>
 #include <string>
+#include <stdexcept>
+#include <thread>
 #include <variant>
 
 namespace geoflow
@@ -42,6 +47,124 @@ typedef std::vector<std::string> vec1s;
 // Attribute types
 typedef std::variant<bool, int, std:: string, float> attribute_value;
 typedef std::unordered_map<std::string, std::vector<attribute_value>> AttributeMap;
+// note that the order matches the alternatives of attribute_value
+enum AttributeType {GF_ATTRIBUTE_BOOL, GF_ATTRIBUTE_INT, GF_ATTRIBUTE_STRING, GF_ATTRIBUTE_FLOAT};
+
+// AttributeColumn stores the values of one attribute for all rows (features) of
+// an AttributeTable in a typed vector. Strings are dictionary encoded, ie. each
+// row stores an index into the list of distinct values. Rows can be null.
+// Numeric columns are widened (bool -> int -> float) when a value of a wider
+// type is set. An int is only stored as float if it is exactly representable
+// (|value| <= 2^24), otherwise std::invalid_argument is thrown, so no values
+// are truncated.
+class AttributeColumn
+{
+  AttributeType type_;
+  vec1b bools_;
+  vec1i ints_;
+  vec1f floats_;
+  std::vector<uint32_t> string_codes_;
+  vec1s dictionary_;
+  std::unordered_map<std::string, uint32_t> dictionary_index_;
+  vec1b is_null_;
+
+public:
+  AttributeColumn(AttributeType type);
+
+  AttributeType type() const;
+  size_t size() const;
+  void reserve(size_t n);
+  // converts the stored values to the wider numeric type, does nothing if the
+  // column is already at least as wide. Throws for string columns and for ints
+  // that a float can not represent exactly.
+  void widen(AttributeType type);
+  // true if set(row, value) would succeed for this value
+  bool accepts(const attribute_value& value) const;
+  // appends a null value
+  void push_back();
+  void push_back(const attribute_value& value);
+  void set(size_t row, const attribute_value& value);
+  void set(size_t row, float value);
+  void set(size_t row, int value);
+  void set(size_t row, bool value);
+  void set(size_t row, const std::string& value);
+  void set(size_t row, const char* value);
+  void set_null(size_t row);
+  bool is_null(size_t row) const;
+  attribute_value get(size_t row) const;
+
+  // typed access to the underlying storage, only the vector that matches type() is used
+  const vec1b& bools() const;
+  const vec1i& ints() const;
+  const vec1f& floats() const;
+  const std::vector<uint32_t>& string_codes() const;
+  const vec1s& dictionary() const;
+  const std::string& get_string(size_t row) const;
+};
+
+// AttributeTable is a columnar table with one row per feature. The schema
+// (column names and types) is shared by all rows, so appending a row costs one
+// push_back per column.
+class AttributeTable
+{
+  std::vector<AttributeColumn> columns_;
+  vec1s names_;
+  std::unordered_map<std::string, size_t> column_index_;
+  size_t row_count_ = 0;
+
+public:
+  // returns the index of the (new or existing) column with this name
+  size_t add_column(const std::string& name, AttributeType type);
+  bool has_column(const std::string& name) const;
+  size_t column_index(const std::string& name) const;
+  AttributeColumn& column(size_t i);
+  const AttributeColumn& column(size_t i) const;
+  AttributeColumn& column(const std::string& name);
+  const AttributeColumn& column(const std::string& name) const;
+  const vec1s& column_names() const;
+  size_t column_count() const;
+
+  size_t row_count() const;
+  void reserve(size_t row_count);
+  // appends a row with all values set to null and returns its index
+  size_t append_row();
+  // appends a row with values for the first sizeof...(values) columns, in
+  // column order, without building an AttributeMap. Remaining columns are null.
+  template<typename... Ts> size_t append_row(const Ts&... values) {
+    if (sizeof...(values) > columns_.size())
+      throw std::out_of_range("AttributeTable::append_row: more values than columns");
+    auto row = append_row();
+    size_t c = 0;
+    (columns_[c++].set(row, values), ...);
+    return row;
+  }
+  void clear();
+
+  // conversion from and to per feature AttributeMaps. Each attribute vector
+  // must hold at most one value, otherwise std::invalid_argument is thrown. New
+  // keys are added as columns. The map is validated before anything is
+  // written, so a rejected map leaves the table unchanged.
+  void push_back(const AttributeMap& attributemap);
+  AttributeMap row_map(size_t row) const;
+};
+
+// AttributeRow is a read-only view of one row of an AttributeTable, values are
+// read from the columns on access. It is valid as long as the table is.
+class AttributeRow
+{
+  const AttributeTable* table_;
+  size_t row_;
+
+public:
+  AttributeRow(const AttributeTable& table, size_t row);
+
+  size_t index() const;
+  // the value of the named column, empty if there is no such column or the
+  // value is null
+  std::optional<attribute_value> get(const std::string& name) const;
+  // copies the non-null values of the row
+  AttributeMap to_map() const;
+};
 
 class Box
 {
@@ -70,11 +193,29 @@ public:
 
 class Geometry
 {
+  // box() computes bbox lazily, also on inputs that are shared by nodes running
+  // in parallel, so the computation is guarded by this lock. Copies get their
+  // own unlocked lock.
+  class BoxLock
+  {
+    std::atomic_flag flag_ = ATOMIC_FLAG_INIT;
+
+  public:
+    BoxLock() {};
+    BoxLock(const BoxLock&) {};
+    BoxLock& operator=(const BoxLock&) { return *this; };
+    void lock() { while (flag_.test_and_set(std::memory_order_acquire)) std::this_thread::yield(); };
+    void unlock() { flag_.clear(std::memory_order_release); };
+  };
+  BoxLock box_lock_;
+
 protected:
   std::optional<Box> bbox;
   virtual void compute_box() = 0;
 
 public:
+  // safe to call from several threads at once, as long as the geometry is not
+  // modified at the same time
   virtual size_t vertex_count() const = 0;
   virtual const Box &box();
   size_t dimension();
@@ -141,25 +282,28 @@ public:
 
 // MultiTriangleCollection stores a collection of TriangleCollections along with
 // attributes for each TriangleCollection. The vector of TriangleCollections
-// `trianglecollections_` and the vector of AttributeMaps `attributes_`
+// `trianglecollections_` and the rows of the AttributeTable `attributes_`
 // supposed to have the same length when attributes are present, however this is
 // not enforced. The `attributes_` can be empty.
 class MultiTriangleCollection
 {
   std::vector<TriangleCollection> trianglecollections_;
-  std::vector<AttributeMap>       attributes_;
+  AttributeTable                  attributes_;
 
 public:
   void push_back(TriangleCollection & trianglecollection);
   void push_back(AttributeMap & attributemap);
   std::vector<TriangleCollection>& get_tricollections();
   const std::vector<TriangleCollection>& get_tricollections() const;
-  std::vector<AttributeMap>& get_attributes();
-  const std::vector<AttributeMap>& get_attributes() const;
+  // these used to return an AttributeMap, plugins that use them have to be
+  // ported to AttributeTable and rebuilt against this header
+  AttributeTable& get_attributes();
+  const AttributeTable& get_attributes() const;
   TriangleCollection& tri_at(size_t i);
   const TriangleCollection& tri_at(size_t i) const;
-  AttributeMap& attr_at(size_t i);
-  const AttributeMap& attr_at(size_t i) const;
+  // a view of row i of the attribute table, write to the columns of
+  // get_attributes() to modify it
+  AttributeRow attr_at(size_t i) const;
   size_t tri_size() const;
   size_t attr_size() const;
   bool has_attributes();
@@ -182,22 +326,126 @@ public:
   float *get_data_ptr();
 };
 
-class LineStringCollection : public GeometryCollection<vec3f>
+// VertexRange is a non-owning view on a contiguous sequence of vertices, eg. one
+// ring in a LinearRingCollection. It can be used much like a vec3f of fixed size.
+template <typename T>
+class VertexRange
 {
+  T* first_ = nullptr;
+  T* last_ = nullptr;
+
 public:
-  size_t vertex_count() const;
-  void compute_box();
-  float *get_data_ptr();
+  typedef T value_type;
+  typedef T* iterator;
+
+  VertexRange() {};
+  VertexRange(T* first, T* last) : first_(first), last_(last) {};
+  template <typename U> VertexRange(const VertexRange<U>& other) : first_(other.begin()), last_(other.end()) {};
+
+  T* begin() const { return first_; };
+  T* end() const { return last_; };
+  T* data() const { return first_; };
+  size_t size() const { return last_ - first_; };
+  bool empty() const { return first_ == last_; };
+  T& operator[](size_t i) const { return first_[i]; };
+  T& front() const { return *first_; };
+  T& back() const { return *(last_ - 1); };
+  operator vec3f() const { return vec3f(first_, last_); };
 };
-
-class LinearRingCollection : public GeometryCollection<vec3f>
+typedef VertexRange<arr3f> RingView;
+typedef VertexRange<const arr3f> ConstRingView;
+
+// VertexRangeCollection stores a sequence of vertex ranges (rings or linestrings)
+// in one flat vertex buffer. Range i spans vertices [offsets_[i], offsets_[i+1])
+// of `vertices_`, so `offsets_` always holds one element more than there are
+// ranges. Elements are accessed as RingView's that point into `vertices_`, hence
+// they are invalidated when the collection grows.
+class VertexRangeCollection : public Geometry
 {
+protected:
+  vec3f vertices_;
+  std::vector<size_t> offsets_ = {0};
+
 public:
+  // iterator that keeps the current view as a member so that range-based for
+  // loops with `auto&` keep working. The reference is valid until the next increment.
+  template <typename T>
+  class RangeIterator
+  {
+    T* vertices_;
+    const size_t* offset_;
+    VertexRange<T> current_;
+
+  public:
+    typedef std::input_iterator_tag iterator_category;
+    typedef VertexRange<T> value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef VertexRange<T>* pointer;
+    typedef VertexRange<T>& reference;
+
+    RangeIterator(T* vertices, const size_t* offset) : vertices_(vertices), offset_(offset) {};
+    reference operator*() { current_ = VertexRange<T>(vertices_ + offset_[0], vertices_ + offset_[1]); return current_; };
+    pointer operator->() { return &(**this); };
+    RangeIterator& operator++() { ++offset_; return *this; };
+    RangeIterator operator++(int) { auto it = *this; ++offset_; return it; };
+    bool operator==(const RangeIterator& other) const { return offset_ == other.offset_; };
+    bool operator!=(const RangeIterator& other) const { return offset_ != other.offset_; };
+  };
+  typedef RangeIterator<arr3f> iterator;
+  typedef RangeIterator<const arr3f> const_iterator;
+
+  iterator begin() { return iterator(vertices_.data(), offsets_.data()); };
+  iterator end() { return iterator(vertices_.data(), offsets_.data() + size()); };
+  const_iterator begin() const { return const_iterator(vertices_.data(), offsets_.data()); };
+  const_iterator end() const { return const_iterator(vertices_.data(), offsets_.data() + size()); };
+
+  size_t size() const { return offsets_.size() - 1; };
+  bool empty() const { return offsets_.size() == 1; };
+  RingView operator[](size_t i);
+  ConstRingView operator[](size_t i) const;
+  RingView front() { return (*this)[0]; };
+  ConstRingView front() const { return (*this)[0]; };
+  RingView back() { return (*this)[size() - 1]; };
+  ConstRingView back() const { return (*this)[size() - 1]; };
+
+  void push_back(const vec3f& range);
+  template <typename T> void push_back(const VertexRange<T>& range) {
+    // the range may point into our own vertex buffer, which can be reallocated
+    if (range.begin() >= vertices_.data() && range.begin() < vertices_.data() + vertices_.size()) {
+      size_t first = range.begin() - vertices_.data();
+      size_t n = range.size();
+      vertices_.reserve(vertices_.size() + n);
+      for (size_t i = first; i < first + n; ++i)
+        vertices_.push_back(vertices_[i]);
+      offsets_.push_back(vertices_.size());
+    } else {
+      push_back(range.begin(), range.end());
+    }
+  };
+  template <typename InputIt> void push_back(InputIt first, InputIt last) {
+    vertices_.insert(vertices_.end(), first, last);
+    offsets_.push_back(vertices_.size());
+  };
+  void reserve(size_t range_count, size_t vertex_count = 0);
+  void clear();
+
+  vec3f& vertices();
+  const vec3f& vertices() const;
+  const std::vector<size_t>& offsets() const;
+
   size_t vertex_count() const;
   void compute_box();
   float *get_data_ptr();
 };
 
+class LineStringCollection : public VertexRangeCollection
+{
+};
+
+class LinearRingCollection : public VertexRangeCollection
+{
+};
+
 
 // struct AttributeVec {
 //   AttributeVec(std::type_index ttype) : value_type(ttype) {};
@@ -206,7 +454,7 @@ public:
 // };
 
 // class Mesh : public Geometry {
-// use indexed vertices?
+// see IndexedMesh for a variant that shares vertices between faces
 class Mesh {
   std::vector<LinearRing> polygons_;
   std::vector<int> labels_;
@@ -229,4 +477,60 @@ class Mesh {
   // const std::unordered_map<std::string, AttributeVec>&  get_attributes() const;
 };
 
+// IndexedMesh stores polygonal faces that share one vertex array. Face i consists
+// of the rings [face_offsets_[i], face_offsets_[i+1]), the first of which is the
+// exterior ring and the others are holes. Ring j is the list of vertex indices
+// [ring_offsets_[j], ring_offsets_[j+1]) in `indices_`. Each face has a label.
+class IndexedMesh : public Geometry
+{
+  vec3f vertices_;
+  std::vector<uint32_t> indices_;
+  std::vector<size_t> ring_offsets_ = {0};
+  std::vector<size_t> face_offsets_ = {0};
+  std::vector<int> labels_;
+
+protected:
+  void compute_box();
+
+public:
+  typedef VertexRange<const uint32_t> IndexRing;
+
+  uint32_t push_vertex(const arr3f& vertex);
+  void push_face(const std::vector<uint32_t>& exterior, int label = 0);
+  void push_face(const std::vector<uint32_t>& exterior, const std::vector<std::vector<uint32_t>>& interiors, int label = 0);
+  void clear();
+
+  size_t face_count() const;
+  size_t ring_count(size_t face) const;
+  IndexRing face_ring(size_t face, size_t ring = 0) const;
+  int face_label(size_t face) const;
+
+  vec3f& vertices();
+  const vec3f& vertices() const;
+  const std::vector<uint32_t>& indices() const;
+  std::vector<int>& labels();
+  const std::vector<int>& labels() const;
+
+  // de-indexed copies of the faces
+  LinearRing face_polygon(size_t face) const;
+  Mesh to_mesh() const;
+
+  // index buffers for the viewer. Faces are triangulated with their holes by
+  // ear clipping (see triangulate.hpp). The edge indices contain one pair per
+  // ring edge (eg. for GL_LINES).
+  std::vector<uint32_t> triangle_indices() const;
+  std::vector<uint32_t> edge_indices() const;
+
+  size_t vertex_count() const;
+  float *get_data_ptr();
+};
+
+// Weld the vertices of a Mesh or TriangleCollection into an IndexedMesh. With a
+// tolerance of 0 only bitwise identical vertices are merged, otherwise vertices
+// are snapped to a grid with cell size `tolerance` and merged per cell. Rings
+// that collapse to fewer than 3 vertices are dropped, a face whose exterior
+// collapses is dropped entirely.
+IndexedMesh weld_vertices(const Mesh& mesh, float tolerance = 0);
+IndexedMesh weld_vertices(const TriangleCollection& triangles, float tolerance = 0);
+
 } // namespace geoflow
@@ -1,11 +1,23 @@
 #include "geoflow.hpp"
+#include "spatial_index.hpp"
+#include "neighbour_index.hpp"
+#include "space_filling_curve.hpp"
+#include "selection.hpp"
+#include "quantized_points.hpp"
+#include "mapped_points.hpp"
+#include "raster.hpp"
+#include "expression.hpp"
+#include "triangulate.hpp"
+#include "parallel.hpp"
 #ifdef GF_BUILD_WITH_GUI
   #include "imgui.h"
   #include "gui/parameter_widgets.hpp"
 #endif
 
+#include <atomic>
 #include <chrono>
 #include <ctime>
+#include <numeric>
 // #include <taskflow/taskflow.hpp>
 
 namespace geoflow::nodes::core {
@@ -17,6 +29,521 @@ namespace geoflow::nodes::core {
     void process(){};
   };
 
+  class SpatialIndexNode : public Node {
+    int node_size_=16;
+
+    template<typename T> void add_boxes(std::vector<Box>& boxes) {
+      auto& geometries = input("geometries");
+      for(size_t i=0; i<geometries.size(); ++i) {
+        auto& geometry = geometries.get<T&>(i);
+        boxes.push_back(geometry.box());
+      }
+    }
+
+    public:
+    using Node::Node;
+
+    void init() {
+      add_input("geometries", {
+        typeid(PointCollection),
+        typeid(TriangleCollection),
+        typeid(SegmentCollection),
+        typeid(LineStringCollection),
+        typeid(LinearRingCollection),
+        typeid(IndexedMesh),
+        typeid(LinearRing),
+        typeid(LineString),
+        typeid(Segment)
+      });
+      add_output("index", typeid(PackedRTree));
+      add_param(ParamBoundedInt(node_size_, 2, 64, "node_size", "Maximum number of children per tree node"));
+    };
+
+    void process() {
+      auto& geometries = input("geometries");
+      std::vector<Box> boxes;
+      // a collection gives one box per element, a vector of single geometries one box per geometry
+      if (geometries.is_connected_type(typeid(PointCollection))) {
+        boxes = element_boxes(geometries.get<PointCollection&>());
+      } else if (geometries.is_connected_type(typeid(TriangleCollection))) {
+        boxes = element_boxes(geometries.get<TriangleCollection&>());
+      } else if (geometries.is_connected_type(typeid(SegmentCollection))) {
+        boxes = element_boxes(geometries.get<SegmentCollection&>());
+      } else if (geometries.is_connected_type(typeid(LineStringCollection))) {
+        boxes = element_boxes(geometries.get<LineStringCollection&>());
+      } else if (geometries.is_connected_type(typeid(LinearRingCollection))) {
+        boxes = element_boxes(geometries.get<LinearRingCollection&>());
+      } else if (geometries.is_connected_type(typeid(IndexedMesh))) {
+        boxes = element_boxes(geometries.get<IndexedMesh&>());
+      } else if (geometries.is_connected_type(typeid(LinearRing))) {
+        add_boxes<LinearRing>(boxes);
+      } else if (geometries.is_connected_type(typeid(LineString))) {
+        add_boxes<LineString>(boxes);
+      } else if (geometries.is_connected_type(typeid(Segment))) {
+        add_boxes<Segment>(boxes);
+      }
+      output("index").set(PackedRTree(boxes, node_size_));
+    }
+  };
+
+  class NeighbourIndexNode : public Node {
+    int leaf_size_=32;
+
+    public:
+    using Node::Node;
+
+    void init() {
+      add_input("points", typeid(PointCollection));
+      add_output("index", typeid(KDTree));
+      add_param(ParamBoundedInt(leaf_size_, 1, 256, "leaf_size", "Maximum number of points per tree leaf"));
+    };
+
+    void process() {
+      auto& points = input("points").get<PointCollection&>();
+      output("index").set(KDTree(points, leaf_size_));
+    }
+  };
+
+  class SpaceFillingCurveSortNode : public Node {
+    bool use_hilbert_=true;
+
+    template<typename T> void permute_attribute(const gfSingleFeatureOutputTerminal& attribute, const vec1ui& order) {
+      auto& values = attribute.get<const T&>();
+      if (values.size() != order.size())
+        throw gfException("attribute \""+attribute.get_name()+"\" has a different size than points in " + get_name());
+      poly_output("attributes").add(attribute.get_name(), typeid(T)).set(permute(values, order));
+    }
+
+    public:
+    using Node::Node;
+
+    void init() {
+      add_input("points", typeid(PointCollection));
+      add_poly_input("attributes", {typeid(vec1f), typeid(vec1i)}, true);
+      add_output("points", typeid(PointCollection));
+      add_poly_output("attributes", {typeid(vec1f), typeid(vec1i)});
+      add_output("permutation", typeid(vec1ui));
+      add_param(ParamBool(use_hilbert_, "use_hilbert", "Order along a Hilbert curve instead of a Morton (Z-order) curve"));
+    };
+
+    void process() {
+      auto& points = input("points").get<PointCollection&>();
+      auto order = curve_order(points, use_hilbert_ ? GF_CURVE_HILBERT : GF_CURVE_MORTON);
+      output("points").set(permute(points, order));
+      for (auto attribute : poly_input("attributes").sub_terminals()) {
+        if (attribute->get_type() == typeid(vec1f)) {
+          permute_attribute<vec1f>(*attribute, order);
+        } else if (attribute->get_type() == typeid(vec1i)) {
+          permute_attribute<vec1i>(*attribute, order);
+        }
+      }
+      output("permutation").set(order);
+    }
+  };
+
+  class SelectRangeNode : public Node {
+    std::pair<float,float> range_ = {0,1};
+
+    template<typename T> Selection select(const T& values) {
+      auto [low, high] = range_;
+      auto in_range = [&](size_t i) { return values[i] >= low && values[i] <= high; };
+      // within an incoming selection we only need to test the elements it holds
+      if (input("selection").has_data()) {
+        auto& selection = input("selection").get<Selection&>();
+        if (selection.universe_size() != values.size())
+          throw gfException("selection does not match the size of values in " + get_name());
+        return selection.filter(in_range);
+      }
+      return Selection::where(values.size(), in_range);
+    }
+
+    public:
+    using Node::Node;
+
+    void init() {
+      add_input("values", {typeid(vec1f), typeid(vec1i)});
+      add_input("selection", typeid(Selection), true);
+      add_output("selection", typeid(Selection));
+      add_param(ParamFloatRange(range_, "range", "Select elements with a value in this (inclusive) range"));
+    };
+
+    void process() {
+      auto& values = input("values");
+      if (values.is_connected_type(typeid(vec1f)))
+        output("selection").set(select(values.get<vec1f&>()));
+      else
+        output("selection").set(select(values.get<vec1i&>()));
+    }
+  };
+
+  class SelectionAndNode : public Node {
+    public:
+    using Node::Node;
+    void init() {
+      add_input("a", typeid(Selection));
+      add_input("b", typeid(Selection));
+      add_output("selection", typeid(Selection));
+    };
+    void process() {
+      output("selection").set(input("a").get<Selection&>() & input("b").get<Selection&>());
+    }
+  };
+
+  class SelectionOrNode : public Node {
+    public:
+    using Node::Node;
+    void init() {
+      add_input("a", typeid(Selection));
+      add_input("b", typeid(Selection));
+      add_output("selection", typeid(Selection));
+    };
+    void process() {
+      output("selection").set(input("a").get<Selection&>() | input("b").get<Selection&>());
+    }
+  };
+
+  class SelectionNotNode : public Node {
+    public:
+    using Node::Node;
+    void init() {
+      add_input("selection", typeid(Selection));
+      add_output("selection", typeid(Selection));
+    };
+    void process() {
+      output("selection").set(~input("selection").get<Selection&>());
+    }
+  };
+
+  // copies the selected points and attributes, for consumers that need a contiguous PointCollection
+  class ApplySelectionNode : public Node {
+    template<typename T> void select_attribute(const gfSingleFeatureOutputTerminal& attribute, const Selection& selection) {
+      poly_output("attributes").add(attribute.get_name(), typeid(T)).set(materialize(attribute.get<const T&>(), selection));
+    }
+
+    public:
+    using Node::Node;
+
+    void init() {
+      add_input("points", typeid(PointCollection));
+      add_input("selection", typeid(Selection));
+      add_poly_input("attributes", {typeid(vec1f), typeid(vec1i)}, true);
+      add_output("points", typeid(PointCollection));
+      add_poly_output("attributes", {typeid(vec1f), typeid(vec1i)});
+    };
+
+    void process() {
+      auto& selection = input("selection").get<Selection&>();
+      output("points").set(materialize(input("points").get<PointCollection&>(), selection));
+      for (auto attribute : poly_input("attributes").sub_terminals()) {
+        if (attribute->get_type() == typeid(vec1f)) {
+          select_attribute<vec1f>(*attribute, selection);
+        } else if (attribute->get_type() == typeid(vec1i)) {
+          select_attribute<vec1i>(*attribute, selection);
+        }
+      }
+    }
+  };
+
+  class QuantizePointsNode : public Node {
+    float resolution_=0.001;
+
+    public:
+    using Node::Node;
+
+    void init() {
+      add_input("points", typeid(PointCollection));
+      add_output("points", typeid(QuantizedPointCollection));
+      add_param(ParamFloat(resolution_, "resolution", "Grid size that coordinates are rounded to"));
+    };
+
+    void process() {
+      auto& points = input("points").get<PointCollection&>();
+      auto offset = manager.get_data_offset().value_or(std::array<double,3>{0,0,0});
+      output("points").set(QuantizedPointCollection(points, resolution_, offset));
+    }
+  };
+
+  class DequantizePointsNode : public Node {
+    public:
+    using Node::Node;
+
+    void init() {
+      add_input("points", typeid(QuantizedPointCollection));
+      add_output("points", typeid(PointCollection));
+    };
+
+    void process() {
+      output("points").set(input("points").get<QuantizedPointCollection&>().decode());
+    }
+  };
+
+  class MapPointsNode : public Node {
+    std::string filepath_;
+    size_t chunk_size_=1<<20;
+
+    public:
+    using Node::Node;
+
+    void init() {
+      add_input("points", typeid(PointCollection));
+      add_output("points", typeid(MappedPointCollection));
+      add_param(ParamPath(filepath_, "filepath", "File to store the points in, a temporary file is used if empty"));
+    };
+
+    void process() {
+      auto& points = input("points").get<PointCollection&>();
+      auto mapped = MappedPointCollection::create(filepath_, points.size());
+      // write in chunks so that written pages can be evicted along the way
+      for_each_chunk(points, chunk_size_, [&](size_t first, PointChunk chunk) {
+        mapped.append(chunk.data(), chunk.size());
+        mapped.release(first, first + chunk.size());
+      });
+      mapped.flush();
+      output("points").set(mapped);
+    }
+  };
+
+  class OpenMappedPointsNode : public Node {
+    std::string filepath_;
+
+    public:
+    using Node::Node;
+
+    void init() {
+      add_output("points", typeid(MappedPointCollection));
+      add_param(ParamPath(filepath_, "filepath", "Point file written by MapPoints"));
+    };
+
+    void process() {
+      output("points").set(MappedPointCollection::open(filepath_));
+    }
+  };
+
+  // reads an XYZ text file straight into a memory-mapped point file, so the
+  // points never have to fit in RAM
+  class MapXYZFileNode : public Node {
+    std::string xyz_filepath_;
+    std::string filepath_;
+    size_t chunk_size_=1<<20;
+
+    public:
+    using Node::Node;
+
+    void init() {
+      add_output("points", typeid(MappedPointCollection));
+      add_param(ParamPath(xyz_filepath_, "xyz_filepath", "Text file with one x y z point per line"));
+      add_param(ParamPath(filepath_, "filepath", "File to store the points in, a temporary file is used if empty"));
+    };
+
+    void process() {
+      // the first point sets the offset if no other node did
+      auto resolve_offset = [this](const std::array<double, 3>& first_point) {
+        return manager.set_data_offset(first_point);
+      };
+      output("points").set(MappedPointCollection::read_xyz(xyz_filepath_, resolve_offset, filepath_, chunk_size_));
+    }
+  };
+
+  // maximum point height per cell, eg. to make a DSM. Memory-mapped points are
+  // read chunk by chunk, so they do not need to fit in RAM.
+  class RasterizePointsNode : public Node {
+    float cell_size_=1.0;
+    bool use_memory_map_=false;
+    size_t chunk_size_=1<<22;
+
+    public:
+    using Node::Node;
+
+    void init() {
+      add_input("points", {typeid(PointCollection), typeid(MappedPointCollection)});
+      add_output("raster", typeid(TiledRaster));
+      add_param(ParamFloat(cell_size_, "cell_size", "Raster cell size"));
+      add_param(ParamBool(use_memory_map_, "use_memory_map", "Keep the raster tiles in a temporary memory-mapped file"));
+    };
+
+    void process() {
+      auto& points_term = input("points");
+      if (points_term.is_connected_type(typeid(MappedPointCollection))) {
+        auto& points = points_term.get<MappedPointCollection&>();
+        output("raster").set(rasterize(points, chunk_size_));
+      } else {
+        auto& points = points_term.get<PointCollection&>();
+        // in memory there is no need to split, use a single chunk
+        output("raster").set(rasterize(points, points.size()));
+      }
+    }
+
+    template<typename Points> TiledRaster rasterize(const Points& points, size_t chunk_size) {
+      if (points.empty())
+        return TiledRaster(0, 0, {0,0}, cell_size_);
+      Box box;
+      for_each_chunk(points, chunk_size, [&](size_t, PointChunk chunk) {
+        for (auto& p : chunk)
+          box.add(p);
+      });
+      auto pmin = box.min(), pmax = box.max();
+      size_t width = size_t((pmax[0]-pmin[0])/cell_size_) + 1;
+      size_t height = size_t((pmax[1]-pmin[1])/cell_size_) + 1;
+      arr2f origin = {pmin[0], pmin[1]};
+      auto raster = use_memory_map_ ? TiledRaster::mapped(width, height, origin, cell_size_) : TiledRaster(width, height, origin, cell_size_);
+
+      // bucket the points of each chunk per tile so that the tiles can be filled in parallel
+      std::vector<size_t> tile_of, tile_begin, order;
+      for_each_chunk(points, chunk_size, [&](size_t, PointChunk chunk) {
+        tile_of.resize(chunk.size());
+        order.resize(chunk.size());
+        tile_begin.assign(raster.tile_count()+1, 0);
+        for (size_t i=0; i<chunk.size(); ++i) {
+          // points on the maximum edge of the box can round to just outside the raster
+          size_t col=width-1, row=height-1;
+          raster.locate(chunk[i][0], chunk[i][1], col, row);
+          tile_of[i] = (row/raster.tile_size())*raster.tile_cols() + col/raster.tile_size();
+          ++tile_begin[tile_of[i]+1];
+        }
+        std::partial_sum(tile_begin.begin(), tile_begin.end(), tile_begin.begin());
+        auto position = tile_begin;
+        for (size_t i=0; i<chunk.size(); ++i)
+          order[position[tile_of[i]]++] = i;
+
+        raster.for_each_tile([&](RasterTile& tile) {
+          for (size_t j=tile_begin[tile.index]; j<tile_begin[tile.index+1]; ++j) {
+            auto& p = chunk[order[j]];
+            size_t col=width-1, row=height-1;
+            raster.locate(p[0], p[1], col, row);
+            auto value = raster.get(col, row);
+            if (raster.is_nodata(value) || p[2] > value)
+              raster.set(col, row, p[2]);
+          }
+        });
+      });
+      return raster;
+    }
+  };
+
+  class RasterDifferenceNode : public Node {
+    public:
+    using Node::Node;
+
+    void init() {
+      add_input("a", typeid(TiledRaster));
+      add_input("b", typeid(TiledRaster));
+      add_output("difference", typeid(TiledRaster));
+    };
+
+    void process() {
+      auto& a = input("a").get<TiledRaster&>();
+      auto& b = input("b").get<TiledRaster&>();
+      if (a.width()!=b.width() || a.height()!=b.height() || a.cell_size()!=b.cell_size() || a.origin()!=b.origin())
+        throw gfException("rasters a and b are not aligned in " + get_name());
+      auto difference = a.is_mapped() ?
+        TiledRaster::mapped(a.width(), a.height(), a.origin(), a.cell_size(), a.nodata(), a.tile_size()) :
+        TiledRaster(a.width(), a.height(), a.origin(), a.cell_size(), a.nodata(), a.tile_size());
+      difference.for_each_tile([&](RasterTile& tile) {
+        if (a.tile_size()==b.tile_size() && !a.is_allocated(tile.index) && !b.is_allocated(tile.index))
+          return;
+        for (size_t r=0; r<tile.height; ++r) {
+          for (size_t c=0; c<tile.width; ++c) {
+            auto va = a.get(tile.col+c, tile.row+r);
+            auto vb = b.get(tile.col+c, tile.row+r);
+            if (!a.is_nodata(va) && !b.is_nodata(vb))
+              tile.set(c, r, va-vb);
+          }
+        }
+      });
+      output("difference").set(difference);
+    }
+  };
+
+  class AttributeCalculatorNode : public Node {
+    std::string expression_;
+    Expression compiled_;
+    std::string compiled_key_;
+
+    // numeric flowchart globals can be used as constants in the expression
+    std::unordered_map<std::string, float> global_constants() {
+      std::unordered_map<std::string, float> constants;
+      for (auto& [name, param] : manager.global_flowchart_params) {
+        if (auto p = dynamic_cast<ParameterByValue<float>*>(param.get()))
+          constants[name] = p->get();
+        else if (auto p = dynamic_cast<ParameterByValue<int>*>(param.get()))
+          constants[name] = float(p->get());
+        else if (auto p = dynamic_cast<ParameterByValue<bool>*>(param.get()))
+          constants[name] = p->get();
+      }
+      return constants;
+    }
+
+    public:
+    using Node::Node;
+
+    void init() {
+      add_poly_input("attributes", {typeid(vec1f), typeid(vec1i)}, true);
+      add_output("result", typeid(vec1f));
+      add_param(ParamString(expression_, "expression", "Expression over the attribute names and numeric globals, eg. z - dtm"));
+    };
+
+    void process() {
+      std::vector<std::string> names;
+      std::vector<ExpressionColumn> columns;
+      for (auto attribute : poly_input("attributes").sub_terminals()) {
+        names.push_back(attribute->get_name());
+        if (attribute->get_type() == typeid(vec1f))
+          columns.emplace_back(attribute->get<const vec1f&>());
+        else
+          columns.emplace_back(attribute->get<const vec1i&>());
+      }
+      auto constants = global_constants();
+
+      // only compile again if the expression, the inputs or the globals changed
+      std::string key = expression_;
+      for (auto& name : names) key += "\n" + name;
+      for (auto& [name, value] : constants) key += "\n" + name + "=" + std::to_string(value);
+      try {
+        if (key != compiled_key_) {
+          compiled_ = Expression(expression_, names, constants);
+          compiled_key_ = key;
+        }
+        output("result").set(compiled_.evaluate(columns));
+      } catch (const std::invalid_argument& e) {
+        throw gfException(std::string(e.what()) + " in " + get_name());
+      }
+    }
+  };
+
+  class TriangulatePolygonsNode : public Node {
+    public:
+    using Node::Node;
+
+    void init() {
+      add_input("polygons", {typeid(LinearRingCollection), typeid(LinearRing)});
+      add_output("triangles", typeid(TriangleCollection));
+      add_output("mesh", typeid(IndexedMesh));
+    };
+
+    size_t estimate_memory() {
+      // about one 36 byte triangle per 12 byte vertex, plus the mesh with its
+      // own copy of the vertices and 3 indices per triangle
+      return 6 * input_memory_size();
+    }
+
+    void process() {
+      auto& polygons = input("polygons");
+      if (polygons.is_connected_type(typeid(LinearRingCollection))) {
+        auto& rings = polygons.get<LinearRingCollection&>();
+        if (output_requested("triangles")) output("triangles").set(triangulate(rings));
+        if (output_requested("mesh")) output("mesh").set(triangulate_mesh(rings));
+      } else {
+        // a vector of polygons with holes
+        std::vector<const LinearRing*> rings;
+        for(size_t i=0; i<polygons.size(); ++i) {
+          rings.push_back(&polygons.get<LinearRing&>(i));
+        }
+        if (output_requested("triangles")) output("triangles").set(triangulate(rings));
+        if (output_requested("mesh")) output("mesh").set(triangulate_mesh(rings));
+      }
+    }
+  };
+
   class NestNode : public Node {
     private:
     bool flowchart_loaded=false;
@@ -80,6 +607,15 @@ namespace geoflow::nodes::core {
     };
     void post_parameter_load() {
       flowchart_loaded = load_nodes();
+      update_concurrency();
+    }
+    std::vector<std::string> validate() {
+      if (!flowchart_loaded)
+        return {"nested flowchart " + filepath_ + " could not be loaded"};
+      std::vector<std::string> problems;
+      for (auto& problem : nested_node_manager_->validate(true))
+        problems.push_back(filepath_ + ": " + problem);
+      return problems;
     }
 
     #ifdef GF_BUILD_WITH_GUI
@@ -92,8 +628,10 @@ namespace geoflow::nodes::core {
           ImGui::PopID();
         }
         ImGui::Separator();
-        if(ImGui::Button("Load Nodes"))
+        if(ImGui::Button("Load Nodes")) {
           flowchart_loaded = load_nodes();
+          update_concurrency();
+        }
         ImGui::SameLine();
         if(ImGui::Button("Sync globals"))
           for (auto& [key,val] : manager.global_flowchart_params) {
@@ -104,7 +642,8 @@ namespace geoflow::nodes::core {
 
     std::shared_ptr<NodeManager> copy_nested_flowchart() {
       auto flowchart = std::make_shared<NodeManager>(*nested_node_manager_);
-      flowchart->data_offset = *manager.data_offset;
+      flowchart->data_offset = manager.get_data_offset();
+      flowchart->set_cancellation_token(manager.get_cancellation_token());
       // set up proxy node
       auto R = std::make_shared<NodeRegister>("ProxyRegister");
       R->register_node<ProxyNode>("Proxy");
@@ -151,94 +690,138 @@ namespace geoflow::nodes::core {
       }
     }
 
-    void process_parallel() {
-      // repack input data
-      // assume all vector inputs have the same size
-
-      // std::vector<std::shared_ptr<NodeManager>> flowcharts;
-      // for(size_t i=0; i<input_size_; ++i) {
-      //   auto fc = copy_nested_flowchart();
-      //   for (auto& [key,val] : manager.global_flowchart_params) {
-      //     fc->global_flowchart_params[key] = val;
-      //   }
-      //   fc->global_flowchart_params["GF_I"] = std::make_shared<ParameterByValue<std::string>>(std::to_string(i), "GF_I", "");
-      //   set_inputs(fc, i);
-      //   flowcharts.push_back(fc);
-      // }
-
-      // tf::Executor executor;
-      // tf::Taskflow taskflow;
-      // for(auto& fc : flowcharts) {
-      //   tf::Task task = taskflow.emplace([&](){ 
-      //     auto& proxy_node = fc->get_node(proxy_node_name_);
-      //     fc->run(proxy_node, false);
-      //    });
-      // }
-      // executor.run(taskflow).wait();
+    // outputs of one run of the nested flowchart, for the marked output terminals
+    struct NestedOutputs {
+      std::vector<std::pair<std::string, std::vector<std::any>>> vectors;
+      std::vector<std::tuple<std::string, std::string, std::type_index, std::vector<std::any>>> polys;
+      float runtime;
     };
 
-    void process_sequential() {
-      // repack input data
-      // assume all vector inputs have the same size
-      auto flowchart = copy_nested_flowchart();
+    NestedOutputs run_item(std::shared_ptr<NodeManager>& flowchart, size_t i) {
       auto& proxy_node = flowchart->get_node(proxy_node_name_);
-      float runtime;
-      for(size_t i=0; i<input_size_; ++i) {
-        proxy_node->notify_children();
-        // prep inputs
-        for (auto& [key,val] : manager.global_flowchart_params) {
-          flowchart->global_flowchart_params[key] = val;
-        }
-        flowchart->global_flowchart_params["GF_I"] = std::make_shared<ParameterByValue<std::string>>(std::to_string(i), "GF_I", "");
-        set_inputs(flowchart, i);
-        // run
-        std::cout << "Processing item " << i+1 << "/" << input_size_ << "\n";
-        std::clock_t c_start = std::clock(); // CPU time
-        // auto t_start = std::chrono::high_resolution_clock::now(); // Wall time
-        flowchart->run_all(false);
-        std::clock_t c_end = std::clock(); // CPU time
-        // auto t_end = std::chrono::high_resolution_clock::now(); // Wall time
-        runtime = 1000.0 * (c_end-c_start) / CLOCKS_PER_SEC;
-        std::cout << ".. " << runtime << "ms\n";
-        // collect outputs and push directly to vector outputs
-        for (auto& [node_name, node] : flowchart->get_nodes()) {
-          for (auto& [term_name, output_term_] : node->output_terminals) {
-            if (output_term_->is_marked()) {
-              if (output_term_->get_family() == GF_SINGLE_FEATURE) {
-                auto output_term = (gfSingleFeatureOutputTerminal*)(output_term_.get());
-                if (output_term->has_data()) {
-                  for (auto& data : output_term->get_data_vec()) {
-                    vector_output(node_name+"."+term_name).push_back_any(data);
-                  }
-                } else {
-                  std::cout << "pushing empty any for " << node_name+"."+term_name << "at i=" << i << std::endl;
-                  vector_output(node_name+"."+term_name).push_back_any(std::any());
-                }
+      proxy_node->notify_children();
+      // prep inputs
+      for (auto& [key,val] : manager.global_flowchart_params) {
+        flowchart->global_flowchart_params[key] = val;
+      }
+      flowchart->global_flowchart_params["GF_I"] = std::make_shared<ParameterByValue<std::string>>(std::to_string(i), "GF_I", "");
+      set_inputs(flowchart, i);
+      // run, timed in wall time as the lanes share the process CPU time.
+      // Progress goes through report_progress, the lanes do not print.
+      auto t_start = std::chrono::steady_clock::now();
+      flowchart->run_all(false);
+      NestedOutputs outputs;
+      outputs.runtime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - t_start).count();
+      // collect outputs
+      for (auto& [node_name, node] : flowchart->get_nodes()) {
+        for (auto& [term_name, output_term_] : node->output_terminals) {
+          if (output_term_->is_marked()) {
+            if (output_term_->get_family() == GF_SINGLE_FEATURE) {
+              auto output_term = (gfSingleFeatureOutputTerminal*)(output_term_.get());
+              if (output_term->has_data()) {
+                outputs.vectors.emplace_back(node_name+"."+term_name, output_term->get_data_vec());
               } else {
-                auto output_term = (gfMultiFeatureOutputTerminal*)(output_term_.get());
-                auto& aggregate_poly_out = poly_output(node_name+"."+term_name);
-                for (auto& [name, sub_term]: output_term->sub_terminals()) {
-                  if(i==0) {
-                    aggregate_poly_out.add_vector(name, sub_term->get_type());
-                  }
-                  for (auto& data : sub_term->get_data_vec()) {
-                    aggregate_poly_out.sub_terminal(name).push_back_any(data);
-                  }
-                }
+                outputs.vectors.emplace_back(node_name+"."+term_name, std::vector<std::any>{std::any()});
+              }
+            } else {
+              auto output_term = (gfMultiFeatureOutputTerminal*)(output_term_.get());
+              for (auto& [name, sub_term]: output_term->sub_terminals()) {
+                outputs.polys.emplace_back(node_name+"."+term_name, name, sub_term->get_type(), sub_term->get_data_vec());
               }
             }
           }
         }
-        vector_output(get_name()+".timings").push_back(runtime);
+      }
+      return outputs;
+    }
+
+    // push the outputs of item i directly to the vector outputs
+    void push_outputs(NestedOutputs& outputs, size_t i) {
+      for (auto& [name, data_vec] : outputs.vectors) {
+        for (auto& data : data_vec) {
+          vector_output(name).push_back_any(data);
+        }
+      }
+      for (auto& [name, sub_name, type, data_vec] : outputs.polys) {
+        auto& aggregate_poly_out = poly_output(name);
+        if(i==0) {
+          aggregate_poly_out.add_vector(sub_name, type);
+        }
+        for (auto& data : data_vec) {
+          aggregate_poly_out.sub_terminal(sub_name).push_back_any(data);
+        }
+      }
+      vector_output(get_name()+".timings").push_back(outputs.runtime);
+    }
+
+    // Runs the items on the shared executor, each lane with its own copy of the
+    // nested flowchart. Fewer lanes run when the nested nodes have a resource
+    // cost above one, and serialized nested nodes take their type lock. The
+    // results are pushed in item order.
+    void process_parallel() {
+      float item_cost = 1;
+      for (auto& [name, node] : nested_node_manager_->get_nodes()) {
+        item_cost = std::max(item_cost, node->get_resource_cost());
+      }
+      size_t lane_count = std::max<size_t>(1, std::min<size_t>(input_size_, size_t(float(thread_count()) / item_cost)));
+      std::vector<std::shared_ptr<NodeManager>> flowcharts;
+      for (size_t l=0; l<lane_count; ++l) {
+        flowcharts.push_back(copy_nested_flowchart());
+      }
+      std::vector<NestedOutputs> outputs(input_size_);
+      std::atomic<size_t> next_item{0}, done_items{0};
+      TaskGroup lanes;
+      report_progress(0, input_size_);
+      for (auto& flowchart : flowcharts) {
+        lanes.run([&]() {
+          for (size_t i; !is_cancelled() && (i = next_item++) < input_size_;) {
+            outputs[i] = run_item(flowchart, i);
+            report_progress(++done_items, input_size_);
+          }
+        });
+      }
+      lanes.wait();
+      if (is_cancelled()) return;
+      for(size_t i=0; i<input_size_; ++i) {
+        push_outputs(outputs[i], i);
+      }
+    };
+
+    void process_sequential() {
+      // repack input data
+      // assume all vector inputs have the same size
+      auto flowchart = copy_nested_flowchart();
+      report_progress(0, input_size_);
+      for(size_t i=0; i<input_size_ && !is_cancelled(); ++i) {
+        auto outputs = run_item(flowchart, i);
+        push_outputs(outputs, i);
+        report_progress(i+1, input_size_);
       }
     };
 
+    // A nested main thread node makes this node main thread only too, then the
+    // items are processed sequentially.
+    void update_concurrency() {
+      set_concurrency(GF_NODE_REENTRANT);
+      set_resource_cost(1);
+      for (auto& [name, node] : nested_node_manager_->get_nodes()) {
+        if (node->get_concurrency() == GF_NODE_MAIN_THREAD)
+          set_concurrency(GF_NODE_MAIN_THREAD);
+        set_resource_cost(std::max(get_resource_cost(), node->get_resource_cost()));
+      }
+      if (use_parallel_processing && get_concurrency() != GF_NODE_MAIN_THREAD)
+        set_resource_cost(float(thread_count()));
+    }
+    void on_change_parameter(const std::string&, Parameter&) override {
+      update_concurrency();
+    }
+
     void process() {
       if(flowchart_loaded) {
         auto first_input = input_terminals.begin()->second.get();
         input_size_ = first_input->size();
         std::cout << "Begin processing for NestNode " << get_name() << "\n";
-        if (use_parallel_processing) {
+        if (use_parallel_processing && get_concurrency() != GF_NODE_MAIN_THREAD) {
           process_parallel();
         } else {
           process_sequential();
@@ -0,0 +1,389 @@
+// This file is part of Geoflow
+// Copyright (C) 2018-2019  Ravi Peters, 3D geoinformation TU Delft
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+
+#include "expression.hpp"
+#include "parallel.hpp"
+
+namespace geoflow
+{
+
+void ExpressionColumn::load(size_t first, size_t n, float* out) const
+{
+  if (floats_)
+    std::copy(floats_ + first, floats_ + first + n, out);
+  else
+    for (size_t i = 0; i < n; ++i)
+      out[i] = float(ints_[first + i]);
+}
+
+namespace
+{
+// applies op to n elements: a = op(a), a = op(a, b) or a = a ? b : c
+void apply(Expression::OpCode op, float* a, const float* b, const float* c, size_t n)
+{
+  typedef Expression E;
+  switch (op)
+  {
+  case E::NEG: for (size_t i = 0; i < n; ++i) a[i] = -a[i]; break;
+  case E::NOT: for (size_t i = 0; i < n; ++i) a[i] = a[i] == 0; break;
+  case E::ABS: for (size_t i = 0; i < n; ++i) a[i] = std::abs(a[i]); break;
+  case E::SQRT: for (size_t i = 0; i < n; ++i) a[i] = std::sqrt(a[i]); break;
+  case E::FLOOR: for (size_t i = 0; i < n; ++i) a[i] = std::floor(a[i]); break;
+  case E::CEIL: for (size_t i = 0; i < n; ++i) a[i] = std::ceil(a[i]); break;
+  case E::ROUND: for (size_t i = 0; i < n; ++i) a[i] = std::round(a[i]); break;
+  case E::EXP: for (size_t i = 0; i < n; ++i) a[i] = std::exp(a[i]); break;
+  case E::LOG: for (size_t i = 0; i < n; ++i) a[i] = std::log(a[i]); break;
+  case E::SIN: for (size_t i = 0; i < n; ++i) a[i] = std::sin(a[i]); break;
+  case E::COS: for (size_t i = 0; i < n; ++i) a[i] = std::cos(a[i]); break;
+  case E::ADD: for (size_t i = 0; i < n; ++i) a[i] = a[i] + b[i]; break;
+  case E::SUB: for (size_t i = 0; i < n; ++i) a[i] = a[i] - b[i]; break;
+  case E::MUL: for (size_t i = 0; i < n; ++i) a[i] = a[i] * b[i]; break;
+  case E::DIV: for (size_t i = 0; i < n; ++i) a[i] = a[i] / b[i]; break;
+  case E::MOD: for (size_t i = 0; i < n; ++i) a[i] = std::fmod(a[i], b[i]); break;
+  case E::POW: for (size_t i = 0; i < n; ++i) a[i] = std::pow(a[i], b[i]); break;
+  case E::MIN: for (size_t i = 0; i < n; ++i) a[i] = b[i] < a[i] ? b[i] : a[i]; break;
+  case E::MAX: for (size_t i = 0; i < n; ++i) a[i] = b[i] > a[i] ? b[i] : a[i]; break;
+  case E::LT: for (size_t i = 0; i < n; ++i) a[i] = a[i] < b[i]; break;
+  case E::LE: for (size_t i = 0; i < n; ++i) a[i] = a[i] <= b[i]; break;
+  case E::GT: for (size_t i = 0; i < n; ++i) a[i] = a[i] > b[i]; break;
+  case E::GE: for (size_t i = 0; i < n; ++i) a[i] = a[i] >= b[i]; break;
+  case E::EQ: for (size_t i = 0; i < n; ++i) a[i] = a[i] == b[i]; break;
+  case E::NE: for (size_t i = 0; i < n; ++i) a[i] = a[i] != b[i]; break;
+  case E::AND: for (size_t i = 0; i < n; ++i) a[i] = (a[i] != 0) & (b[i] != 0); break;
+  case E::OR: for (size_t i = 0; i < n; ++i) a[i] = (a[i] != 0) | (b[i] != 0); break;
+  case E::SELECT: for (size_t i = 0; i < n; ++i) a[i] = a[i] != 0 ? b[i] : c[i]; break;
+  default: break;
+  }
+}
+
+size_t operand_count(Expression::OpCode op)
+{
+  if (op <= Expression::PUSH_CONSTANT)
+    return 0;
+  if (op <= Expression::COS)
+    return 1;
+  if (op <= Expression::OR)
+    return 2;
+  return 3;
+}
+
+const std::unordered_map<std::string, Expression::OpCode> functions = {
+  {"abs", Expression::ABS}, {"sqrt", Expression::SQRT}, {"floor", Expression::FLOOR},
+  {"ceil", Expression::CEIL}, {"round", Expression::ROUND}, {"exp", Expression::EXP},
+  {"log", Expression::LOG}, {"sin", Expression::SIN}, {"cos", Expression::COS},
+  {"min", Expression::MIN}, {"max", Expression::MAX}, {"pow", Expression::POW}
+};
+} // namespace
+
+// Recursive descent parser that emits the instructions in postfix order, with
+// the usual precedence from low to high: ?:, ||, &&, == !=, < <= > >=, + -,
+// * / %, unary - ! +, ^ (right associative).
+class ExpressionParser
+{
+  const std::string& text_;
+  const std::vector<std::string>& variables_;
+  const std::unordered_map<std::string, float>& constants_;
+  Expression& expression_;
+  size_t pos_ = 0;
+  size_t depth_ = 0;
+
+  [[noreturn]] void fail(const std::string& message)
+  {
+    throw std::invalid_argument(message + " at position " + std::to_string(pos_) + " in expression \"" + text_ + "\"");
+  }
+  void skip_space()
+  {
+    while (pos_ < text_.size() && std::isspace((unsigned char)text_[pos_]))
+      ++pos_;
+  }
+  bool accept(const char* token)
+  {
+    skip_space();
+    size_t len = std::char_traits<char>::length(token);
+    if (text_.compare(pos_, len, token) != 0)
+      return false;
+    // do not take the < of <= or the = of ==
+    if (len == 1 && pos_ + 1 < text_.size() && text_[pos_ + 1] == '=' && std::string("<>!=").find(token[0]) != std::string::npos)
+      return false;
+    pos_ += len;
+    return true;
+  }
+  void expect(const char* token)
+  {
+    if (!accept(token))
+      fail(std::string("expected '") + token + "'");
+  }
+
+  void emit_constant(float value)
+  {
+    expression_.code_.push_back({Expression::PUSH_CONSTANT, 0, value});
+    expression_.stack_size_ = std::max(expression_.stack_size_, ++depth_);
+  }
+  // emits op, or replaces it and its operands by a constant if they are all constant
+  void emit(Expression::OpCode op)
+  {
+    auto& code = expression_.code_;
+    size_t n = operand_count(op);
+    bool is_constant = code.size() >= n;
+    for (size_t k = 1; k <= n && is_constant; ++k)
+      is_constant = code[code.size() - k].op == Expression::PUSH_CONSTANT;
+    depth_ -= n - 1;
+    if (is_constant)
+    {
+      float v[3] = {0, 0, 0};
+      for (size_t k = 0; k < n; ++k)
+        v[k] = code[code.size() - n + k].constant;
+      apply(op, &v[0], &v[1], &v[2], 1);
+      code.resize(code.size() - n);
+      code.push_back({Expression::PUSH_CONSTANT, 0, v[0]});
+    }
+    else
+    {
+      code.push_back({op, 0, 0});
+    }
+  }
+
+  void ternary()
+  {
+    logical_or();
+    if (accept("?"))
+    {
+      ternary();
+      expect(":");
+      ternary();
+      emit(Expression::SELECT);
+    }
+  }
+  void logical_or()
+  {
+    logical_and();
+    while (accept("||"))
+    {
+      logical_and();
+      emit(Expression::OR);
+    }
+  }
+  void logical_and()
+  {
+    equality();
+    while (accept("&&"))
+    {
+      equality();
+      emit(Expression::AND);
+    }
+  }
+  void equality()
+  {
+    relational();
+    while (true)
+    {
+      if (accept("==")) { relational(); emit(Expression::EQ); }
+      else if (accept("!=")) { relational(); emit(Expression::NE); }
+      else break;
+    }
+  }
+  void relational()
+  {
+    additive();
+    while (true)
+    {
+      if (accept("<=")) { additive(); emit(Expression::LE); }
+      else if (accept(">=")) { additive(); emit(Expression::GE); }
+      else if (accept("<")) { additive(); emit(Expression::LT); }
+      else if (accept(">")) { additive(); emit(Expression::GT); }
+      else break;
+    }
+  }
+  void additive()
+  {
+    multiplicative();
+    while (true)
+    {
+      if (accept("+")) { multiplicative(); emit(Expression::ADD); }
+      else if (accept("-")) { multiplicative(); emit(Expression::SUB); }
+      else break;
+    }
+  }
+  void multiplicative()
+  {
+    unary();
+    while (true)
+    {
+      if (accept("*")) { unary(); emit(Expression::MUL); }
+      else if (accept("/")) { unary(); emit(Expression::DIV); }
+      else if (accept("%")) { unary(); emit(Expression::MOD); }
+      else break;
+    }
+  }
+  void unary()
+  {
+    if (accept("-")) { unary(); emit(Expression::NEG); }
+    else if (accept("!")) { unary(); emit(Expression::NOT); }
+    else if (accept("+")) { unary(); }
+    else power();
+  }
+  void power()
+  {
+    primary();
+    if (accept("^"))
+    {
+      unary();
+      emit(Expression::POW);
+    }
+  }
+  void primary()
+  {
+    skip_space();
+    if (pos_ >= text_.size())
+      fail("unexpected end");
+    char c = text_[pos_];
+    if (std::isdigit((unsigned char)c) || c == '.')
+    {
+      const char* begin = text_.c_str() + pos_;
+      char* end;
+      float value = std::strtof(begin, &end);
+      if (end == begin)
+        fail("invalid number");
+      pos_ += end - begin;
+      emit_constant(value);
+    }
+    else if (std::isalpha((unsigned char)c) || c == '_')
+    {
+      size_t begin = pos_;
+      while (pos_ < text_.size() && (std::isalnum((unsigned char)text_[pos_]) || text_[pos_] == '_' || text_[pos_] == '.'))
+        ++pos_;
+      identifier(text_.substr(begin, pos_ - begin));
+    }
+    else if (accept("("))
+    {
+      ternary();
+      expect(")");
+    }
+    else
+    {
+      fail(std::string("unexpected '") + c + "'");
+    }
+  }
+  void identifier(const std::string& name)
+  {
+    if (accept("("))
+    {
+      auto f = functions.find(name);
+      if (f == functions.end())
+        fail("unknown function '" + name + "'");
+      size_t n = operand_count(f->second);
+      for (size_t k = 0; k < n; ++k)
+      {
+        if (k)
+          expect(",");
+        ternary();
+      }
+      expect(")");
+      emit(f->second);
+      return;
+    }
+    auto v = std::find(variables_.begin(), variables_.end(), name);
+    if (v != variables_.end())
+    {
+      expression_.code_.push_back({Expression::PUSH_VARIABLE, size_t(v - variables_.begin()), 0});
+      expression_.stack_size_ = std::max(expression_.stack_size_, ++depth_);
+      return;
+    }
+    auto constant = constants_.find(name);
+    if (constant != constants_.end())
+    {
+      emit_constant(constant->second);
+      return;
+    }
+    fail("unknown variable '" + name + "'");
+  }
+
+public:
+  ExpressionParser(const std::string& text, const std::vector<std::string>& variables, const std::unordered_map<std::string, float>& constants, Expression& expression)
+    : text_(text), variables_(variables), constants_(constants), expression_(expression) {};
+
+  void parse()
+  {
+    ternary();
+    skip_space();
+    if (pos_ != text_.size())
+      fail("unexpected '" + text_.substr(pos_, 1) + "'");
+  }
+};
+
+Expression::Expression(const std::string& text, const std::vector<std::string>& variables, const std::unordered_map<std::string, float>& constants)
+  : variable_count_(variables.size())
+{
+  ExpressionParser(text, variables, constants, *this).parse();
+}
+
+void Expression::run(const std::vector<ExpressionColumn>& columns, size_t first, size_t n, float* stack) const
+{
+  float* top = stack - batch_size; // top of the stack, one batch below the stack when empty
+  for (auto& instruction : code_)
+  {
+    switch (instruction.op)
+    {
+    case PUSH_VARIABLE:
+      top += batch_size;
+      columns[instruction.variable].load(first, n, top);
+      break;
+    case PUSH_CONSTANT:
+      top += batch_size;
+      std::fill(top, top + n, instruction.constant);
+      break;
+    default:
+    {
+      size_t k = operand_count(instruction.op);
+      top -= (k - 1) * batch_size;
+      apply(instruction.op, top, top + batch_size, top + 2 * batch_size, n);
+    }
+    }
+  }
+}
+
+vec1f Expression::evaluate(const std::vector<ExpressionColumn>& columns) const
+{
+  if (columns.size() != variable_count_)
+    throw std::invalid_argument("expected " + std::to_string(variable_count_) + " expression columns");
+  size_t size = columns.empty() ? 1 : columns[0].size();
+  for (auto& column : columns)
+    if (column.size() != size)
+      throw std::invalid_argument("expression columns have different sizes");
+  vec1f result(size);
+  if (code_.empty())
+    return result;
+
+  parallel_for(0, (size + batch_size - 1) / batch_size, [&](size_t first_batch, size_t last_batch) {
+    std::vector<float> stack(stack_size_ * batch_size);
+    for (size_t b = first_batch; b < last_batch; ++b)
+    {
+      size_t first = b * batch_size;
+      size_t n = std::min(batch_size, size - first);
+      run(columns, first, n, stack.data());
+      std::copy(stack.data(), stack.data() + n, result.data() + first);
+    }
+  }, 64);
+  return result;
+}
+
+} // namespace geoflow
@@ -0,0 +1,92 @@
+// This file is part of Geoflow
+// Copyright (C) 2018-2019  Ravi Peters, 3D geoinformation TU Delft
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <string>
+#include <unordered_map>
+
+#include "common.hpp"
+
+namespace geoflow
+{
+
+// one input column of an Expression, refers to the data of a vec1f or vec1i
+class ExpressionColumn
+{
+  const float* floats_ = nullptr;
+  const int* ints_ = nullptr;
+  size_t size_ = 0;
+
+public:
+  ExpressionColumn(const vec1f& values) : floats_(values.data()), size_(values.size()) {};
+  ExpressionColumn(const vec1i& values) : ints_(values.data()), size_(values.size()) {};
+
+  size_t size() const { return size_; };
+  // converts elements [first, first+n) to float
+  void load(size_t first, size_t n, float* out) const;
+};
+
+// Expression is an arithmetic expression over named columns, compiled once to
+// bytecode for a stack machine. Every instruction is applied to a batch of
+// elements at a time, so its inner loop runs over contiguous floats and is
+// vectorised, and batches are divided over threads.
+//
+// Supported are numbers, variables, constants, the operators + - * / % ^,
+// comparisons (< <= > >= == !=, giving 1 or 0), logic (&& || !), c ? a : b,
+// parentheses and the functions abs sqrt floor ceil round exp log sin cos min
+// max pow.
+class Expression
+{
+public:
+  enum OpCode {
+    PUSH_VARIABLE, PUSH_CONSTANT,
+    NEG, NOT, ABS, SQRT, FLOOR, CEIL, ROUND, EXP, LOG, SIN, COS,
+    ADD, SUB, MUL, DIV, MOD, POW, MIN, MAX, LT, LE, GT, GE, EQ, NE, AND, OR,
+    SELECT
+  };
+  struct Instruction
+  {
+    OpCode op;
+    size_t variable;
+    float constant;
+  };
+
+private:
+  std::vector<Instruction> code_;
+  size_t stack_size_ = 0;
+  size_t variable_count_ = 0;
+
+  void run(const std::vector<ExpressionColumn>& columns, size_t first, size_t n, float* stack) const;
+
+  friend class ExpressionParser;
+
+public:
+  static constexpr size_t batch_size = 256;
+
+  Expression() {};
+  // Compiles text. Identifiers refer to the variables, by position in the
+  // columns passed to evaluate, or else to the constants. Throws
+  // std::invalid_argument on a syntax error or an unknown identifier.
+  Expression(const std::string& text, const std::vector<std::string>& variables, const std::unordered_map<std::string, float>& constants = {});
+
+  const std::vector<Instruction>& code() const { return code_; };
+  // evaluates the expression for every element of the columns, which must all
+  // have the same size. Without variables the result is a single value.
+  vec1f evaluate(const std::vector<ExpressionColumn>& columns) const;
+};
+
+} // namespace geoflow
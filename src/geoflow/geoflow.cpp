@@ -18,10 +18,15 @@
 #include <fstream>
 #include <iomanip>
 #include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <ctime>
+#include <condition_variable>
+#include <deque>
 
 #include "geoflow.hpp"
+#include "memory.hpp"
+#include "parallel.hpp"
 
 using namespace geoflow;
 
@@ -38,6 +43,25 @@ std::string random_string(size_t length) {
   return str;
 }
 
+namespace {
+  // callbacks of main thread nodes go through the main thread dispatcher
+  void call_on_node_thread(Node& node, const std::function<void()>& callback) {
+    if (node.get_concurrency() == GF_NODE_MAIN_THREAD)
+      node.get_manager().run_on_main_thread(callback);
+    else
+      callback();
+  }
+  std::string exception_message(std::exception_ptr error) {
+    try {
+      std::rethrow_exception(error);
+    } catch (const std::exception& e) {
+      return e.what();
+    } catch (...) {
+      return "unknown error";
+    }
+  }
+}
+
 bool gfTerminal::accepts_type(std::type_index ttype) const {
   for (auto& t : types_) {
     if (t==ttype) 
@@ -48,7 +72,7 @@ bool gfTerminal::accepts_type(std::type_index ttype) const {
 
 void gfInputTerminal::clear() {
   parent_.update_status();
-  parent_.on_clear(*this);
+  call_on_node_thread(parent_, [this]() { parent_.on_clear(*this); });
 }
 
 gfSingleFeatureInputTerminal::~gfSingleFeatureInputTerminal(){
@@ -71,8 +95,22 @@ void gfSingleFeatureInputTerminal::update_on_receive(bool queue) {
   if(has_data() || is_touched()) {
     if (queue && parent_.update_status() && parent_.autorun) 
       parent_.queue();
-    parent_.on_receive(*this);
+    call_on_node_thread(parent_, [this]() { parent_.on_receive(*this); });
+  }
+}
+std::set<NodeHandle> gfInputTerminal::get_parent_nodes() {
+  std::set<NodeHandle> parent_nodes;
+  for (auto& output_term : get_connected_outputs()) {
+    parent_nodes.insert(output_term->get_parent().get_handle());
+  }
+  return parent_nodes;
+}
+std::vector<std::shared_ptr<gfOutputTerminal>> gfSingleFeatureInputTerminal::get_connected_outputs() {
+  std::vector<std::shared_ptr<gfOutputTerminal>> outputs;
+  if (auto output_term = connected_output_.lock()) {
+    outputs.push_back(output_term);
   }
+  return outputs;
 }
 bool gfSingleFeatureInputTerminal::has_connection() {
   return !connected_output_.expired();
@@ -193,6 +231,15 @@ void gfMultiFeatureInputTerminal::clear() {
   rebuild_terminal_refs();
   gfInputTerminal::clear();
 }
+std::vector<std::shared_ptr<gfOutputTerminal>> gfMultiFeatureInputTerminal::get_connected_outputs() {
+  std::vector<std::shared_ptr<gfOutputTerminal>> outputs;
+  for (auto& conn : connected_outputs_) {
+    if (auto output_term = conn.lock()) {
+      outputs.push_back(output_term);
+    }
+  }
+  return outputs;
+}
 void gfMultiFeatureInputTerminal::connect_output(gfOutputTerminal& output_term) {
   connected_outputs_.insert(output_term.get_ptr());
 }
@@ -231,7 +278,7 @@ void gfMultiFeatureInputTerminal::update_on_receive(bool queue) {
     if (queue && parent_.autorun)
       parent_.queue();
   }
-  parent_.on_receive(*this);
+  call_on_node_thread(parent_, [this]() { parent_.on_receive(*this); });
 }
 bool gfMultiFeatureInputTerminal::has_data() const {
   if (connected_outputs_.size()==0)
@@ -319,6 +366,28 @@ void Node::set_name(std::string new_name) {
 //     set_param(kv.first, kv.second, quiet);
 //   }
 // }
+bool Node::output_requested(const std::string& name) {
+  auto& oT = *output_terminals.at(name);
+  if (missing_outputs_only_ && (oT.has_data() || oT.is_touched()))
+    return false;
+  return oT.is_requested();
+}
+bool Node::has_missing_outputs() {
+  if (status_ != GF_NODE_DONE) return false;
+  bool missing = false;
+  for_each_output([&missing](gfOutputTerminal& oT) {
+    missing |= oT.is_requested() && !oT.has_data() && !oT.is_touched();
+  });
+  return missing;
+}
+std::set<NodeHandle> Node::get_parent_nodes() {
+  std::set<NodeHandle> parent_nodes;
+  for (auto& [name, iT] : input_terminals) {
+    auto nodes = iT->get_parent_nodes();
+    parent_nodes.insert(nodes.begin(), nodes.end());
+  }
+  return parent_nodes;
+}
 std::set<NodeHandle> Node::get_child_nodes() {
   std::set<NodeHandle> child_nodes;
   for (auto& [name, oT] : output_terminals) {
@@ -340,7 +409,8 @@ const ParameterMap& Node::dump_params() {
 // }
 bool Node::inputs_valid() {
   for (auto& [name,iT] : input_terminals) {
-    if (!iT->has_data())
+    // in map mode an empty vector is valid input, it maps to empty outputs
+    if (!iT->has_data() && !(map_mode && iT->is_touched()))
       return false;
   }
   return true;
@@ -368,6 +438,36 @@ void Node::propagate_outputs() {
   //   group->propagate();
   // }
 }
+void Node::report_progress(size_t done, size_t total) {
+  NodeManager::RunEvent event{GF_RUN_NODE_PROGRESS, get_handle()};
+  event.done = done;
+  event.total = total;
+  manager.notify_run_event(event);
+}
+bool Node::is_cancelled() const {
+  auto timeout = manager.get_node_timeout();
+  bool cancelled = manager.is_cancelled()
+    || (timeout > 0 && std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - process_start_).count() > timeout);
+  if (cancelled) cancel_seen_ = true;
+  return cancelled;
+}
+size_t Node::input_memory_size() {
+  size_t size = 0;
+  auto add = [&size](const std::vector<std::any>& data_vec) {
+    for (auto& data : data_vec)
+      size += memory_size(data);
+  };
+  for_each_input([&add](gfInputTerminal& iT) {
+    if (!iT.has_data()) return;
+    if (iT.get_family() == GF_SINGLE_FEATURE) {
+      add(static_cast<gfSingleFeatureInputTerminal&>(iT).get_data_vec());
+    } else {
+      for (auto sub_term : static_cast<gfMultiFeatureInputTerminal&>(iT).sub_terminals())
+        add(sub_term->get_data_vec());
+    }
+  });
+  return size;
+}
 void Node::notify_children() {
   std::queue<Node*> nodes_to_check;
   std::set<Node*> visited;
@@ -412,27 +512,95 @@ std::string Node::debug_info() {
   return s.str();
 }
 
+std::mutex& NodeRegister::type_mutex(const std::string& type_name) {
+  std::lock_guard<std::mutex> lock(type_mutexes_mutex_);
+  auto& m = type_mutexes_[type_name];
+  if (!m) m = std::make_unique<std::mutex>();
+  return *m;
+}
 void NodeManager::queue(std::shared_ptr<Node> n) {
+  if (!demanded_.empty() && !demanded_.count(n.get())) return;
   node_queue.push(n);
 }
-size_t NodeManager::run_all(bool notify_children) {
+std::vector<NodeHandle> NodeManager::autorun_roots() {
   // find all root nodes with autorun enabled
-  std::vector<NodeHandle> to_run;
+  std::vector<NodeHandle> roots;
   for (auto& [name, node] : nodes) {
     if(node->is_root() && node->autorun) {
-      to_run.push_back(node);
+      roots.push_back(node);
+    }
+  }
+  return roots;
+}
+std::vector<NodeHandle> NodeManager::sink_nodes() {
+  std::vector<NodeHandle> sinks;
+  for (auto& [name, node] : nodes) {
+    bool has_marked_output = false;
+    for (auto& [oname, oT] : node->output_terminals) {
+      has_marked_output |= oT->is_marked();
+    }
+    if (node->is_leaf() || has_marked_output) {
+      sinks.push_back(node);
     }
   }
+  return sinks;
+}
+size_t NodeManager::run_all(bool notify_children) {
+  return run_roots(autorun_roots(), notify_children);
+}
+size_t NodeManager::run_targets(const std::vector<NodeHandle>& targets, bool notify_children) {
+  // collect the targets and everything upstream of them
+  std::vector<NodeHandle> stack = targets.empty() ? sink_nodes() : targets;
+  std::vector<NodeHandle> roots;
+  demanded_.clear();
+  while (!stack.empty()) {
+    auto n = stack.back();
+    stack.pop_back();
+    if (!demanded_.insert(n.get()).second) continue;
+    if (n->is_root()) roots.push_back(n);
+    for (auto& parent : n->get_parent_nodes()) stack.push_back(parent);
+  }
+  size_t run_count;
+  try {
+    run_count = run_roots(roots, notify_children);
+  } catch (...) {
+    demanded_.clear();
+    throw;
+  }
+  demanded_.clear();
+  return run_count;
+}
+size_t NodeManager::run_roots(const std::vector<NodeHandle>& to_run, bool notify_children) {
   if(notify_children) {
     for (auto& node : to_run){
       node->notify_children();
     }
   }
-  size_t run_count = 0;
+  // a node downstream of another one that is about to run is queued once that
+  // one propagates its outputs, queueing it here as well would process it twice
+  std::unordered_set<Node*> downstream;
+  std::vector<NodeHandle> stack;
   for (auto& node : to_run){
-    run_count += run(node, notify_children);
+    node->update_status();
+    if (node->status_ == GF_NODE_READY)
+      for (auto& child : node->get_child_nodes()) stack.push_back(child);
   }
-  return run_count;
+  while (!stack.empty()) {
+    auto n = stack.back();
+    stack.pop_back();
+    if (!downstream.insert(n.get()).second) continue;
+    for (auto& child : n->get_child_nodes()) stack.push_back(child);
+  }
+  // start from all roots at once so that independent branches overlap
+  std::queue<std::shared_ptr<Node>>().swap(node_queue);
+  std::unordered_set<Node*> queued;
+  for (auto& node : to_run){
+    if (downstream.count(node.get()) || !queued.insert(node.get()).second) continue;
+    node->queue();
+  }
+  if (parallel_)
+    return run_queue_parallel();
+  return run_queue_sequential();
 }
 size_t NodeManager::run(Node &node, bool notify_children) {
   std::queue<std::shared_ptr<Node>>().swap(node_queue); // clear to prevent double processing of nodes ()
@@ -440,32 +608,592 @@ size_t NodeManager::run(Node &node, bool notify_children) {
   size_t run_count = 0;
   if (node.queue()) {
     if (notify_children) node.notify_children();
-    while (!node_queue.empty()) {
-      auto n = node_queue.front();
-      node_queue.pop();
-      n->status_ = GF_NODE_PROCESSING;
-      // n->preprocess();
-      std::cout << "P " << n->get_name() << "..." << std::flush;
-      std::clock_t c_start = std::clock(); // CPU time
-      // copy parameter values from master if a master is set
-      for (auto& [name, param] : n->parameters) {
-        param->copy_value_from_master();
+    if (parallel_)
+      run_count = run_queue_parallel();
+    else
+      run_count = run_queue_sequential();
+  }
+  return run_count;
+}
+size_t NodeManager::run_missing_outputs(Node& node) {
+  std::queue<std::shared_ptr<Node>>().swap(node_queue);
+  if (!node.has_missing_outputs()) return 0;
+  std::vector<gfOutputTerminal*> missing;
+  node.for_each_output([&missing](gfOutputTerminal& oT) {
+    if (oT.is_requested() && !oT.has_data() && !oT.is_touched())
+      missing.push_back(&oT);
+  });
+  node.status_ = GF_NODE_PROCESSING;
+  node.missing_outputs_only_ = true;
+  notify_run_event({GF_RUN_NODE_STARTED, node.get_handle()});
+  auto t_start = std::chrono::steady_clock::now();
+  try {
+    process_node(node);
+  } catch (...) {
+    node.missing_outputs_only_ = false;
+    node.status_ = GF_NODE_DONE;
+    notify_run_event({GF_RUN_NODE_FAILED, node.get_handle(), exception_message(std::current_exception())});
+    throw;
+  }
+  node.missing_outputs_only_ = false;
+  if (discard_if_cancelled(node)) return 0;
+  node.status_ = GF_NODE_DONE;
+  notify_run_event({GF_RUN_NODE_DONE, node.get_handle(), std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t_start).count()});
+  // only the new outputs are propagated, so that the existing consumers do not run again
+  for (auto oT : missing) {
+    oT->propagate();
+  }
+  return 1 + (parallel_ ? run_queue_parallel() : run_queue_sequential());
+}
+void NodeManager::process_node(Node& n) {
+  n.process_start_ = std::chrono::steady_clock::now();
+  n.cancel_seen_ = false;
+  // copy parameter values from master if a master is set
+  for (auto& [name, param] : n.parameters) {
+    param->copy_value_from_master();
+  }
+  if (n.map_mode) {
+    process_node_mapped(n);
+    return;
+  }
+  if (n.get_concurrency() == GF_NODE_SERIALIZED) {
+    std::lock_guard<std::mutex> lock(n.node_register->type_mutex(n.get_type_name()));
+    n.process();
+  } else if (n.get_concurrency() == GF_NODE_MAIN_THREAD) {
+    run_on_main_thread([&n]() { n.process(); });
+  } else {
+    n.process();
+  }
+}
+namespace {
+  // source for the inputs of the copies of a map mode node
+  class MapFeederNode : public Node {
+    public:
+    using Node::Node;
+    void init(){};
+    void process(){};
+  };
+}
+void NodeManager::process_node_mapped(Node& node) {
+  // the number of elements is given by the mapped inputs that hold more than one
+  size_t item_count = 1;
+  for (auto& [name, iT] : node.input_terminals) {
+    if (iT->get_family() != GF_SINGLE_FEATURE)
+      throw gfException("Map mode does not support poly input \"" + name + "\" of " + node.get_name());
+    // a touched input without data holds zero elements
+    if (iT->supports_multiple_elements() || !(iT->has_data() || iT->is_touched()) || iT->size() == 1)
+      continue;
+    if (item_count != 1 && iT->size() != item_count)
+      throw gfException("Mapped inputs of " + node.get_name() + " hold different numbers of elements (" + std::to_string(item_count) + " and " + std::to_string(iT->size()) + ")");
+    item_count = iT->size();
+  }
+  for (auto& [name, oT] : node.output_terminals) {
+    if (oT->get_family() != GF_SINGLE_FEATURE)
+      throw gfException("Map mode does not support poly output \"" + name + "\" of " + node.get_name());
+  }
+
+  // one copy of the node per lane, fed by a node with an output per connected input
+  struct Lane {
+    std::unique_ptr<NodeManager> manager;
+    NodeHandle feeder, copy;
+    std::vector<std::pair<gfSingleFeatureOutputTerminal*, gfSingleFeatureInputTerminal*>> mapped;
+  };
+  auto feeder_register = NodeRegister::create("MapFeeder");
+  feeder_register->register_node<MapFeederNode>("Feeder");
+  size_t lane_count = 1;
+  if (node.get_concurrency() == GF_NODE_REENTRANT) {
+    float cost = std::max(1.f, node.get_resource_cost());
+    lane_count = std::max<size_t>(1, std::min<size_t>(item_count, size_t(float(thread_count()) / cost)));
+  }
+  std::vector<Lane> lanes(lane_count);
+  for (auto& lane : lanes) {
+    lane.manager = std::make_unique<NodeManager>(registers_);
+    lane.manager->data_offset = get_data_offset();
+    lane.manager->set_cancellation_token(cancellation_token_);
+    lane.manager->set_node_timeout(node_timeout_ms_);
+    // so that main thread nodes still run on the main thread
+    lane.manager->set_main_thread_dispatcher(main_thread_dispatcher_);
+    lane.feeder = lane.manager->create_node(feeder_register, "Feeder");
+    lane.copy = lane.manager->create_copy(node);
+    for (auto& [name, iT] : node.input_terminals) {
+      if (!iT->has_connection()) continue;
+      if (!lane.copy->input_terminals.count(name))
+        throw gfException("No input terminal \"" + name + "\" on the copies of " + node.get_name());
+      auto& in = static_cast<gfSingleFeatureInputTerminal&>(*iT);
+      auto& feed = lane.feeder->add_output(name, in.get_types());
+      feed.set_type(in.get_connected_type());
+      feed.connect(*lane.copy->input_terminals.at(name));
+      // inputs that are passed whole are set once per lane
+      if (!in.supports_multiple_elements() && in.has_data() && in.size() == item_count)
+        lane.mapped.emplace_back(&feed, &in);
+      else
+        feed = in.get_data_vec();
+    }
+    for (auto& [name, oT] : node.output_terminals) {
+      if (lane.copy->output_terminals.count(name))
+        lane.copy->output_terminals.at(name)->set_requested(node.output_requested(name));
+    }
+  }
+
+  // results[o][i] holds what the copy put in output o for element i
+  std::vector<std::string> output_names;
+  for (auto& [name, oT] : node.output_terminals) output_names.push_back(name);
+  std::vector<std::vector<std::optional<std::vector<std::any>>>> results(output_names.size(), std::vector<std::optional<std::vector<std::any>>>(item_count));
+  auto run_item = [&](Lane& lane, size_t i) {
+    for (auto& [feed, in] : lane.mapped) {
+      feed->set_from_any(in->get_data_vec()[i]);
+    }
+    lane.copy->for_each_output([](gfOutputTerminal& oT) { oT.clear(); });
+    lane.manager->process_node(*lane.copy);
+    // an element that stopped early makes the mapped result incomplete
+    if (lane.copy->cancel_seen_) node.cancel_seen_ = true;
+    for (size_t o = 0; o < output_names.size(); ++o) {
+      auto it = lane.copy->output_terminals.find(output_names[o]);
+      if (it == lane.copy->output_terminals.end()) continue;
+      auto& out = static_cast<gfSingleFeatureOutputTerminal&>(*it->second);
+      if (out.has_data() || out.is_touched())
+        results[o][i] = std::move(out.get_data_vec());
+    }
+  };
+  if (lane_count == 1) {
+    for (size_t i = 0; i < item_count && !node.is_cancelled(); ++i) run_item(lanes[0], i);
+  } else {
+    std::atomic<size_t> next_item{0};
+    TaskGroup group;
+    for (auto& lane : lanes) {
+      group.run([&]() {
+        for (size_t i; !node.is_cancelled() && (i = next_item++) < item_count;) run_item(lane, i);
+      });
+    }
+    group.wait();
+  }
+
+  // collect in element order. An element for which the copy produced nothing
+  // gets an empty value, so that the outputs stay aligned with the inputs.
+  // Outputs that no copy produced are left alone, unless there were no
+  // elements at all.
+  for (size_t o = 0; o < output_names.size(); ++o) {
+    bool produced = item_count == 0;
+    std::vector<std::any> data_vec;
+    data_vec.reserve(item_count);
+    for (auto& item : results[o]) {
+      if (!item || item->empty()) {
+        data_vec.emplace_back();
+        continue;
       }
-//      try {
-        n->process();
-        n->status_ = GF_NODE_DONE;
-        ++run_count;
-        n->propagate_outputs();
-//      } catch (const gfException& e) {
-//        std::cout << "ERROR: gfException -- " << e.what() << "\n" << std::flush;
-//        n->status_ = GF_NODE_READY;
-//      }
-      std::clock_t c_end = std::clock(); // CPU time
-      std::cout << 1000.0 * (c_end-c_start) / CLOCKS_PER_SEC << "ms\n";
+      produced = true;
+      for (auto& data : *item) data_vec.push_back(std::move(data));
     }
+    if (produced)
+      node.output(output_names[o]) = data_vec;
+  }
+}
+size_t NodeManager::run_queue_sequential() {
+  size_t run_count = 0;
+  while (!node_queue.empty() && !is_cancelled()) {
+    auto n = node_queue.front();
+    node_queue.pop();
+    n->status_ = GF_NODE_PROCESSING;
+    // n->preprocess();
+    std::cout << "P " << n->get_name() << "..." << std::flush;
+    std::clock_t c_start = std::clock(); // CPU time
+    auto t_start = std::chrono::steady_clock::now();
+    notify_run_event({GF_RUN_NODE_STARTED, n});
+//    try {
+      try {
+        process_node(*n);
+      } catch (...) {
+        notify_run_event({GF_RUN_NODE_FAILED, n, exception_message(std::current_exception())});
+        throw;
+      }
+      if (discard_if_cancelled(*n)) continue;
+      double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t_start).count();
+      record_duration(n->get_name(), ms);
+      notify_run_event({GF_RUN_NODE_DONE, n, ms});
+      n->status_ = GF_NODE_DONE;
+      ++run_count;
+      n->propagate_outputs();
+//    } catch (const gfException& e) {
+//      std::cout << "ERROR: gfException -- " << e.what() << "\n" << std::flush;
+//      n->status_ = GF_NODE_READY;
+//    }
+    std::clock_t c_end = std::clock(); // CPU time
+    std::cout << 1000.0 * (c_end-c_start) / CLOCKS_PER_SEC << "ms\n";
   }
+  std::queue<NodeHandle>().swap(node_queue);
   return run_count;
 }
+size_t NodeManager::run_queue_parallel() {
+  // The calling thread schedules: it starts ready nodes on the executor, runs
+  // the main thread nodes itself and propagates the outputs of finished nodes,
+  // which queues their children. Only process() runs on the workers, so the
+  // graph is never modified concurrently.
+  struct Finished {
+    NodeHandle node;
+    double ms;
+    std::exception_ptr error;
+    bool cancelled;
+  };
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::vector<Finished> finished;
+  std::deque<NodeHandle> ready;
+  const float capacity = float(thread_count());
+  float running_cost = 0;
+  size_t running = 0;
+  // memory estimates are taken once per node, when it is first considered
+  std::unordered_map<Node*, size_t> memory_estimates;
+  // resident memory at the start of each running node
+  std::unordered_map<Node*, size_t> start_resident;
+  size_t run_count = 0;
+  std::exception_ptr error;
+  TaskGroup group;
+
+  // a map mode node keeps all threads busy
+  auto cost_of = [&capacity](Node& n) {
+    return n.map_mode ? std::max(capacity, n.get_resource_cost()) : n.get_resource_cost();
+  };
+  auto process_timed = [this](Node& n) {
+    auto t_start = std::chrono::steady_clock::now();
+    process_node(n);
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t_start).count();
+  };
+  auto complete = [&](Finished& f) {
+    auto& n = f.node;
+    if (f.cancelled && discard_if_cancelled(*n)) return;
+    if (f.error) {
+      n->status_ = GF_NODE_READY;
+      notify_run_event({GF_RUN_NODE_FAILED, n, exception_message(f.error)});
+      if (!error) error = f.error;
+      return;
+    }
+    std::cout << "P " << n->get_name() << "... " << f.ms << "ms\n";
+    record_duration(n->get_name(), f.ms);
+    notify_run_event({GF_RUN_NODE_DONE, n, f.ms});
+    n->status_ = GF_NODE_DONE;
+    ++run_count;
+    if (!error) n->propagate_outputs();
+  };
+
+  // longest remaining path per node, by timing history
+  std::unordered_map<Node*, double> remaining;
+  auto by_remaining_duration = [&](const NodeHandle& a, const NodeHandle& b) {
+    return remaining_duration(*a, remaining) > remaining_duration(*b, remaining);
+  };
+
+  while (true) {
+    for (; !node_queue.empty(); node_queue.pop()) {
+      ready.push_back(node_queue.front());
+    }
+    if (!timings_.empty())
+      std::stable_sort(ready.begin(), ready.end(), by_remaining_duration);
+    // start what fits, in order of priority
+    const size_t resident = memory_budget_ ? resident_memory() : 0;
+    auto memory_estimate = [&](Node& n) {
+      auto e = memory_estimates.find(&n);
+      if (e == memory_estimates.end())
+        e = memory_estimates.emplace(&n, n.estimate_memory()).first;
+      return e->second;
+    };
+    // What the running nodes have allocated so far is already part of resident,
+    // so only the part of their estimates that the resident memory has not grown
+    // by since they started is still to come.
+    size_t pending_memory = 0;
+    for (auto& [n, r0] : start_resident) {
+      size_t grown = resident > r0 ? resident - r0 : 0;
+      size_t estimate = memory_estimate(*n);
+      if (estimate > grown) pending_memory += estimate - grown;
+    }
+    auto fits_memory = [&](Node& n) {
+      return memory_budget_ == 0 || running == 0
+        || resident + pending_memory + memory_estimate(n) <= memory_budget_;
+    };
+    NodeHandle main_thread_node;
+    for (auto it = ready.begin(); !error && !is_cancelled() && it != ready.end();) {
+      auto n = *it;
+      if (n->status_ == GF_NODE_PROCESSING) {
+        it = ready.erase(it);
+      } else if (n->get_concurrency() == GF_NODE_MAIN_THREAD) {
+        if (!main_thread_node && fits_memory(*n)) {
+          main_thread_node = n;
+          it = ready.erase(it);
+        } else ++it;
+      } else if (running == 0 || (running_cost + cost_of(*n) <= capacity && fits_memory(*n))) {
+        it = ready.erase(it);
+        n->status_ = GF_NODE_PROCESSING;
+        running_cost += cost_of(*n);
+        if (memory_budget_) {
+          pending_memory += memory_estimate(*n);
+          start_resident[n.get()] = resident;
+        }
+        ++running;
+        notify_run_event({GF_RUN_NODE_STARTED, n});
+        group.run([&, n]() {
+          Finished f{n, 0, nullptr, false};
+          try {
+            f.ms = process_timed(*n);
+          } catch (...) {
+            f.error = std::current_exception();
+          }
+          f.cancelled = n->cancel_seen_;
+          std::lock_guard<std::mutex> lock(mutex);
+          finished.push_back(std::move(f));
+          changed.notify_all();
+        });
+      } else {
+        ++it;
+      }
+    }
+    if (main_thread_node) {
+      main_thread_node->status_ = GF_NODE_PROCESSING;
+      notify_run_event({GF_RUN_NODE_STARTED, main_thread_node});
+      Finished f{main_thread_node, 0, nullptr, false};
+      try {
+        f.ms = process_timed(*main_thread_node);
+      } catch (...) {
+        f.error = std::current_exception();
+      }
+      f.cancelled = main_thread_node->cancel_seen_;
+      complete(f);
+    } else if (running == 0) {
+      break;
+    }
+    std::vector<Finished> done;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      if (!main_thread_node)
+        changed.wait(lock, [&]() { return !finished.empty(); });
+      done.swap(finished);
+    }
+    for (auto& f : done) {
+      --running;
+      running_cost -= cost_of(*f.node);
+      start_resident.erase(f.node.get());
+      complete(f);
+    }
+  }
+  group.wait();
+  std::queue<NodeHandle>().swap(node_queue);
+  if (error) std::rethrow_exception(error);
+  return run_count;
+}
+std::vector<std::pair<std::string, std::string>> NodeManager::merge_equivalent_nodes() {
+  // visit the nodes upstream first, so that once the duplicates upstream are
+  // merged the nodes downstream of them have identical connections as well
+  std::map<std::string, NodeHandle> sorted_nodes(nodes.begin(), nodes.end());
+  std::unordered_map<Node*, size_t> parent_count;
+  std::queue<NodeHandle> ready;
+  std::vector<NodeHandle> order;
+  for (auto& [name, node] : sorted_nodes) {
+    parent_count[node.get()] = node->get_parent_nodes().size();
+    if (parent_count[node.get()] == 0) ready.push(node);
+  }
+  for (; !ready.empty(); ready.pop()) {
+    auto& node = ready.front();
+    order.push_back(node);
+    for (auto& child : node->get_child_nodes()) {
+      if (--parent_count[child.get()] == 0) ready.push(child);
+    }
+  }
+
+  auto signature = [](Node& n) {
+    json j;
+    j["type"] = {n.get_register().get_name(), n.get_type_name()};
+    j["map_mode"] = n.map_mode;
+    // a node without autorun only runs when asked to, merging it into a node
+    // with autorun (or the other way around) would change when it runs
+    j["autorun"] = n.autorun;
+    for (auto& [pname, param] : n.parameters) {
+      if (param->has_master())
+        j["parameters"][pname] = std::string("{{" + param->get_master().lock()->get_label() + "}}");
+      else
+        j["parameters"][pname] = param->as_json();
+    }
+    for (auto& [iname, iT] : n.input_terminals) {
+      std::set<std::pair<std::string, std::string>> sources;
+      for (auto& oT : iT->get_connected_outputs()) {
+        sources.emplace(oT->get_parent().get_name(), oT->get_name());
+      }
+      j["inputs"][iname] = sources;
+    }
+    return j.dump();
+  };
+
+  std::vector<std::pair<std::string, std::string>> merged;
+  std::unordered_map<std::string, NodeHandle> kept;
+  for (auto& node : order) {
+    if (node->output_terminals.empty() || node->get_concurrency() == GF_NODE_MAIN_THREAD)
+      continue;
+    auto [k, is_new] = kept.emplace(signature(*node), node);
+    if (is_new) continue;
+    auto& keep = k->second;
+    bool same_outputs = true;
+    for (auto& [oname, oT] : node->output_terminals) {
+      same_outputs &= keep->output_terminals.count(oname) > 0;
+    }
+    if (!same_outputs) continue;
+    // fan the outputs of the node that is kept out to the consumers of the duplicate
+    for (auto& [oname, oT] : node->output_terminals) {
+      auto& keep_oT = keep->output_terminals.at(oname);
+      if (oT->is_marked()) keep_oT->set_marked(true);
+      auto connections = oT->get_connections();
+      for (auto& conn : connections) {
+        if (auto iT = conn.lock()) {
+          oT->disconnect(*iT);
+          keep_oT->connect(*iT);
+        }
+      }
+    }
+    for (auto& [iname, iT] : node->input_terminals) {
+      for (auto& oT : iT->get_connected_outputs()) {
+        oT->disconnect(*iT);
+      }
+    }
+    merged.emplace_back(node->get_name(), keep->get_name());
+    remove_node(node);
+  }
+  return merged;
+}
+bool NodeManager::discard_if_cancelled(Node& node) {
+  // the outputs of a node that was stopped early may be incomplete, a node
+  // that did not notice the cancellation finished normally
+  if (!node.cancel_seen_) return false;
+  node.for_each_output([](gfOutputTerminal& oT) { oT.clear(); });
+  node.status_ = GF_NODE_READY;
+  bool run_cancelled = is_cancelled();
+  std::string reason = run_cancelled ? "cancelled" : "timed out";
+  std::cout << "Discarded the outputs of " << node.get_name() << ", " << reason << "\n";
+  notify_run_event({run_cancelled ? GF_RUN_NODE_CANCELLED : GF_RUN_NODE_FAILED, node.get_handle(), reason});
+  return true;
+}
+void NodeManager::run_on_main_thread(const std::function<void()>& task) const {
+  if (main_thread_dispatcher_)
+    main_thread_dispatcher_(task);
+  else
+    task();
+}
+void NodeManager::notify_run_event(const RunEvent& event) const {
+  if (run_observer_) run_observer_(event);
+}
+std::vector<std::string> NodeManager::validate(bool nested) {
+  std::vector<std::string> problems(load_problems_);
+  std::map<std::string, NodeHandle> sorted_nodes(nodes.begin(), nodes.end());
+  for (auto& [name, node] : sorted_nodes) {
+    for (auto& [iname, iT] : node->input_terminals) {
+      if (!iT->is_optional() && !iT->has_connection() && !(nested && iT->is_marked()))
+        problems.push_back(name + ": required input " + iname + " is not connected");
+      for (auto& oT : iT->get_connected_outputs()) {
+        if (!oT->is_compatible(*iT))
+          problems.push_back(name + ": input " + iname + " is connected to output " + oT->get_name() + " of " + oT->get_parent().get_name() + " with an incompatible type");
+      }
+    }
+    for (auto& [pname, param] : node->parameters) {
+      if (!param->has_master() && param->is_type(typeid(std::string))) {
+        // string parameters may embed globals that are substituted when used
+        auto text = param->as_json().get<std::string>();
+        for (auto open = text.find("{{"); open != std::string::npos; open = text.find("{{", open + 2)) {
+          auto close = text.find("}}", open);
+          if (close == std::string::npos) break;
+          auto gname = text.substr(open + 2, close - open - 2);
+          if (!global_flowchart_params.count(gname))
+            problems.push_back(name + ": parameter " + pname + " refers to global {{" + gname + "}} that does not exist");
+        }
+      }
+    }
+    for (auto& problem : node->validate())
+      problems.push_back(name + ": " + problem);
+  }
+  return problems;
+}
+std::string NodeManager::profile_path(const std::string& flowchart_path) {
+  std::string path = flowchart_path;
+  auto ext = path.rfind(".json");
+  if (ext != std::string::npos && ext + 5 == path.size())
+    path.erase(ext);
+  return path + ".profile.json";
+}
+bool NodeManager::load_profile(const std::string& filepath) {
+  std::ifstream ifs(filepath);
+  if (!ifs) return false;
+  json j;
+  try {
+    ifs >> j;
+    for (auto& [name, timing] : j.at("nodes").items()) {
+      timings_[name] = NodeTiming{timing.at("ms").get<double>(), timing.at("runs").get<size_t>()};
+    }
+  } catch (const std::exception& e) {
+    std::cout << "Ignoring invalid profile " << filepath << ": " << e.what() << "\n";
+    return false;
+  }
+  return true;
+}
+bool NodeManager::dump_profile(const std::string& filepath) {
+  json j;
+  j["nodes"] = json::object();
+  for (auto& [name, timing] : timings_) {
+    // only keep nodes that still exist
+    if (nodes.count(name))
+      j["nodes"][name] = {{"ms", timing.ms}, {"runs", timing.runs}};
+  }
+  std::ofstream ofs(filepath);
+  if (!ofs) return false;
+  ofs << std::setw(2) << j;
+  return bool(ofs);
+}
+void NodeManager::record_duration(const std::string& node_name, double ms) {
+  auto& timing = timings_[node_name];
+  // recent runs weigh more, so that the estimate follows changes in the input data
+  timing.ms = timing.runs ? 0.5 * (timing.ms + ms) : ms;
+  ++timing.runs;
+}
+bool NodeManager::has_duration(const std::string& node_name) const {
+  return timings_.count(node_name) > 0;
+}
+double NodeManager::get_duration(const std::string& node_name) const {
+  auto timing = timings_.find(node_name);
+  return timing == timings_.end() ? 0 : timing->second.ms;
+}
+double NodeManager::remaining_duration(Node& node, std::unordered_map<Node*, double>& memo) {
+  auto r = memo.find(&node);
+  if (r != memo.end()) return r->second;
+  double longest_child = 0;
+  for (auto& child : node.get_child_nodes()) {
+    longest_child = std::max(longest_child, remaining_duration(*child, memo));
+  }
+  return memo[&node] = get_duration(node.get_name()) + longest_child;
+}
+NodeManager::RunEstimate NodeManager::estimate_run_all() {
+  RunEstimate estimate;
+  std::unordered_map<Node*, double> remaining;
+  // every node reachable from the autorun roots
+  std::set<Node*> visited;
+  std::vector<NodeHandle> stack = autorun_roots();
+  NodeHandle first;
+  for (auto& root : stack) {
+    if (!first || remaining_duration(*root, remaining) > remaining_duration(*first, remaining))
+      first = root;
+  }
+  while (!stack.empty()) {
+    auto n = stack.back();
+    stack.pop_back();
+    if (!visited.insert(n.get()).second) continue;
+    estimate.sequential_ms += get_duration(n->get_name());
+    if (!has_duration(n->get_name())) ++estimate.unknown_count;
+    for (auto& child : n->get_child_nodes()) stack.push_back(child);
+  }
+  // follow the children with the longest remaining path
+  for (auto n = first; n;) {
+    estimate.critical_path.push_back(n);
+    NodeHandle next;
+    for (auto& child : n->get_child_nodes()) {
+      if (!next || remaining_duration(*child, remaining) > remaining_duration(*next, remaining))
+        next = child;
+    }
+    n = next;
+  }
+  if (first) estimate.critical_path_ms = remaining_duration(*first, remaining);
+  return estimate;
+}
 NodeHandle NodeManager::create_node(NodeRegisterHandle node_register, std::string type_name) {
   // add node through a node register
   std::string new_name = type_name + "-" + random_string(6);
@@ -477,16 +1205,36 @@ NodeHandle NodeManager::create_node(NodeRegisterHandle node_register, std::strin
   nodes[new_name] = handle;
   return handle;
 }
+NodeHandle NodeManager::create_copy(Node& node) {
+  auto copy = create_node(node.node_register, node.get_type_name());
+  for (auto& [pname, param] : node.parameters) {
+    if (copy->parameters.count(pname))
+      copy->parameters.at(pname)->from_json(param->as_json());
+  }
+  copy->post_parameter_load();
+  return copy;
+}
 NodeHandle NodeManager::create_node(NodeRegisterHandle node_register, std::string type_name, std::pair<float,float> pos) {
   auto handle = create_node(node_register, type_name);
   handle->set_position(pos.first, pos.second);
   return handle;
 }
+std::optional<std::array<double,3>> NodeManager::get_data_offset() const {
+  std::lock_guard<std::mutex> lock(data_offset_mutex_);
+  return data_offset;
+}
+std::array<double,3> NodeManager::set_data_offset(const std::array<double,3>& offset) {
+  std::lock_guard<std::mutex> lock(data_offset_mutex_);
+  if (!data_offset.has_value())
+    data_offset = offset;
+  return *data_offset;
+}
 void NodeManager::remove_node(NodeHandle node) {
   nodes.erase(node->get_name());
 }
 void NodeManager::clear() {
   nodes.clear();
+  load_problems_.clear();
   data_offset.reset();
   global_flowchart_params.clear();
 }
@@ -535,6 +1283,8 @@ void NodeManager::json_serialise(std::ostream& json_sstream) {
     json n;
     n["type"] = {node_handle->node_register->get_name(), node_handle->get_type_name()};
     n["position"] = {node_handle->position[0], node_handle->position[1]};
+    if (node_handle->map_mode)
+      n["map_mode"] = true;
     for ( auto& [pname, pvalue] : node_handle->parameters ) {
       if (pvalue->has_master())
         n["parameters"][pname] = std::string("{{" + pvalue->get_master().lock()->get_label() + "}}");
@@ -602,7 +1352,15 @@ std::vector<NodeHandle> NodeManager::json_unserialise(std::istream& json_sstream
     if (registers_.count(tt[0])) {
       // construct node
       std::array<float,2> pos = node_j.value().at("position");
-      auto nhandle = create_node(registers_.at(tt[0]), tt[1], {pos[0], pos[1]});
+      NodeHandle nhandle;
+      try {
+        nhandle = create_node(registers_.at(tt[0]), tt[1], {pos[0], pos[1]});
+      } catch (const gfException& e) {
+        std::cout << e.what() << "\n";
+        load_problems_.push_back(node_j.key() + ": " + e.what() + " in register " + tt[0]);
+        if (strict) throw;
+        continue;
+      }
       new_nodes.push_back(nhandle);
       std::string node_name = node_j.key();
       name_node(nhandle, node_name);
@@ -620,14 +1378,21 @@ std::vector<NodeHandle> NodeManager::json_unserialise(std::istream& json_sstream
           if (pel.value().is_string() && !phandle->is_type(typeid(std::string)) ) {
             try{
               auto mgname = get_global_name( pel.value().get<std::string>() );
-              phandle->set_master(global_flowchart_params[mgname]);
+              auto global = global_flowchart_params.find(mgname);
+              if (global != global_flowchart_params.end())
+                phandle->set_master(global->second);
+              else
+                load_problems_.push_back(node_name + ": parameter " + pel.key() + " refers to global {{" + mgname + "}} that does not exist");
             } catch (const std::exception& e) {
               std::cout << e.what();
+              load_problems_.push_back(node_name + ": parameter " + pel.key() + " has no valid value");
             }
           } else phandle->from_json(pel.value());
         }
       }
       nhandle->post_parameter_load();
+      if (node_j.value().count("map_mode"))
+        nhandle->map_mode = node_j.value().at("map_mode").get<bool>();
       // set marked terminals
       try{
         if (node_j.value().count("marked_inputs")) {
@@ -648,6 +1413,7 @@ std::vector<NodeHandle> NodeManager::json_unserialise(std::istream& json_sstream
       }
     } else {
       std::cout << "Could not load node of type " << tt[1] << ", register not found: " << tt[0] <<"\n";
+      load_problems_.push_back(node_j.key() + ": node type " + tt[1] + " from register " + tt[0] + " that is not loaded");
       if (strict)
         throw gfException("Unable to load json file");
     }
@@ -655,7 +1421,7 @@ std::vector<NodeHandle> NodeManager::json_unserialise(std::istream& json_sstream
   // create connections
   for (auto node_j : nodes_j.items()) {
     auto tt = node_j.value().at("type").get<std::array<std::string,2>>();
-    if (registers_.count(tt[0])) {
+    if (registers_.count(tt[0]) && nodes.count(node_j.key())) {
       auto nhandle = nodes[node_j.key()];
       if (node_j.value().count("connections")) {
         auto conns_j = node_j.value().at("connections");
@@ -672,10 +1438,13 @@ std::vector<NodeHandle> NodeManager::json_unserialise(std::istream& json_sstream
                   throw e;
                 } else {
                   std::cout << e.what() << "\n";
+                  load_problems_.push_back(node_j.key() + ": " + e.what());
                 }
               }
-            else 
+            else {
               std::cout << "Could not connect output " << conn_j.key() << "\n";
+              load_problems_.push_back(node_j.key() + ": could not connect output " + conn_j.key() + " to missing node " + cval[0]);
+            }
           }
         }
       }
@@ -29,6 +29,9 @@
 #include <unordered_set>
 #include <set>
 #include <queue>
+#include <mutex>
+#include <atomic>
+#include <chrono>
 #include <typeinfo>
 #include <typeindex>
 
@@ -81,6 +84,22 @@ namespace geoflow {
   // enum gfTerminalFamily {GF_UNKNOWN, GF_BASIC, GF_VECTOR, GF_POLY};
   enum gfTerminalFamily {GF_UNKNOWN, GF_SINGLE_FEATURE, GF_MULTI_FEATURE};
   enum gfNodeStatus {GF_NODE_WAITING, GF_NODE_READY, GF_NODE_PROCESSING, GF_NODE_DONE};
+  // How process() of a node may run when a flowchart is processed in parallel:
+  // GF_NODE_REENTRANT nodes on any thread and at the same time as any other
+  // node, GF_NODE_SERIALIZED nodes on any thread but never two of the same node
+  // type at once (eg. for wrapping a non-reentrant library), and
+  // GF_NODE_MAIN_THREAD nodes only on the thread that runs the flowchart, or
+  // through the main thread dispatcher of the NodeManager if it has one (eg.
+  // for OpenGL calls).
+  // Whatever the concurrency, the data on an input terminal is shared with every
+  // other node connected to the same output, and those nodes can run at the same
+  // time. Treat inputs as read-only: const member functions are safe, and so is
+  // Geometry::box(), which computes the box under a lock. Anything that mutates,
+  // such as push_back, clear or writing through a non-const reference, must only
+  // be done on a copy.
+  enum gfNodeConcurrency {GF_NODE_REENTRANT, GF_NODE_SERIALIZED, GF_NODE_MAIN_THREAD};
+  // What happened to a node during a run, see NodeManager::set_run_observer
+  enum gfRunEventType {GF_RUN_NODE_STARTED, GF_RUN_NODE_DONE, GF_RUN_NODE_FAILED, GF_RUN_NODE_CANCELLED, GF_RUN_NODE_PROGRESS};
 
   class gfTerminal : public gfObject {
     private:
@@ -122,6 +141,7 @@ namespace geoflow {
     virtual void update_on_receive(bool queue) = 0;
     virtual void connect_output(gfOutputTerminal& output_term) = 0;
     virtual void disconnect_output(gfOutputTerminal& output_term) = 0;
+    std::set<NodeHandle> get_parent_nodes();
 
     public:
     gfInputTerminal(Node& parent_gnode, std::string name, std::initializer_list<std::type_index> types, bool is_optional, bool supports_multiple_elements)
@@ -140,6 +160,7 @@ namespace geoflow {
     const gfIO get_side() { return GF_IN; };
     bool is_optional() { return is_optional_; };
     virtual size_t size() const = 0;
+    virtual std::vector<std::shared_ptr<gfOutputTerminal>> get_connected_outputs() = 0;
 
     friend class gfOutputTerminal;
     friend class gfSingleFeatureOutputTerminal;
@@ -171,6 +192,7 @@ namespace geoflow {
     template<typename T> const T get(size_t i);
     const std::vector<std::any>& get_data_vec() const;
     size_t size() const;
+    std::vector<std::shared_ptr<gfOutputTerminal>> get_connected_outputs();
 
     friend class gfSingleFeatureOutputTerminal;
   };
@@ -182,6 +204,7 @@ namespace geoflow {
     protected:
     InputConnectionSet connections_;
     bool is_touched_=false;
+    bool is_requested_=false;
 
     std::set<NodeHandle> get_child_nodes();
     virtual void propagate();
@@ -208,7 +231,15 @@ namespace geoflow {
     void touch() { is_touched_=true; };
     bool is_touched() { return is_touched_; };
 
+    // An output is requested when it is connected (which includes painter nodes
+    // that display it), marked, or explicitly requested. The explicit request is
+    // how a map mode node forwards the demand on its outputs to the copies that
+    // process the elements (see Node::output_requested).
+    void set_requested(bool requested) { is_requested_ = requested; };
+    bool is_requested() { return has_connection() || is_marked() || is_requested_; };
+
     friend class Node;
+    friend class NodeManager;
     friend class gfInputTerminal;
     friend class gfGroupOutputTerminal;
     friend class gfSingleFeatureInputTerminal;
@@ -330,6 +361,7 @@ namespace geoflow {
     bool is_touched();
     bool has_connection() {return connected_outputs_.size() > 0; };
     size_t size() const;
+    std::vector<std::shared_ptr<gfOutputTerminal>> get_connected_outputs();
 
     const SubTermRefs& sub_terminals() { return sub_terminals_; };
     // const BasicRefs& basic_terminals() { return basic_terminals_; };
@@ -470,6 +502,12 @@ namespace geoflow {
 
     ParameterMap parameters;
     bool autorun = true;
+    // In map mode every single feature input that is not a vector input is
+    // bound to one element of the vector it is connected to, and process()
+    // runs once per element on per-thread copies of this node. The outputs
+    // collect the results in element order. Inputs holding one element and
+    // vector inputs are passed to every run. Poly terminals are not supported.
+    bool map_mode = false;
     arr2f position;
 
     Node(NodeRegisterHandle node_register, NodeManager& manager, std::string type_name, std::string node_name): node_register(node_register), manager(manager), type_name(type_name), gfObject(node_name) {};
@@ -551,6 +589,52 @@ namespace geoflow {
     };
 
     std::set<NodeHandle> get_child_nodes();
+    std::set<NodeHandle> get_parent_nodes();
+
+    // Whether anything uses this output, so that process() can skip optional
+    // products nobody asked for. An output that is requested after the node
+    // ran (eg. connected to a new consumer) is missing; NodeManager::
+    // run_missing_outputs() then processes the node again with only the
+    // missing outputs requested.
+    bool output_requested(const std::string& name);
+    bool has_missing_outputs();
+
+    // Declared by a node in its constructor or init(). The resource cost is the
+    // share of the worker threads the node keeps busy, eg. the thread count for
+    // a node that uses parallel_for internally. A parallel executor does not
+    // start a node while the costs of the running nodes plus its own would
+    // exceed the number of threads, unless nothing else is running.
+    void set_concurrency(gfNodeConcurrency concurrency) {
+      concurrency_ = concurrency;
+    }
+    gfNodeConcurrency get_concurrency() const {
+      return concurrency_;
+    }
+    void set_resource_cost(float cost) {
+      resource_cost_ = cost;
+    }
+    float get_resource_cost() const {
+      return resource_cost_;
+    }
+
+    // Estimated memory in bytes that process() allocates, used to keep a
+    // parallel run within its memory budget. Called on the scheduling thread
+    // once the inputs are ready. The default assumes the outputs and working
+    // data together take about twice the size of the inputs (see memory.hpp for
+    // which types are measured); node types override it when they know better.
+    virtual size_t estimate_memory() {
+      return 2 * input_memory_size();
+    }
+    // Reports how many of the items of a long process() are done, eg. for a
+    // progress bar. May be called from any thread.
+    void report_progress(size_t done, size_t total);
+    // True once the run is cancelled or this node has been processing for
+    // longer than the node timeout of its NodeManager. A long process() should
+    // poll this and return early. If it returned true during process() the
+    // outputs are assumed to be incomplete and are discarded; a node that never
+    // polls always keeps its outputs.
+    bool is_cancelled() const;
+    size_t input_memory_size();
 
     template<typename T> void add_param(T parameter) {
       parameters.emplace(parameter.get_label(), std::make_shared<T>(parameter));
@@ -569,12 +653,18 @@ namespace geoflow {
     void set_autorun(bool b) {
       autorun = b;
     }
+    void set_map_mode(bool b) {
+      map_mode = b;
+    }
     bool is_root() {
       return input_terminals.size()==0;
     }
     bool is_leaf() {
       return output_terminals.size()==0;
     }
+    gfNodeStatus get_status() const {
+      return status_;
+    }
 
     NodeHandle get_handle(){ return shared_from_this(); };
     WeakNodeHandle get_weak_handle(){ return shared_from_this(); };
@@ -599,7 +689,12 @@ namespace geoflow {
     virtual void on_clear(gfInputTerminal& it){};
     virtual void on_connect_input(gfInputTerminal& ot){};
     virtual void on_connect_output(gfOutputTerminal& ot){};
-    virtual void on_change_parameter(std::string name, Parameter& param){};
+    // called by the GUI after a parameter was edited. Overrides must take the
+    // name by const reference, it used to be passed by value.
+    virtual void on_change_parameter(const std::string&, Parameter&){};
+    // Problems that would make process() fail that can be found before
+    // running, eg. a file that does not exist (see NodeManager::validate)
+    virtual std::vector<std::string> validate() { return {}; };
     virtual void before_gui(){};
     virtual std::string info() {return std::string();};
 
@@ -613,6 +708,12 @@ namespace geoflow {
     const std::string type_name; // to be managed only by node manager because uniqueness constraint (among all nodes in the manager)
     NodeManager& manager;
     NodeRegisterHandle node_register;
+    gfNodeConcurrency concurrency_ = GF_NODE_REENTRANT;
+    float resource_cost_ = 1;
+    bool missing_outputs_only_ = false;
+    std::chrono::steady_clock::time_point process_start_;
+    // set when is_cancelled() returned true during the last process()
+    mutable std::atomic<bool> cancel_seen_{false};
 
     friend class NodeManager;
   };
@@ -634,6 +735,8 @@ namespace geoflow {
       node_types[type_name] = create_node_type<NodeClass>;
     }
     std::string get_name() const {return name;}
+    // held while a GF_NODE_SERIALIZED node of this type processes
+    std::mutex& type_mutex(const std::string& type_name);
     
     protected:
     template<class NodeClass> static std::shared_ptr<NodeClass> create_node_type(NodeRegisterHandle nr, NodeManager& nm, std::string type_name, std::string node_name){
@@ -650,6 +753,8 @@ namespace geoflow {
       return n;
     }
     std::string name;
+    std::mutex type_mutexes_mutex_;
+    std::map<std::string, std::unique_ptr<std::mutex>> type_mutexes_;
     friend class NodeManager;
   };
   typedef std::unordered_map<std::string, NodeRegisterHandle> NodeRegisterMap_;
@@ -668,6 +773,29 @@ namespace geoflow {
     }
   };
 
+  // Cancels a run from another thread, or once its deadline passes. No more
+  // nodes are started and the nodes that are processing can stop early (see
+  // Node::is_cancelled). Nodes that finished keep their outputs.
+  class CancellationToken {
+    std::atomic<bool> cancelled_{false};
+    // steady clock ticks, 0 means no deadline
+    std::atomic<std::chrono::steady_clock::rep> deadline_{0};
+
+    public:
+    void cancel() { cancelled_ = true; };
+    void set_deadline(std::chrono::steady_clock::time_point deadline) {
+      deadline_ = deadline.time_since_epoch().count();
+    };
+    void set_timeout(double seconds) {
+      set_deadline(std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(seconds)));
+    };
+    bool is_cancelled() const {
+      auto deadline = deadline_.load();
+      return cancelled_ || (deadline != 0 && std::chrono::steady_clock::now().time_since_epoch().count() >= deadline);
+    };
+  };
+  typedef std::shared_ptr<CancellationToken> CancellationHandle;
+
   class NodeManager {
     // manages a set of nodes that form one flowchart. Every node must linked to a NodeManager.
     private:
@@ -677,7 +805,13 @@ namespace geoflow {
 
     public:
     std::unordered_map<std::string, std::shared_ptr<Parameter>> global_flowchart_params;
+    // Offset that is subtracted from world coordinates to keep them in float
+    // range. Nodes may run in parallel, so process() should use the accessors
+    // below rather than the member.
     std::optional<std::array<double,3>> data_offset;
+    std::optional<std::array<double,3>> get_data_offset() const;
+    // sets data_offset unless it was already set, returns the offset in effect
+    std::array<double,3> set_data_offset(const std::array<double,3>& offset);
     NodeManager(NodeRegisterMap&  node_registers)
       : registers_(node_registers) {};
     NodeManager(NodeManager&  other_node_manager)
@@ -686,7 +820,7 @@ namespace geoflow {
         other_node_manager.json_serialise(ss);
         set_globals(other_node_manager);
         json_unserialise(ss);
-        data_offset = *other_node_manager.data_offset;
+        data_offset = other_node_manager.get_data_offset();
       };
     
     NodeRegisterMap& get_node_registers() const { return registers_; };
@@ -697,6 +831,9 @@ namespace geoflow {
     NodeHandle create_node(NodeRegisterHandle node_register, std::string type_name);
     NodeHandle create_node(NodeRegister& node_register, std::string type_name, std::pair<float,float> pos);
     NodeHandle create_node(NodeRegisterHandle node_register, std::string type_name, std::pair<float,float> pos);
+    // creates a node of the same type as node, which may belong to another
+    // manager, with a copy of its parameter values but no connections
+    NodeHandle create_copy(Node& node);
     void remove_node(NodeHandle node);
     void clear();
 
@@ -717,14 +854,142 @@ namespace geoflow {
     std::string substitute_globals(const std::string& text) const;
     
     size_t run_all(bool notify_children=true);
+    // Pull mode: runs only the nodes that the targets depend on, including the
+    // targets themselves. Branches that no target needs, eg. a debug chain,
+    // are not processed. Without targets the sink nodes are used.
+    size_t run_targets(const std::vector<NodeHandle>& targets, bool notify_children=true);
+    // nodes with a marked output and nodes without outputs (writers)
+    std::vector<NodeHandle> sink_nodes();
     size_t run(Node &node, bool notify_children=true);
+    // Merges nodes that are equivalent, ie. of the same type with the same
+    // parameter values, autorun and map mode settings and the same upstream
+    // connections, so that each is computed once. The consumers of a duplicate
+    // are connected to the node that is kept and the duplicate is removed.
+    // Nodes without outputs and main thread nodes are never merged. Returns the
+    // (removed, kept) names.
+    std::vector<std::pair<std::string, std::string>> merge_equivalent_nodes();
+    // Checks the flowchart without processing any node and describes every
+    // problem found: nodes that could not be loaded (eg. their plugin register
+    // is missing), connections that failed, required inputs that are not
+    // connected, connections between incompatible terminals, references to
+    // globals that do not exist and the problems reported by Node::validate().
+    // With nested set, marked inputs need no connection since the NestNode
+    // feeds them.
+    std::vector<std::string> validate(bool nested=false);
+    // Computes the outputs of a processed node that were requested after it
+    // ran, then runs the nodes that consume them. Other outputs and their
+    // consumers are left as they are.
+    size_t run_missing_outputs(Node& node);
     size_t run(NodeHandle node, bool notify_children=true) {
       return run(*node, notify_children);
     };
+    // Runs several nodes and everything downstream of them in one go, so that
+    // a node downstream of more than one of them runs once.
+    size_t run(const std::vector<NodeHandle>& nodes, bool notify_children=true) {
+      return run_roots(nodes, notify_children);
+    };
+
+    // With parallel processing on, nodes whose inputs are ready run at the same
+    // time on the shared executor (see parallel.hpp), within the constraints of
+    // their concurrency class and resource cost. Outputs are always propagated
+    // on the thread that called run().
+    void set_parallel(bool parallel) { parallel_ = parallel; };
+    bool is_parallel() const { return parallel_; };
+    // Memory budget in bytes for parallel runs, 0 means unlimited. A node is
+    // only started when the resident memory of the process, plus what the
+    // running nodes are still expected to allocate, plus its own estimate
+    // (Node::estimate_memory) fits in the budget. A running node is expected to
+    // allocate its estimate minus the growth of the resident memory since it
+    // started. Nodes that do not fit wait for others to finish; a node is
+    // always started when nothing else is running.
+    void set_memory_budget(size_t bytes) { memory_budget_ = bytes; };
+    size_t get_memory_budget() const { return memory_budget_; };
+
+    // Timing history: a moving average of the wall clock duration of each node
+    // (by name) over the runs of this flowchart. With parallel processing on,
+    // of the nodes that are ready the one that starts the longest remaining
+    // path (by recorded durations) is started first. The profile is stored as
+    // json next to the flowchart, see profile_path().
+    struct RunEstimate {
+      double sequential_ms = 0; // sum of the durations of all nodes
+      double critical_path_ms = 0;
+      std::vector<NodeHandle> critical_path;
+      size_t unknown_count = 0; // nodes without timing history, counted as 0ms
+    };
+    static std::string profile_path(const std::string& flowchart_path);
+    bool load_profile(const std::string& filepath);
+    bool dump_profile(const std::string& filepath);
+    void record_duration(const std::string& node_name, double ms);
+    bool has_duration(const std::string& node_name) const;
+    double get_duration(const std::string& node_name) const;
+    // predicted timings of run_all() based on the timing history
+    RunEstimate estimate_run_all();
+
+    // Runs can happen on a background thread, eg. to keep the GUI responsive.
+    // The main thread dispatcher must call the task it is given on the main
+    // thread, return once the task is done and rethrow what the task threw.
+    // Without a dispatcher main thread nodes process on the thread that runs
+    // the flowchart. This also applies to on_receive() and on_clear() of main
+    // thread nodes.
+    typedef std::function<void(const std::function<void()>&)> MainThreadDispatcher;
+    void set_main_thread_dispatcher(MainThreadDispatcher dispatcher) { main_thread_dispatcher_ = dispatcher; };
+    void run_on_main_thread(const std::function<void()>& task) const;
+    // The run observer is told when nodes start, finish, fail and report
+    // progress. It is called from the threads that run the nodes.
+    struct RunEvent {
+      RunEvent(gfRunEventType type, NodeHandle node, double ms = 0)
+        : type(type), node(std::move(node)), ms(ms) {};
+      RunEvent(gfRunEventType type, NodeHandle node, std::string message)
+        : type(type), node(std::move(node)), message(std::move(message)) {};
+      gfRunEventType type;
+      NodeHandle node;
+      double ms = 0; // duration of process(), for GF_RUN_NODE_DONE
+      size_t done = 0, total = 0; // items, for GF_RUN_NODE_PROGRESS
+      std::string message; // the error, for GF_RUN_NODE_FAILED and GF_RUN_NODE_CANCELLED
+    };
+    typedef std::function<void(const RunEvent&)> RunObserver;
+    void set_run_observer(RunObserver observer) { run_observer_ = observer; };
+    void notify_run_event(const RunEvent& event) const;
+
+    // Runs stop early once this token is cancelled, see CancellationToken.
+    // Nested flowcharts and map mode copies share the token of their parent.
+    void set_cancellation_token(CancellationHandle token) { cancellation_token_ = token; };
+    CancellationHandle get_cancellation_token() const { return cancellation_token_; };
+    bool is_cancelled() const { return cancellation_token_ && cancellation_token_->is_cancelled(); };
+    // Wall clock limit in milliseconds for process() of each node, 0 means no
+    // limit. A node that exceeds it is cancelled (see Node::is_cancelled): if it
+    // stops early its outputs are discarded and the nodes that do not depend on
+    // it still run. A node that does not poll is_cancelled() runs to the end.
+    void set_node_timeout(double ms) { node_timeout_ms_ = ms; };
+    double get_node_timeout() const { return node_timeout_ms_; };
     
     protected:
     std::queue<NodeHandle> node_queue;
+    bool parallel_ = false;
+    size_t memory_budget_ = 0;
+    struct NodeTiming {
+      double ms = 0;
+      size_t runs = 0;
+    };
+    std::unordered_map<std::string, NodeTiming> timings_;
+    double remaining_duration(Node& node, std::unordered_map<Node*, double>& memo);
+    std::vector<NodeHandle> autorun_roots();
+    size_t run_roots(const std::vector<NodeHandle>& roots, bool notify_children);
+    // nodes that may be queued during a pull mode run, empty otherwise
+    std::unordered_set<Node*> demanded_;
+    // problems found by json_unserialise, reported by validate()
+    std::vector<std::string> load_problems_;
+    MainThreadDispatcher main_thread_dispatcher_;
+    RunObserver run_observer_;
+    mutable std::mutex data_offset_mutex_;
+    CancellationHandle cancellation_token_;
+    double node_timeout_ms_ = 0;
+    bool discard_if_cancelled(Node& node);
     void queue(NodeHandle n);
+    void process_node(Node& node);
+    void process_node_mapped(Node& node);
+    size_t run_queue_sequential();
+    size_t run_queue_parallel();
     
     friend class Node;
   };
@@ -76,7 +76,7 @@ void EndNode()
     ImNodes::EndNode();
 }
 
-bool Slot(geoflow::gfTerminal* term, int kind)
+bool Slot(geoflow::gfTerminal* term, int kind, const TerminalStatusSource& status_source, bool editable)
 {
     auto* storage = ImGui::GetStateStorage();
     const auto& style = ImGui::GetStyle();
@@ -92,6 +92,7 @@ bool Slot(geoflow::gfTerminal* term, int kind)
     if (ImNodes::BeginSlot(term, title, kind))
     {
         auto* draw_lists = ImGui::GetWindowDrawList();
+        auto status = status_source ? status_source(*term) : geoflow::TerminalStatus::of(*term);
 
         // Slot appearance can be altered depending on curve hovering state.
         bool is_active = ImNodes::IsSlotCurveHovered() ||
@@ -122,7 +123,7 @@ bool Slot(geoflow::gfTerminal* term, int kind)
         float circle_offset_y = title_size.y / 2.f - CIRCLE_RADIUS;
         circle_rect.Min.y += circle_offset_y;
         circle_rect.Max.y += circle_offset_y;
-        auto status_color = gCanvas->colors[term->has_data() ? ImNodes::ColNodeDoneBorder : ImNodes::ColNodeWaitingBorder];
+        auto status_color = gCanvas->colors[status.has_data ? ImNodes::ColNodeDoneBorder : ImNodes::ColNodeWaitingBorder];
         draw_lists->AddCircleFilled(circle_rect.GetCenter(), CIRCLE_RADIUS, color);
         draw_lists->AddCircle(circle_rect.GetCenter(), CIRCLE_RADIUS, status_color, 12, term->is_marked()?4.0f:2.0f);
 
@@ -134,7 +135,9 @@ bool Slot(geoflow::gfTerminal* term, int kind)
             !ImGui::IsMouseDragging(1)
           ) {
             // ImGui::OpenPopup("TerminalActionsContextMenu");
-            term->set_marked(!term->is_marked());
+            // the run reads the marked state, so it only changes between runs
+            if (editable)
+              term->set_marked(!term->is_marked());
           } else {
             ImGui::BeginTooltip();
             ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(1.0f,1.0f,1.0f,1.0f));
@@ -146,35 +149,18 @@ bool Slot(geoflow::gfTerminal* term, int kind)
                 auto* ot = (geoflow::gfOutputTerminal*) term;
                 ImGui::Text("Output (%lu connections)", ot->get_connections().size());
             }
-            ImGui::Text("Is touched %s", term->is_touched() ? "yes" : "no");
-            ImGui::Text("Has data: %s", term->has_data() ? "yes" : "no");
+            ImGui::Text("Is touched %s", status.is_touched ? "yes" : "no");
+            ImGui::Text("Has data: %s", status.has_data ? "yes" : "no");
             ImGui::Text("Marked: %s", term->is_marked() ? "yes" : "no");
             if (term->get_family()==geoflow::GF_SINGLE_FEATURE ) {
                 ImGui::TextUnformatted("Family: Single Feature");
-                if(term->has_data()) {
-                    if (term->get_side()==geoflow::GF_IN) {
-                        auto* it = (geoflow::gfSingleFeatureInputTerminal*) term;
-                        ImGui::SameLine(); ImGui::Text("(size: %lu)", it->size());
-                    } else{
-                        auto* ot = (geoflow::gfSingleFeatureOutputTerminal*) term;
-                        ImGui::SameLine(); ImGui::Text("(size: %lu)", ot->size());
-                    }
+                if(status.has_data) {
+                    ImGui::SameLine(); ImGui::Text("(size: %lu)", status.size);
                 }
             } else if (term->get_family()==geoflow::GF_MULTI_FEATURE ) {
-                if(term->get_side()==geoflow::GF_IN) {
-                    ImGui::TextUnformatted("Family: Multi Feature");
-                    auto* it = (geoflow::gfMultiFeatureInputTerminal*) term;
-                    for (auto& subterm : it->sub_terminals()) {
-                        ImGui::Text(" %lu %s, ", subterm->size(), subterm->get_name().c_str());
-                        // ImGui::Text("  %s)", subterm->get_type().name());
-                    }
-                } else {
-                    ImGui::TextUnformatted("Family: Multi Feature");
-                    auto* it = (geoflow::gfMultiFeatureOutputTerminal*) term;
-                    for (auto& [name, subterm] : it->sub_terminals()) {
-                        ImGui::Text(" %lu %s, ", subterm->size(), subterm->get_name().c_str());
-                        // ImGui::Text("  %s)", subterm->get_type().name());
-                    }
+                ImGui::TextUnformatted("Family: Multi Feature");
+                for (auto& [size, name] : status.sub_terminals) {
+                    ImGui::Text(" %lu %s, ", size, name.c_str());
                 }
             } else
                 ImGui::TextUnformatted("Family: Unknown");
@@ -210,7 +196,7 @@ bool Slot(geoflow::gfTerminal* term, int kind)
     return false;
 }
 
-void InputSlots(const geoflow::Node::InputTerminalMap& slots)
+void InputSlots(const geoflow::Node::InputTerminalMap& slots, const TerminalStatusSource& status, bool editable)
 {
     const auto& style = ImGui::GetStyle();
 
@@ -219,7 +205,7 @@ void InputSlots(const geoflow::Node::InputTerminalMap& slots)
     {
         for (const auto& [name, term] : slots) {
             // const char* title = term->get_name().c_str();
-            ImNodes::Ez::Slot(&(*term), ImNodes::InputSlotKind(1));
+            ImNodes::Ez::Slot(&(*term), ImNodes::InputSlotKind(1), status, editable);
         }
     }
     ImGui::EndGroup();
@@ -231,7 +217,7 @@ void InputSlots(const geoflow::Node::InputTerminalMap& slots)
     ImGui::BeginGroup();
 }
 
-void OutputSlots(const geoflow::Node::OutputTerminalMap& slots)
+void OutputSlots(const geoflow::Node::OutputTerminalMap& slots, const TerminalStatusSource& status, bool editable)
 {
     const auto& style = ImGui::GetStyle();
 
@@ -244,7 +230,7 @@ void OutputSlots(const geoflow::Node::OutputTerminalMap& slots)
     {
         for (const auto& [name, term] : slots) {
             // const char* title = term->get_name().c_str();
-            ImNodes::Ez::Slot(&(*term), ImNodes::OutputSlotKind(1));
+            ImNodes::Ez::Slot(&(*term), ImNodes::OutputSlotKind(1), status, editable);
         }
     }
     ImGui::EndGroup();
@@ -23,7 +23,9 @@
 #pragma once
 
 #include "ImNodes.h"
+#include <functional>
 #include <geoflow/geoflow.hpp>
+#include <geoflow/gui/flowchart_runner.hpp>
 
 namespace ImNodes
 {
@@ -45,15 +47,20 @@ struct SlotInfo
 IMGUI_API bool BeginNode(void* node_id, ImVec2* pos, bool* selected);
 /// Terminates current node. Should be called regardless of BeginNode() returns value.
 IMGUI_API void EndNode();
+/// Where the slots get the state of their terminal from, eg. FlowchartRunner::terminal_status. When empty the terminals
+/// are read directly, which is only safe while no flowchart run is writing them.
+typedef std::function<geoflow::TerminalStatus(geoflow::gfTerminal&)> TerminalStatusSource;
+
 /// Renders input slot region. Kind is unique value whose sign is ignored.
 /// This function must always be called after BeginNode() and before OutputSlots().
 /// When no input slots are rendered call InputSlots(nullptr, 0);
-IMGUI_API void InputSlots(const geoflow::Node::InputTerminalMap& slots);
+/// Marking a terminal by double clicking it is only possible when editable is set.
+IMGUI_API void InputSlots(const geoflow::Node::InputTerminalMap& slots, const TerminalStatusSource& status = nullptr, bool editable = true);
 
 /// Renders output slot region. Kind is unique value whose sign is ignored. This function must always be called after InputSlots() and function call is required (not optional).
 /// This function must always be called after InputSlots() and before EndNode().
 /// When no input slots are rendered call OutputSlots(nullptr, 0);
-IMGUI_API void OutputSlots(const geoflow::Node::OutputTerminalMap& slots);
+IMGUI_API void OutputSlots(const geoflow::Node::OutputTerminalMap& slots, const TerminalStatusSource& status = nullptr, bool editable = true);
 
 }
 
@@ -0,0 +1,266 @@
+// This file is part of Geoflow
+// Copyright (C) 2018-2019  Ravi Peters, 3D geoinformation TU Delft
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <future>
+#include <deque>
+#include <chrono>
+#include <unordered_map>
+#include "../geoflow.hpp"
+
+namespace geoflow {
+
+  // What the GUI shows of a terminal. While a run is in progress the run
+  // thread writes the terminals, so the GUI draws snapshots of them instead,
+  // see FlowchartRunner::terminal_status.
+  struct TerminalStatus {
+    bool has_data = false;
+    bool is_touched = false;
+    size_t size = 0;
+    // size and name of each sub terminal of a multi feature terminal
+    std::vector<std::pair<size_t, std::string>> sub_terminals;
+
+    // reads the terminal, only safe while no run is writing it
+    static TerminalStatus of(gfTerminal& term) {
+      TerminalStatus status;
+      status.has_data = term.has_data();
+      status.is_touched = term.is_touched();
+      if (term.get_family() == GF_SINGLE_FEATURE) {
+        if (term.get_side() == GF_IN)
+          status.size = static_cast<gfSingleFeatureInputTerminal&>(term).size();
+        else
+          status.size = static_cast<gfSingleFeatureOutputTerminal&>(term).size();
+      } else if (term.get_family() == GF_MULTI_FEATURE) {
+        if (term.get_side() == GF_IN) {
+          for (auto& subterm : static_cast<gfMultiFeatureInputTerminal&>(term).sub_terminals())
+            status.sub_terminals.emplace_back(subterm->size(), subterm->get_name());
+        } else {
+          for (auto& [name, subterm] : static_cast<gfMultiFeatureOutputTerminal&>(term).sub_terminals())
+            status.sub_terminals.emplace_back(subterm->size(), subterm->get_name());
+        }
+      }
+      return status;
+    }
+  };
+
+  // Runs the flowchart on a background thread so that the GUI stays
+  // responsive. The run talks to the GUI thread only through a message queue
+  // that the GUI thread drains every frame (handle_messages): the run events
+  // that make up the per node status along with snapshots of the terminals of
+  // the node, and the main thread nodes (eg. the painters), which the run
+  // hands over to the GUI thread and waits for.
+  class FlowchartRunner {
+    public:
+    typedef std::chrono::steady_clock Clock;
+    struct NodeState {
+      // GF_RUN_NODE_STARTED while processing, else GF_RUN_NODE_DONE,
+      // GF_RUN_NODE_FAILED or GF_RUN_NODE_CANCELLED
+      gfRunEventType status = GF_RUN_NODE_STARTED;
+      Clock::time_point start;
+      double ms = 0;
+      size_t done = 0, total = 0;
+      std::string message;
+    };
+
+    private:
+    NodeManager& manager_;
+    std::thread::id gui_thread_;
+    std::thread thread_;
+    std::atomic<bool> running_{false};
+    // a new token for every run
+    CancellationHandle cancellation_;
+    std::mutex messages_mutex_;
+    std::deque<std::function<void()>> messages_;
+    // only used on the GUI thread
+    std::unordered_map<const Node*, NodeState> node_states_;
+    std::unordered_map<const gfTerminal*, TerminalStatus> terminal_states_;
+    typedef std::vector<std::pair<const gfTerminal*, TerminalStatus>> TerminalSnapshot;
+
+    // Takes snapshots of the terminals of a node that is about to process or
+    // has just finished, on the thread that runs the flowchart. Besides its own
+    // terminals this covers the single feature inputs connected to its
+    // outputs, which only read those outputs. Other terminals may be written
+    // by nodes that are processing at the same time, so they are left alone.
+    static void snapshot(Node& node, TerminalSnapshot& snapshot) {
+      for (auto& [name, iT] : node.input_terminals)
+        snapshot.emplace_back(iT.get(), TerminalStatus::of(*iT));
+      for (auto& [name, oT] : node.output_terminals) {
+        snapshot.emplace_back(oT.get(), TerminalStatus::of(*oT));
+        for (auto& connection : oT->get_connections()) {
+          auto iT = connection.lock();
+          if (iT && iT->get_family() == GF_SINGLE_FEATURE)
+            snapshot.emplace_back(iT.get(), TerminalStatus::of(*iT));
+        }
+      }
+    }
+
+    void post(std::function<void()> message) {
+      std::lock_guard<std::mutex> lock(messages_mutex_);
+      messages_.push_back(std::move(message));
+    }
+    void update(const NodeManager::RunEvent& event, Clock::time_point time) {
+      auto& state = node_states_[event.node.get()];
+      switch (event.type) {
+        case GF_RUN_NODE_STARTED:
+          state = NodeState();
+          state.start = time;
+          break;
+        case GF_RUN_NODE_DONE:
+          state.status = GF_RUN_NODE_DONE;
+          state.ms = event.ms;
+          break;
+        case GF_RUN_NODE_FAILED:
+        case GF_RUN_NODE_CANCELLED:
+          state.status = event.type;
+          state.ms = std::chrono::duration<double, std::milli>(time - state.start).count();
+          state.message = event.message;
+          break;
+        case GF_RUN_NODE_PROGRESS:
+          state.done = event.done;
+          state.total = event.total;
+          break;
+      }
+    }
+
+    public:
+    // must be constructed on the GUI thread
+    FlowchartRunner(NodeManager& manager)
+      : manager_(manager), gui_thread_(std::this_thread::get_id()) {
+      manager_.set_main_thread_dispatcher([this](const std::function<void()>& task) {
+        if (std::this_thread::get_id() == gui_thread_) {
+          task();
+          return;
+        }
+        std::promise<void> done;
+        post([&task, &done]() {
+          try {
+            task();
+            done.set_value();
+          } catch (...) {
+            done.set_exception(std::current_exception());
+          }
+        });
+        done.get_future().get();
+      });
+      manager_.set_run_observer([this](const NodeManager::RunEvent& event) {
+        auto time = Clock::now();
+        // progress is reported from the thread that processes the node, while
+        // the node writes its terminals
+        TerminalSnapshot terminals;
+        if (event.type != GF_RUN_NODE_PROGRESS)
+          snapshot(*event.node, terminals);
+        post([this, event, time, terminals = std::move(terminals)]() {
+          update(event, time);
+          for (auto& [term, status] : terminals)
+            terminal_states_[term] = status;
+        });
+      });
+    }
+    ~FlowchartRunner() {
+      cancel();
+      wait();
+      manager_.set_main_thread_dispatcher(nullptr);
+      manager_.set_run_observer(nullptr);
+      manager_.set_cancellation_token(nullptr);
+    }
+
+    // Starts run on the background thread, returns false if a run is still
+    // in progress. The graph must not be edited until the run is done.
+    bool start(std::function<void(NodeManager&)> run) {
+      if (running_) return false;
+      if (thread_.joinable()) thread_.join();
+      // the state at the start of the run, updated by the node events
+      terminal_states_.clear();
+      for (auto& [name, node] : manager_.get_nodes()) {
+        TerminalSnapshot terminals;
+        snapshot(*node, terminals);
+        for (auto& [term, status] : terminals)
+          terminal_states_[term] = status;
+      }
+      cancellation_ = std::make_shared<CancellationToken>();
+      manager_.set_cancellation_token(cancellation_);
+      running_ = true;
+      thread_ = std::thread([this, run]() {
+        try {
+          run(manager_);
+        } catch (const std::exception& e) {
+          std::cout << "Run failed: " << e.what() << "\n";
+        }
+        running_ = false;
+      });
+      return true;
+    }
+    bool is_running() const { return running_; };
+    // Asks the run in progress to stop, see CancellationToken. The nodes that
+    // finished keep their outputs.
+    void cancel() {
+      if (cancellation_) cancellation_->cancel();
+    }
+    // Blocks until the run is done, meanwhile handling its messages.
+    void wait() {
+      while (running_) {
+        handle_messages();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      if (thread_.joinable()) thread_.join();
+      handle_messages();
+    }
+    // Call every frame on the GUI thread.
+    void handle_messages() {
+      std::deque<std::function<void()>> messages;
+      {
+        std::lock_guard<std::mutex> lock(messages_mutex_);
+        messages.swap(messages_);
+      }
+      for (auto& message : messages) {
+        message();
+      }
+    }
+
+    // State of the node in the last run it was part of, nullptr if it has not
+    // run yet.
+    const NodeState* node_state(const Node& node) const {
+      auto state = node_states_.find(&node);
+      return state == node_states_.end() ? nullptr : &state->second;
+    }
+    // The terminal itself when no run is in progress, otherwise its last
+    // snapshot. Only call on the GUI thread.
+    TerminalStatus terminal_status(gfTerminal& term) const {
+      if (!running_) return TerminalStatus::of(term);
+      auto status = terminal_states_.find(&term);
+      return status == terminal_states_.end() ? TerminalStatus() : status->second;
+    }
+    double elapsed_ms(const NodeState& state) const {
+      if (state.status != GF_RUN_NODE_STARTED) return state.ms;
+      return std::chrono::duration<double, std::milli>(Clock::now() - state.start).count();
+    }
+    void forget(const Node& node) {
+      node_states_.erase(&node);
+      for (auto& [name, iT] : node.input_terminals) terminal_states_.erase(iT.get());
+      for (auto& [name, oT] : node.output_terminals) terminal_states_.erase(oT.get());
+    }
+    void forget_all() {
+      node_states_.clear();
+      terminal_states_.clear();
+    }
+  };
+
+}
@@ -2,7 +2,11 @@
 #include "geoflow/geoflow.hpp"
 #include "povi_nodes.hpp"
 #include "parameter_widgets.hpp"
+#include "flowchart_runner.hpp"
 #include <thread>
+#include <chrono>
+#include <map>
+#include <set>
 #include "misc/cpp/imgui_stdlib.h"
 
 #ifdef GF_BUILD_GUI_FILE_DIALOGS
@@ -18,6 +22,21 @@ class gfImNodes : public RenderObject {
   private:
   geoflow::NodeManager& node_manager_;
   poviApp& app_;
+  // flowchart runs happen in the background, the graph is not edited meanwhile
+  geoflow::FlowchartRunner runner_;
+  // Parameters edited during a run go to a copy of the node, so the run keeps
+  // reading the values it started with. The copies are applied once it stopped.
+  geoflow::NodeManager staging_manager_;
+  std::map<geoflow::NodeHandle, geoflow::NodeHandle> staged_nodes_;
+  // Live update: nodes whose parameters were edited rerun, with everything
+  // downstream of them, once no edits were made for live_update_delay_. An
+  // edit cancels the run in progress.
+  bool live_update_ = true;
+  const std::chrono::milliseconds live_update_delay_{500};
+  std::set<geoflow::NodeHandle> dirty_nodes_;
+  std::chrono::steady_clock::time_point last_edit_;
+  // an edit cancelled a run, the nodes it did not get to run with the rerun
+  bool resume_cancelled_run_ = false;
 
   ImNodes::CanvasState canvas_;
 
@@ -50,11 +69,14 @@ class gfImNodes : public RenderObject {
   }
 
   gfImNodes(geoflow::NodeManager& node_manager, poviApp& app, std::string flowchart_file)
-    : node_manager_(node_manager), app_(app), flowchart_file_(flowchart_file) {
+    : node_manager_(node_manager), app_(app), runner_(node_manager),
+      staging_manager_(node_manager.get_node_registers()), flowchart_file_(flowchart_file) {
       init_node_draw_list();
       canvas_.style.curve_thickness = 2.f;
     };
   ~gfImNodes() {
+    runner_.cancel();
+    runner_.wait();
     node_draw_list_.clear();
     node_manager_.clear();
   }
@@ -82,6 +104,10 @@ class gfImNodes : public RenderObject {
           if (ImGui::MenuItem("Load from JSON", "Ctrl+O")) {
             auto result = osdialog_file(OSDIALOG_OPEN, NULL, "JSON:json");
             if (result.has_value()) {
+              runner_.cancel();
+              runner_.wait();
+              runner_.forget_all();
+              discard_edits();
               node_manager_.clear();
 
               // set current work directory to folder containing flowchart file
@@ -99,16 +125,19 @@ class gfImNodes : public RenderObject {
 			}
 		}
     if (ImGui::BeginMenu("Flowchart")) {
-        if (ImGui::MenuItem("Run all root nodes")) {
-					node_manager_.run_all();
+        if (ImGui::MenuItem("Run all root nodes", NULL, false, !runner_.is_running())) {
+          runner_.start([](geoflow::NodeManager& manager) { manager.run_all(); });
 				}
-        // This sort of works, but very prone to crashes because most of geoflow is not threadsafe atm. Especially painters.
-        // if (ImGui::MenuItem("Run all threaded")) {
-        //   std::thread t_run(&geoflow::NodeManager::run_all, &node_manager_);
-        //   t_run.detach();
-        // }
+        if (ImGui::MenuItem("Cancel run", NULL, false, runner_.is_running())) {
+          runner_.cancel();
+        }
+        ImGui::MenuItem("Live update", NULL, &live_update_);
 				ImGui::Separator();
         if (ImGui::MenuItem("Clear flowchart")) {
+          runner_.cancel();
+          runner_.wait();
+          runner_.forget_all();
+          discard_edits();
 					node_draw_list_.clear();
 					node_manager_.clear();
 				}
@@ -117,7 +146,7 @@ class gfImNodes : public RenderObject {
 				}
       ImGui::EndMenu();
     }
-    if (ImGui::BeginMenu("Globals")) {
+    if (ImGui::BeginMenu("Globals", !runner_.is_running())) {
       // std::string to_remove;
       for (auto it=node_manager_.global_flowchart_params.begin(); it!=node_manager_.global_flowchart_params.end(); ) {
         draw_global_parameter(it->second.get());
@@ -162,10 +191,83 @@ class gfImNodes : public RenderObject {
     }
 	}
     
+  // the node whose parameters the GUI edits: its staged copy if it has one or
+  // a run is in progress, otherwise the node itself
+  geoflow::NodeHandle& editable_node(geoflow::NodeHandle& node) {
+    auto it = staged_nodes_.find(node);
+    if (it != staged_nodes_.end()) return it->second;
+    if (!runner_.is_running()) return node;
+    // so that the globals can be picked for the copy as well
+    staging_manager_.global_flowchart_params = node_manager_.global_flowchart_params;
+    auto& staged = staged_nodes_[node] = staging_manager_.create_copy(*node);
+    for (auto& [name, param] : node->parameters) {
+      if (param->has_master())
+        staged->parameters.at(name)->set_master(param->get_master());
+    }
+    return staged;
+  }
+  void apply_staged_parameters() {
+    for (auto& [node, staged] : staged_nodes_) {
+      for (auto& [name, param] : node->parameters) {
+        auto& staged_param = staged->parameters.at(name);
+        auto value = param->as_json();
+        auto master = param->get_master().lock();
+        if (staged_param->has_master()) {
+          param->set_master(staged_param->get_master());
+        } else {
+          param->clear_master();
+          param->from_json(staged_param->as_json());
+        }
+        if (param->as_json() != value || param->get_master().lock() != master)
+          node->on_change_parameter(name, *param);
+      }
+    }
+    staged_nodes_.clear();
+    staging_manager_.clear();
+  }
+  void discard_edits() {
+    staged_nodes_.clear();
+    staging_manager_.clear();
+    dirty_nodes_.clear();
+    resume_cancelled_run_ = false;
+  }
+
+  void mark_dirty(geoflow::NodeHandle node) {
+    dirty_nodes_.insert(node);
+    last_edit_ = std::chrono::steady_clock::now();
+    if (runner_.is_running()) {
+      runner_.cancel();
+      resume_cancelled_run_ = true;
+    }
+  }
+  void rerun_dirty_nodes() {
+    if (dirty_nodes_.empty() || std::chrono::steady_clock::now() - last_edit_ < live_update_delay_)
+      return;
+    // wait for the cancelled run to wind down
+    if (runner_.is_running()) return;
+    std::vector<geoflow::NodeHandle> nodes(dirty_nodes_.begin(), dirty_nodes_.end());
+    if (resume_cancelled_run_) {
+      // nodes that have their inputs but were not processed
+      for (auto& [name, node] : node_manager_.get_nodes()) {
+        if (!node->is_root() && node->autorun && node->get_status() == geoflow::GF_NODE_READY && !dirty_nodes_.count(node))
+          nodes.push_back(node);
+      }
+    }
+    dirty_nodes_.clear();
+    resume_cancelled_run_ = false;
+    runner_.start([nodes](geoflow::NodeManager& manager) { manager.run(nodes); });
+  }
+    
   void render() {
 
     const ImGuiStyle& style = ImGui::GetStyle();
-
+    runner_.handle_messages();
+    if (!runner_.is_running())
+      apply_staged_parameters();
+    rerun_dirty_nodes();
+    const bool running = runner_.is_running();
+    // the run writes the terminals, so the slots show the snapshots of the runner
+    auto terminal_status = [this](geoflow::gfTerminal& term) { return runner_.terminal_status(term); };
 
     if (ImGui::Begin("Flowchart", nullptr, ImGuiWindowFlags_NoScrollbar | ImGuiWindowFlags_NoScrollWithMouse))
     {
@@ -181,13 +283,27 @@ class gfImNodes : public RenderObject {
             if (ImNodes::Ez::BeginNode(node.get(), &pos, &selected))
             {
                 // Render input nodes first (order is important)
-                ImNodes::Ez::InputSlots(node->input_terminals);
+                ImNodes::Ez::InputSlots(node->input_terminals, terminal_status, !runner_.is_running());
 
                 // Custom node content may go here
                 // ImGui::Text("Pos: %f, %f", pos.x, pos.y);
+                if (auto state = runner_.node_state(*node)) {
+                  if (state->status == geoflow::GF_RUN_NODE_FAILED) {
+                    ImGui::TextColored(ImVec4(1.f, .3f, .3f, 1.f), "failed");
+                    if (ImGui::IsItemHovered())
+                      ImGui::SetTooltip("%s", state->message.c_str());
+                  } else if (state->status == geoflow::GF_RUN_NODE_CANCELLED) {
+                    ImGui::TextDisabled("cancelled");
+                  } else {
+                    ImGui::Text("%.2fs", runner_.elapsed_ms(*state) / 1000);
+                  }
+                  if (state->status == geoflow::GF_RUN_NODE_STARTED && state->total) {
+                    ImGui::ProgressBar(float(state->done) / state->total, ImVec2(80, 0));
+                  }
+                }
 
                 // Render output nodes first (order is important)
-                ImNodes::Ez::OutputSlots(node->output_terminals);
+                ImNodes::Ez::OutputSlots(node->output_terminals, terminal_status, !runner_.is_running());
 
                 // Store new connections when they are created
                 void* source_node_=nullptr;
@@ -195,7 +311,7 @@ class gfImNodes : public RenderObject {
                 const char* source_term_title=nullptr;
                 const char* target_term_title=nullptr;
                 if (ImNodes::GetNewConnection(&target_node_, &target_term_title,
-                    &source_node_, &source_term_title))
+                    &source_node_, &source_term_title) && !running)
                 {
                     auto source_node = (geoflow::Node*)(source_node_);
                     auto target_node = (geoflow::Node*)(target_node_);
@@ -203,7 +319,14 @@ class gfImNodes : public RenderObject {
                     auto& target_term = target_node->input_terminals[std::string(target_term_title)];
                     // std::cerr << "connect " << source_node->get_name() << " [" << source_term_title << ", " << &source_term << "] to " << target_node->get_name() << " [" << target_term_title << ", " << &target_term << "]\n";
                     source_term->connect(*target_term);
-                    node_manager_.run(*target_node);
+                    if (source_node->has_missing_outputs())
+                      runner_.start([source_node = source_node->get_handle()](geoflow::NodeManager& manager) {
+                        manager.run_missing_outputs(*source_node);
+                      });
+                    else
+                      runner_.start([target_node = target_node->get_handle()](geoflow::NodeManager& manager) {
+                        manager.run(*target_node);
+                      });
                 }
 
                 // Render output connections of this node
@@ -225,7 +348,7 @@ class gfImNodes : public RenderObject {
                         to_delete.push_back(input_term);
                       }
                     }
-                    for (auto& input_term : to_delete) {
+                    if (!running) for (auto& input_term : to_delete) {
                       output_term->disconnect(*input_term);
                     }
                 }
@@ -251,21 +374,35 @@ class gfImNodes : public RenderObject {
               // node->gui();
               ImGui::InputText("##name", &name_buffer);
               ImGui::SameLine();
-              if(ImGui::Button("Rename")) {
+              if(ImGui::Button("Rename") && !running) {
                 if(!node_manager_.name_node(node, name_buffer))
                   name_buffer = node->get_name();
               }
-              ImGui::Checkbox("Autorun", &(node->autorun));
-              if (ImGui::MenuItem("Run")) {
-                node_manager_.run(*node);
+              // the run reads these, so they can only be changed between runs
+              bool autorun = node->autorun, map_mode = node->map_mode;
+              if (ImGui::Checkbox("Autorun", &autorun) && !runner_.is_running())
+                node->autorun = autorun;
+              if (ImGui::Checkbox("Map over vectors", &map_mode) && !runner_.is_running())
+                node->map_mode = map_mode;
+              if (ImGui::MenuItem("Run", NULL, false, !running)) {
+                runner_.start([node](geoflow::NodeManager& manager) { manager.run(*node); });
               }
               ImGui::Separator();
               
-              node->gui();
+              if (running) {
+                ImGui::Text("Running, the node can be edited once the run is done");
+              } else {
+                node->gui();
+              }
               if (node->get_register().get_name() != "Visualisation") {
                 if (ImGui::CollapsingHeader("Parameters", ImGuiTreeNodeFlags_DefaultOpen)) {
-                  geoflow::draw_parameters(node);
-                  ImGui::Text("%s", node->info().c_str());
+                  // during a run the edits go to a staged copy of the node
+                  if (geoflow::draw_parameters(editable_node(node)) && live_update_)
+                    mark_dirty(node);
+                  if (running)
+                    ImGui::Text("Edits are applied once the run has stopped");
+                  else
+                    ImGui::Text("%s", node->info().c_str());
                 }
               }
               // if (ImGui::MenuItem("Destroy")) {					
@@ -278,7 +415,9 @@ class gfImNodes : public RenderObject {
             }
             ImGui::PopID();
 
-            if (selected && ImGui::IsKeyPressedMap(ImGuiKey_Delete)) {
+            if (selected && !running && ImGui::IsKeyPressedMap(ImGuiKey_Delete)) {
+              runner_.forget(*node);
+              dirty_nodes_.erase(node);
               node_manager_.remove_node(node);
               node_draw_list_.erase(node_it);
             } else
@@ -305,7 +444,7 @@ class gfImNodes : public RenderObject {
             if ( ImGui::BeginMenu(node_register->get_name().c_str())) {
               for (auto& kv : node_register->node_types) {
                 auto type_name = kv.first;
-                if (ImGui::MenuItem(type_name.c_str())) {
+                if (ImGui::MenuItem(type_name.c_str(), NULL, false, !running)) {
                   auto handle = node_manager_.create_node(node_register, type_name);
                   if (handle->get_type_name()=="Painter" || handle->get_type_name()=="VectorPainter") {
                     auto* painter_node = (geoflow::nodes::gui::PainterNode*)(handle.get());
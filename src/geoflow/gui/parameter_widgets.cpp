@@ -112,10 +112,12 @@ namespace geoflow {
     return changed;
   };
 
-	void draw_parameters(NodeHandle& node) {
+	bool draw_parameters(NodeHandle& node) {
+		bool any_changed = false;
 		node->before_gui();
 		for(auto&& [name, param] : node->parameters) {
-      ImGui::PushID(param.get());
+      // by name, so that a drag continues when the GUI switches to a staged copy
+      ImGui::PushID(name.c_str());
       if(ImGui::Button("G")) {
         ImGui::OpenPopup("GlobalSelector"); 
       }
@@ -128,11 +130,13 @@ namespace geoflow {
           if(gparam->is_type_compatible(*param)) {
             if (ImGui::MenuItem(gparam->get_label().c_str())) {
               param->set_master(gparam);
+              any_changed = true;
             }
           }
         }
         if (ImGui::MenuItem("Clear")) {
           param->clear_master();
+          any_changed = true;
         }
         ImGui::EndPopup();
       }
@@ -143,9 +147,11 @@ namespace geoflow {
         bool changed = draw_parameter(param.get());
         if(changed) {
           node->on_change_parameter(name, *param);
+          any_changed = true;
         }
       }
       ImGui::PopID();
 		}
+		return any_changed;
 	};
 }
\ No newline at end of file
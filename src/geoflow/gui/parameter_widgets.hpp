@@ -7,5 +7,6 @@ namespace geoflow {
 
   bool draw_parameter(Parameter* param);
 
-	void draw_parameters(NodeHandle& node);
+	// returns true if any parameter of the node was changed
+	bool draw_parameters(NodeHandle& node);
 }
\ No newline at end of file
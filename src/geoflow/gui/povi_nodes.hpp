@@ -20,6 +20,7 @@
 #include <algorithm>
 #include <random>
 #include "../geoflow.hpp"
+#include "../kernels.hpp"
 #include "../../viewer/gloo.h"
 #include "../../viewer/app_povi.h"
 #include "imgui_color_gradient.h"
@@ -47,6 +48,7 @@ namespace geoflow::nodes::gui {
     void init() {
       add_input("values", typeid(vec1i));
       add_output("colormap", typeid(ColorMap));
+      set_concurrency(GF_NODE_MAIN_THREAD);
       texture = std::make_shared<Texture1D>();
       texture->set_interpolation_nearest();
       texture->set_wrap_repeat();
@@ -136,6 +138,7 @@ namespace geoflow::nodes::gui {
     void init() {
       add_input("values", typeid(vec1f));
       add_output("colormap", typeid(ColorMap));
+      set_concurrency(GF_NODE_MAIN_THREAD);
       cmap.tex = std::make_shared<Texture1D>();
       cmap.tex->set_wrap_clamp();
       cmap.tex->set_interpolation_linear();
@@ -207,6 +210,8 @@ namespace geoflow::nodes::gui {
 
     public:    
     BasePainterNode (NodeRegisterHandle nr, NodeManager &nm, std::string type_name, std::string node_name):Node(nr, nm, type_name, node_name) {
+      // the painters and textures make OpenGL calls
+      set_concurrency(GF_NODE_MAIN_THREAD);
       painter = std::make_shared<Painter>();
       // painter->set_attribute("position", nullptr, 0, {3});
       // painter->set_attribute("value", nullptr, 0, {1});
@@ -239,7 +244,8 @@ namespace geoflow::nodes::gui {
         typeid(SegmentCollection),
         typeid(LineStringCollection),
         typeid(LinearRingCollection),
-        typeid(LinearRing)
+        typeid(LinearRing),
+        typeid(IndexedMesh)
       });
       add_input("normals", typeid(vec3f));
       add_input("colormap", typeid(ColorMap));
@@ -290,6 +296,9 @@ namespace geoflow::nodes::gui {
             lrc.push_back(gc);
             painter->set_geometry(lrc);
             painter->set_drawmode(GL_LINE_LOOP);
+          } else if (t.is_connected_type(typeid(IndexedMesh))) {
+            auto& gc = input("geometries").get<IndexedMesh&>();
+            painter->set_geometry(gc);
           }
         } else if(&input("normals") == &t) {
           auto& d = input("normals").get<vec3f&>();
@@ -580,17 +589,12 @@ namespace geoflow::nodes::gui {
       tc.push_back({p3,p0,p4});
       tc.push_back({p4,p7,p3});
 
+      //counter-clockwise winding order, one normal per vertex
       vec3f normals;
-      //counter-clockwise winding order
-      for(auto& t : tc){
-        auto a = glm::make_vec3(t[0].data());
-        auto b = glm::make_vec3(t[1].data());
-        auto c = glm::make_vec3(t[2].data());
-        auto n = glm::cross(b-a, c-b);
-
-        normals.push_back({n.x,n.y,n.z});
-        normals.push_back({n.x,n.y,n.z});
-        normals.push_back({n.x,n.y,n.z});
+      for(auto& n : kernels::triangle_normals(tc, false)){
+        normals.push_back(n);
+        normals.push_back(n);
+        normals.push_back(n);
       }
       output("triangle_collection").set(tc);
       output("normals").set(normals);
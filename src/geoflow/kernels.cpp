@@ -0,0 +1,359 @@
+// This file is part of Geoflow
+// Copyright (C) 2018-2019  Ravi Peters, 3D geoinformation TU Delft
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+#include "kernels.hpp"
+#include "kernels_impl.hpp"
+#include "parallel.hpp"
+
+namespace geoflow
+{
+namespace kernels
+{
+
+namespace
+{
+
+struct Scalar
+{
+  static const size_t width = 1;
+  float v;
+
+  static Scalar set1(float a) { return {a}; }
+  static Scalar gather(const float* p, size_t) { return {*p}; }
+  void scatter(float* p, size_t) const { *p = v; }
+  friend Scalar operator+(Scalar a, Scalar b) { return {a.v + b.v}; }
+  friend Scalar operator-(Scalar a, Scalar b) { return {a.v - b.v}; }
+  friend Scalar operator*(Scalar a, Scalar b) { return {a.v * b.v}; }
+  friend Scalar operator/(Scalar a, Scalar b) { return {a.v / b.v}; }
+  friend Scalar min(Scalar a, Scalar b) { return {std::min(a.v, b.v)}; }
+  friend Scalar max(Scalar a, Scalar b) { return {std::max(a.v, b.v)}; }
+  friend Scalar sqrt(Scalar a) { return {std::sqrt(a.v)}; }
+  friend Scalar fmadd(Scalar a, Scalar b, Scalar c) { return {a.v * b.v + c.v}; }
+  float hsum() const { return v; }
+  float hmin() const { return v; }
+  float hmax() const { return v; }
+};
+
+// elements per parallel_for grain, and per partial result of the reductions
+const size_t parallel_block = size_t(1) << 16;
+
+SimdLevel detect_simd_level()
+{
+#ifdef GF_KERNELS_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f"))
+    return GF_SIMD_AVX512;
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    return GF_SIMD_AVX2;
+  return GF_SIMD_SSE;
+#else
+  return GF_SIMD_SCALAR;
+#endif
+}
+
+const KernelTable& kernels_for(SimdLevel level)
+{
+  switch (level)
+  {
+#ifdef GF_KERNELS_X86
+  case GF_SIMD_AVX512: return avx512_kernels();
+  case GF_SIMD_AVX2: return avx2_kernels();
+  case GF_SIMD_SSE: return sse_kernels();
+#endif
+  default: return scalar_kernels();
+  }
+}
+
+struct Dispatch
+{
+  SimdLevel max_level;
+  std::atomic<SimdLevel> level;
+  std::atomic<const KernelTable*> table;
+
+  Dispatch() : max_level(detect_simd_level()), level(max_level), table(&kernels_for(max_level)) {}
+};
+Dispatch& dispatch()
+{
+  static Dispatch dispatch;
+  return dispatch;
+}
+const KernelTable& active()
+{
+  return *dispatch().table.load(std::memory_order_relaxed);
+}
+
+const float* floats(const arr3f* points)
+{
+  return points->data();
+}
+
+// Applies reduce(first, last, result) to blocks of parallel_block elements in
+// parallel, and returns the partial results in block order so that the final
+// sum does not depend on the thread count.
+template <typename Result, typename Reduce>
+std::vector<Result> reduce_blocks(size_t count, Reduce reduce)
+{
+  std::vector<Result> results((count + parallel_block - 1) / parallel_block);
+  parallel_for(0, results.size(), [&](size_t first, size_t last) {
+    for (size_t b = first; b < last; ++b)
+      reduce(b * parallel_block, std::min(count, (b + 1) * parallel_block), results[b]);
+  }, 1);
+  return results;
+}
+
+std::array<double, 3> newell_normal(ConstRingView ring)
+{
+  std::array<double, 3> n = {0, 0, 0};
+  if (ring.size() < 3)
+    return n;
+  auto& origin = ring[0];
+  active().newell(floats(ring.data()), ring.size(), origin.data(), n.data());
+  // the closing edge ends at the origin
+  auto& last = ring.back();
+  double x = last[0] - origin[0], y = last[1] - origin[1], z = last[2] - origin[2];
+  n[0] += y * z;
+  n[1] += z * x;
+  n[2] += x * y;
+  return n;
+}
+
+// eigen decomposition of a symmetric 3x3 matrix by cyclic Jacobi rotations,
+// the eigenvectors end up in the columns of v
+void jacobi_eigen(double a[3][3], double v[3][3])
+{
+  for (size_t i = 0; i < 3; ++i)
+    for (size_t j = 0; j < 3; ++j)
+      v[i][j] = i == j;
+  for (int sweep = 0; sweep < 50; ++sweep)
+  {
+    double off = a[0][1] * a[0][1] + a[0][2] * a[0][2] + a[1][2] * a[1][2];
+    if (off < 1e-30 * (a[0][0] * a[0][0] + a[1][1] * a[1][1] + a[2][2] * a[2][2]) || off == 0)
+      return;
+    for (size_t p = 0; p < 2; ++p)
+    {
+      for (size_t q = p + 1; q < 3; ++q)
+      {
+        if (a[p][q] == 0)
+          continue;
+        double theta = (a[q][q] - a[p][p]) / (2 * a[p][q]);
+        double t = (theta >= 0 ? 1 : -1) / (std::abs(theta) + std::sqrt(theta * theta + 1));
+        double c = 1 / std::sqrt(t * t + 1), s = t * c;
+        for (size_t k = 0; k < 3; ++k)
+        {
+          double akp = a[k][p], akq = a[k][q];
+          a[k][p] = c * akp - s * akq;
+          a[k][q] = s * akp + c * akq;
+        }
+        for (size_t k = 0; k < 3; ++k)
+        {
+          double apk = a[p][k], aqk = a[q][k];
+          a[p][k] = c * apk - s * aqk;
+          a[q][k] = s * apk + c * aqk;
+        }
+        for (size_t k = 0; k < 3; ++k)
+        {
+          double vkp = v[k][p], vkq = v[k][q];
+          v[k][p] = c * vkp - s * vkq;
+          v[k][q] = s * vkp + c * vkq;
+        }
+      }
+    }
+  }
+}
+
+} // namespace
+
+const KernelTable& scalar_kernels()
+{
+  return Kernels<Scalar>::table();
+}
+
+SimdLevel simd_level()
+{
+  return dispatch().level;
+}
+SimdLevel max_simd_level()
+{
+  return dispatch().max_level;
+}
+void set_simd_level(SimdLevel level)
+{
+  auto& d = dispatch();
+  level = std::min(level, d.max_level);
+  d.level = level;
+  d.table = &kernels_for(level);
+}
+const char* simd_level_name(SimdLevel level)
+{
+  switch (level)
+  {
+  case GF_SIMD_SSE: return "SSE";
+  case GF_SIMD_AVX2: return "AVX2";
+  case GF_SIMD_AVX512: return "AVX-512";
+  default: return "scalar";
+  }
+}
+
+vec3f triangle_normals(const TriangleCollection& triangles, bool normalize)
+{
+  vec3f normals(triangles.size());
+  if (triangles.empty())
+    return normals;
+  auto& table = active();
+  const float* data = triangles[0][0].data();
+  parallel_for(0, triangles.size(), [&](size_t first, size_t last) {
+    table.triangle_normals(data + 9 * first, last - first, normals[first].data(), normalize);
+  }, parallel_block);
+  return normals;
+}
+
+arr3f normal(ConstRingView ring)
+{
+  auto n = newell_normal(ring);
+  double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+  if (length == 0)
+    return {0, 0, 0};
+  return {float(n[0] / length), float(n[1] / length), float(n[2] / length)};
+}
+float area(ConstRingView ring)
+{
+  auto n = newell_normal(ring);
+  return float(std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]) / 2);
+}
+float signed_area(ConstRingView ring)
+{
+  return float(newell_normal(ring)[2] / 2);
+}
+bool is_ccw(ConstRingView ring)
+{
+  return signed_area(ring) > 0;
+}
+float area(const LinearRing& polygon)
+{
+  float a = area(view(polygon));
+  for (auto& hole : polygon.interior_rings())
+    a -= area(view(hole));
+  return a;
+}
+vec1f areas(const LinearRingCollection& rings)
+{
+  vec1f result(rings.size());
+  parallel_for(0, rings.size(), [&](size_t first, size_t last) {
+    for (size_t i = first; i < last; ++i)
+      result[i] = area(rings[i]);
+  });
+  return result;
+}
+vec1f areas(const std::vector<LinearRing>& polygons)
+{
+  vec1f result(polygons.size());
+  parallel_for(0, polygons.size(), [&](size_t first, size_t last) {
+    for (size_t i = first; i < last; ++i)
+      result[i] = area(polygons[i]);
+  });
+  return result;
+}
+
+arr3f centroid(ConstRingView points)
+{
+  if (points.empty())
+    return {0, 0, 0};
+  auto& table = active();
+  std::array<double, 3> sum = {0, 0, 0};
+  if (points.size() <= parallel_block)
+  {
+    // a single block, skip the allocations of reduce_blocks
+    table.sum(floats(points.data()), points.size(), sum.data());
+  } else {
+    auto sums = reduce_blocks<std::array<double, 3>>(points.size(), [&](size_t first, size_t last, std::array<double, 3>& sum) {
+      table.sum(floats(points.data() + first), last - first, sum.data());
+    });
+    for (auto& s : sums)
+      for (size_t c = 0; c < 3; ++c)
+        sum[c] += s[c];
+  }
+  double n = double(points.size());
+  return {float(sum[0] / n), float(sum[1] / n), float(sum[2] / n)};
+}
+
+PlaneFit fit_plane(ConstRingView points)
+{
+  PlaneFit fit;
+  fit.centroid = centroid(points);
+  fit.normal = {0, 0, 1};
+  fit.eigenvalues = {0, 0, 0};
+  if (points.size() < 3)
+    return fit;
+  auto& table = active();
+  std::array<double, 6> m = {0, 0, 0, 0, 0, 0};
+  if (points.size() <= parallel_block)
+  {
+    table.moments(floats(points.data()), points.size(), fit.centroid.data(), m.data());
+    for (auto& mk : m)
+      mk /= double(points.size());
+  } else {
+    auto parts = reduce_blocks<std::array<double, 6>>(points.size(), [&](size_t first, size_t last, std::array<double, 6>& moments) {
+      table.moments(floats(points.data() + first), last - first, fit.centroid.data(), moments.data());
+    });
+    for (auto& p : parts)
+      for (size_t k = 0; k < 6; ++k)
+        m[k] += p[k] / double(points.size());
+  }
+  double a[3][3] = {{m[0], m[1], m[2]}, {m[1], m[3], m[4]}, {m[2], m[4], m[5]}};
+  double v[3][3];
+  jacobi_eigen(a, v);
+  std::array<size_t, 3> order = {0, 1, 2};
+  std::sort(order.begin(), order.end(), [&](size_t i, size_t j) { return a[i][i] < a[j][j]; });
+  for (size_t k = 0; k < 3; ++k)
+    fit.eigenvalues[k] = float(std::max(a[order[k]][order[k]], 0.0));
+  for (size_t c = 0; c < 3; ++c)
+    fit.normal[c] = float(v[c][order[0]]);
+  return fit;
+}
+
+Box bbox(ConstRingView points)
+{
+  Box box;
+  if (points.empty())
+    return box;
+  auto& table = active();
+  if (points.size() <= parallel_block)
+  {
+    // a single block, skip the allocations of reduce_blocks; this is the common
+    // case for Box::add on the vertices of one feature
+    arr3f pmin, pmax;
+    table.bbox(floats(points.data()), points.size(), pmin.data(), pmax.data());
+    box.add(pmin);
+    box.add(pmax);
+    return box;
+  }
+  auto parts = reduce_blocks<std::array<arr3f, 2>>(points.size(), [&](size_t first, size_t last, std::array<arr3f, 2>& minmax) {
+    table.bbox(floats(points.data() + first), last - first, minmax[0].data(), minmax[1].data());
+  });
+  for (auto& p : parts)
+  {
+    box.add(p[0]);
+    box.add(p[1]);
+  }
+  return box;
+}
+
+} // namespace kernels
+} // namespace geoflow
@@ -0,0 +1,92 @@
+// This file is part of Geoflow
+// Copyright (C) 2018-2019  Ravi Peters, 3D geoinformation TU Delft
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "common.hpp"
+
+namespace geoflow
+{
+namespace kernels
+{
+
+// Geometry kernels on the common.hpp types. Each kernel has a scalar, SSE, AVX2
+// and AVX-512 implementation; the best one the CPU supports is picked the first
+// time a kernel is used. Inputs larger than a few ten thousand elements are
+// split over threads with parallel_for.
+
+enum SimdLevel
+{
+  GF_SIMD_SCALAR,
+  GF_SIMD_SSE,
+  GF_SIMD_AVX2,
+  GF_SIMD_AVX512
+};
+
+// the instruction set the kernels use, and the best one available on this CPU
+// (always scalar when geoflow was not built for x86-64)
+SimdLevel simd_level();
+SimdLevel max_simd_level();
+// use another instruction set, eg. to compare results. Levels above
+// max_simd_level() are clamped.
+void set_simd_level(SimdLevel level);
+const char* simd_level_name(SimdLevel level);
+
+// One normal per triangle, cross(b - a, c - a), which points to the side from
+// which the triangle is counter-clockwise. Degenerate triangles get a zero
+// normal when normalize is set.
+vec3f triangle_normals(const TriangleCollection& triangles, bool normalize = true);
+
+// Newell normal (unit length, or zero for degenerate rings), area and signed
+// area in the xy plane (positive when counter-clockwise) of a closed ring. The
+// ring does not repeat its first vertex.
+arr3f normal(ConstRingView ring);
+float area(ConstRingView ring);
+float signed_area(ConstRingView ring);
+bool is_ccw(ConstRingView ring);
+// area of the exterior ring minus the area of the holes
+float area(const LinearRing& polygon);
+vec1f areas(const LinearRingCollection& rings);
+vec1f areas(const std::vector<LinearRing>& polygons);
+
+// mean of the points
+arr3f centroid(ConstRingView points);
+// Least squares plane through the points by PCA of their covariance matrix: the
+// normal is the eigenvector of the smallest eigenvalue. The eigenvalues are the
+// variances along the principal axes, in ascending order.
+struct PlaneFit
+{
+  arr3f centroid;
+  arr3f normal;
+  arr3f eigenvalues;
+};
+PlaneFit fit_plane(ConstRingView points);
+Box bbox(ConstRingView points);
+
+inline ConstRingView view(const vec3f& points)
+{
+  return ConstRingView(points.data(), points.data() + points.size());
+}
+inline arr3f normal(const vec3f& ring) { return normal(view(ring)); }
+inline float area(const vec3f& ring) { return area(view(ring)); }
+inline float signed_area(const vec3f& ring) { return signed_area(view(ring)); }
+inline bool is_ccw(const vec3f& ring) { return is_ccw(view(ring)); }
+inline arr3f centroid(const vec3f& points) { return centroid(view(points)); }
+inline PlaneFit fit_plane(const vec3f& points) { return fit_plane(view(points)); }
+inline Box bbox(const vec3f& points) { return bbox(view(points)); }
+
+} // namespace kernels
+} // namespace geoflow
@@ -0,0 +1,67 @@
+// This file is part of Geoflow
+// Copyright (C) 2018-2019  Ravi Peters, 3D geoinformation TU Delft
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// AVX-512 kernels, compiled with -mavx512f and only called when the CPU has it.
+
+#include <immintrin.h>
+
+#include "kernels_impl.hpp"
+
+namespace geoflow
+{
+namespace kernels
+{
+namespace
+{
+
+struct Avx512
+{
+  static const size_t width = 16;
+  __m512 v;
+
+  static Avx512 set1(float a) { return {_mm512_set1_ps(a)}; }
+  static Avx512 gather(const float* p, size_t stride)
+  {
+    __m512i index = _mm512_mullo_epi32(_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15), _mm512_set1_epi32(int(stride)));
+    return {_mm512_i32gather_ps(index, p, 4)};
+  }
+  void scatter(float* p, size_t stride) const
+  {
+    __m512i index = _mm512_mullo_epi32(_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15), _mm512_set1_epi32(int(stride)));
+    _mm512_i32scatter_ps(p, index, v, 4);
+  }
+  friend Avx512 operator+(Avx512 a, Avx512 b) { return {_mm512_add_ps(a.v, b.v)}; }
+  friend Avx512 operator-(Avx512 a, Avx512 b) { return {_mm512_sub_ps(a.v, b.v)}; }
+  friend Avx512 operator*(Avx512 a, Avx512 b) { return {_mm512_mul_ps(a.v, b.v)}; }
+  friend Avx512 operator/(Avx512 a, Avx512 b) { return {_mm512_div_ps(a.v, b.v)}; }
+  friend Avx512 min(Avx512 a, Avx512 b) { return {_mm512_min_ps(a.v, b.v)}; }
+  friend Avx512 max(Avx512 a, Avx512 b) { return {_mm512_max_ps(a.v, b.v)}; }
+  friend Avx512 sqrt(Avx512 a) { return {_mm512_sqrt_ps(a.v)}; }
+  friend Avx512 fmadd(Avx512 a, Avx512 b, Avx512 c) { return {_mm512_fmadd_ps(a.v, b.v, c.v)}; }
+  float hsum() const { return _mm512_reduce_add_ps(v); }
+  float hmin() const { return _mm512_reduce_min_ps(v); }
+  float hmax() const { return _mm512_reduce_max_ps(v); }
+};
+
+} // namespace
+
+const KernelTable& avx512_kernels()
+{
+  return Kernels<Avx512>::table();
+}
+
+} // namespace kernels
+} // namespace geoflow
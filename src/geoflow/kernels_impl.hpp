@@ -0,0 +1,242 @@
+// This file is part of Geoflow
+// Copyright (C) 2018-2019  Ravi Peters, 3D geoinformation TU Delft
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Internal to the kernels: the kernel bodies written once against a small
+// vector type V, instantiated per instruction set in kernels.cpp (scalar),
+// kernels_sse.cpp, kernels_avx2.cpp and kernels_avx512.cpp. Those translation
+// units are compiled with different -m flags, so everything here lives in an
+// unnamed namespace and avoids inline library functions: a copy compiled for
+// AVX must never be picked by the linker for the scalar path.
+//
+// V provides: width, set1, gather(p, stride), scatter(p, stride), + - * /,
+// min, max, sqrt, fmadd(a, b, c) = a * b + c and the horizontal sum, hmin and
+// hmax.
+
+#pragma once
+
+#include <cstddef>
+
+namespace geoflow
+{
+namespace kernels
+{
+
+// The kernels of one instruction set. Points are packed xyz floats, triangles
+// nine floats. Reductions return doubles so that large inputs stay accurate.
+struct KernelTable
+{
+  // one (optionally normalized) normal per triangle, cross(b - a, c - a)
+  void (*triangle_normals)(const float* triangles, size_t count, float* normals, bool normalize);
+  void (*bbox)(const float* points, size_t count, float* pmin, float* pmax);
+  void (*sum)(const float* points, size_t count, double* sum);
+  // sums of xx, xy, xz, yy, yz, zz of the points relative to center
+  void (*moments)(const float* points, size_t count, const float* center, double* moments);
+  // Newell normal (its length is twice the area) of the edges between
+  // points[0..count-1] relative to origin, without the closing edge
+  void (*newell)(const float* points, size_t count, const float* origin, double* normal);
+};
+
+const KernelTable& scalar_kernels();
+#ifdef GF_KERNELS_X86
+const KernelTable& sse_kernels();
+const KernelTable& avx2_kernels();
+const KernelTable& avx512_kernels();
+#endif
+
+namespace
+{
+
+// inner loops accumulate in float for at most this many points at a time
+const size_t accumulate_block = 1024;
+
+template <typename V> struct Kernels
+{
+  static const size_t W = V::width;
+
+  static void normals_step(const float* t, float* out, bool normalize)
+  {
+    V ax = V::gather(t, 9), ay = V::gather(t + 1, 9), az = V::gather(t + 2, 9);
+    V ux = V::gather(t + 3, 9) - ax, uy = V::gather(t + 4, 9) - ay, uz = V::gather(t + 5, 9) - az;
+    V vx = V::gather(t + 6, 9) - ax, vy = V::gather(t + 7, 9) - ay, vz = V::gather(t + 8, 9) - az;
+    V nx = uy * vz - uz * vy;
+    V ny = uz * vx - ux * vz;
+    V nz = ux * vy - uy * vx;
+    if (normalize)
+    {
+      // degenerate triangles get a zero normal
+      V length = sqrt(max(fmadd(nx, nx, fmadd(ny, ny, nz * nz)), V::set1(1.17549435e-38f)));
+      nx = nx / length;
+      ny = ny / length;
+      nz = nz / length;
+    }
+    nx.scatter(out, 3);
+    ny.scatter(out + 1, 3);
+    nz.scatter(out + 2, 3);
+  }
+  static void triangle_normals(const float* triangles, size_t count, float* normals, bool normalize)
+  {
+    size_t i = 0;
+    for (; i + W <= count; i += W)
+      normals_step(triangles + 9 * i, normals + 3 * i, normalize);
+    if (i == count)
+      return;
+    float in[9 * W] = {}, out[3 * W];
+    for (size_t k = 0; k < 9 * (count - i); ++k)
+      in[k] = triangles[9 * i + k];
+    normals_step(in, out, normalize);
+    for (size_t k = 0; k < 3 * (count - i); ++k)
+      normals[3 * i + k] = out[k];
+  }
+
+  // copies the last count % W points into buf, padded with copies of pad
+  static const float* tail(const float* points, size_t count, const float* pad, float* buf)
+  {
+    size_t first = count - count % W;
+    for (size_t k = 0; k < W; ++k)
+      for (size_t c = 0; c < 3; ++c)
+        buf[3 * k + c] = first + k < count ? points[3 * (first + k) + c] : pad[c];
+    return buf;
+  }
+
+  static void bbox(const float* points, size_t count, float* pmin, float* pmax)
+  {
+    if (count == 0)
+      return;
+    V lo[3], hi[3];
+    for (size_t c = 0; c < 3; ++c)
+      lo[c] = hi[c] = V::set1(points[c]);
+    auto step = [&](const float* p) {
+      for (size_t c = 0; c < 3; ++c)
+      {
+        V v = V::gather(p + c, 3);
+        lo[c] = min(lo[c], v);
+        hi[c] = max(hi[c], v);
+      }
+    };
+    size_t i = 0;
+    for (; i + W <= count; i += W)
+      step(points + 3 * i);
+    float buf[3 * W];
+    if (i < count)
+      step(tail(points, count, points, buf));
+    for (size_t c = 0; c < 3; ++c)
+    {
+      pmin[c] = lo[c].hmin();
+      pmax[c] = hi[c].hmax();
+    }
+  }
+
+  static void sum(const float* points, size_t count, double* sum)
+  {
+    sum[0] = sum[1] = sum[2] = 0;
+    const float zero[3] = {0, 0, 0};
+    float buf[3 * W];
+    for (size_t block = 0; block < count; block += accumulate_block)
+    {
+      size_t end = block + accumulate_block < count ? block + accumulate_block : count;
+      V s[3] = {V::set1(0), V::set1(0), V::set1(0)};
+      size_t i = block;
+      for (; i + W <= end; i += W)
+        for (size_t c = 0; c < 3; ++c)
+          s[c] = s[c] + V::gather(points + 3 * i + c, 3);
+      if (i < end)
+      {
+        const float* p = tail(points + 3 * block, end - block, zero, buf);
+        for (size_t c = 0; c < 3; ++c)
+          s[c] = s[c] + V::gather(p + c, 3);
+      }
+      for (size_t c = 0; c < 3; ++c)
+        sum[c] += s[c].hsum();
+    }
+  }
+
+  static void moments(const float* points, size_t count, const float* center, double* moments)
+  {
+    for (size_t k = 0; k < 6; ++k)
+      moments[k] = 0;
+    V cx = V::set1(center[0]), cy = V::set1(center[1]), cz = V::set1(center[2]);
+    float buf[3 * W];
+    for (size_t block = 0; block < count; block += accumulate_block)
+    {
+      size_t end = block + accumulate_block < count ? block + accumulate_block : count;
+      V m[6] = {V::set1(0), V::set1(0), V::set1(0), V::set1(0), V::set1(0), V::set1(0)};
+      auto step = [&](const float* p) {
+        V x = V::gather(p, 3) - cx, y = V::gather(p + 1, 3) - cy, z = V::gather(p + 2, 3) - cz;
+        m[0] = fmadd(x, x, m[0]);
+        m[1] = fmadd(x, y, m[1]);
+        m[2] = fmadd(x, z, m[2]);
+        m[3] = fmadd(y, y, m[3]);
+        m[4] = fmadd(y, z, m[4]);
+        m[5] = fmadd(z, z, m[5]);
+      };
+      size_t i = block;
+      for (; i + W <= end; i += W)
+        step(points + 3 * i);
+      // padding with the center adds nothing
+      if (i < end)
+        step(tail(points + 3 * block, end - block, center, buf));
+      for (size_t k = 0; k < 6; ++k)
+        moments[k] += m[k].hsum();
+    }
+  }
+
+  static void newell(const float* points, size_t count, const float* origin, double* normal)
+  {
+    normal[0] = normal[1] = normal[2] = 0;
+    if (count < 2)
+      return;
+    V ox = V::set1(origin[0]), oy = V::set1(origin[1]), oz = V::set1(origin[2]);
+    // edges i -> i + 1 for i in [0, count - 1)
+    size_t edges = count - 1;
+    float buf[3 * (W + 1)];
+    for (size_t block = 0; block < edges; block += accumulate_block)
+    {
+      size_t end = block + accumulate_block < edges ? block + accumulate_block : edges;
+      V n[3] = {V::set1(0), V::set1(0), V::set1(0)};
+      auto step = [&](const float* p) {
+        V xi = V::gather(p, 3) - ox, yi = V::gather(p + 1, 3) - oy, zi = V::gather(p + 2, 3) - oz;
+        V xj = V::gather(p + 3, 3) - ox, yj = V::gather(p + 4, 3) - oy, zj = V::gather(p + 5, 3) - oz;
+        n[0] = fmadd(yi - yj, zi + zj, n[0]);
+        n[1] = fmadd(zi - zj, xi + xj, n[1]);
+        n[2] = fmadd(xi - xj, yi + yj, n[2]);
+      };
+      size_t i = block;
+      for (; i + W <= end; i += W)
+        step(points + 3 * i);
+      if (i < end)
+      {
+        // the remaining edges, padded with zero length edges at the last point
+        const float* last = points + 3 * end;
+        for (size_t k = 0; k <= W; ++k)
+          for (size_t c = 0; c < 3; ++c)
+            buf[3 * k + c] = i + k <= end ? points[3 * (i + k) + c] : last[c];
+        step(buf);
+      }
+      for (size_t c = 0; c < 3; ++c)
+        normal[c] += n[c].hsum();
+    }
+  }
+
+  static const KernelTable& table()
+  {
+    static const KernelTable table = {triangle_normals, bbox, sum, moments, newell};
+    return table;
+  }
+};
+
+} // namespace
+} // namespace kernels
+} // namespace geoflow
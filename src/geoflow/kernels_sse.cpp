@@ -0,0 +1,77 @@
+// This file is part of Geoflow
+// Copyright (C) 2018-2019  Ravi Peters, 3D geoinformation TU Delft
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// SSE kernels. SSE2 is part of x86-64, so this needs no extra compile flags.
+
+#include <emmintrin.h>
+
+#include "kernels_impl.hpp"
+
+namespace geoflow
+{
+namespace kernels
+{
+namespace
+{
+
+struct Sse
+{
+  static const size_t width = 4;
+  __m128 v;
+
+  static Sse set1(float a) { return {_mm_set1_ps(a)}; }
+  static Sse gather(const float* p, size_t stride) { return {_mm_setr_ps(p[0], p[stride], p[2 * stride], p[3 * stride])}; }
+  void scatter(float* p, size_t stride) const
+  {
+    alignas(16) float a[4];
+    _mm_store_ps(a, v);
+    for (size_t i = 0; i < 4; ++i)
+      p[i * stride] = a[i];
+  }
+  friend Sse operator+(Sse a, Sse b) { return {_mm_add_ps(a.v, b.v)}; }
+  friend Sse operator-(Sse a, Sse b) { return {_mm_sub_ps(a.v, b.v)}; }
+  friend Sse operator*(Sse a, Sse b) { return {_mm_mul_ps(a.v, b.v)}; }
+  friend Sse operator/(Sse a, Sse b) { return {_mm_div_ps(a.v, b.v)}; }
+  friend Sse min(Sse a, Sse b) { return {_mm_min_ps(a.v, b.v)}; }
+  friend Sse max(Sse a, Sse b) { return {_mm_max_ps(a.v, b.v)}; }
+  friend Sse sqrt(Sse a) { return {_mm_sqrt_ps(a.v)}; }
+  friend Sse fmadd(Sse a, Sse b, Sse c) { return {_mm_add_ps(_mm_mul_ps(a.v, b.v), c.v)}; }
+  float hsum() const
+  {
+    __m128 s = _mm_add_ps(v, _mm_movehl_ps(v, v));
+    return _mm_cvtss_f32(_mm_add_ss(s, _mm_shuffle_ps(s, s, 1)));
+  }
+  float hmin() const
+  {
+    __m128 s = _mm_min_ps(v, _mm_movehl_ps(v, v));
+    return _mm_cvtss_f32(_mm_min_ss(s, _mm_shuffle_ps(s, s, 1)));
+  }
+  float hmax() const
+  {
+    __m128 s = _mm_max_ps(v, _mm_movehl_ps(v, v));
+    return _mm_cvtss_f32(_mm_max_ss(s, _mm_shuffle_ps(s, s, 1)));
+  }
+};
+
+} // namespace
+
+const KernelTable& sse_kernels()
+{
+  return Kernels<Sse>::table();
+}
+
+} // namespace kernels
+} // namespace geoflow
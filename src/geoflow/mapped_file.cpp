@@ -0,0 +1,341 @@
+// This file is part of Geoflow
+// Copyright (C) 2018-2019  Ravi Peters, 3D geoinformation TU Delft
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+  #define NOMINMAX
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+#include "mapped_file.hpp"
+
+namespace geoflow
+{
+
+#ifdef _WIN32
+
+namespace
+{
+void fail(const std::string& what, const std::string& path)
+{
+  throw std::runtime_error(what + " failed for " + path + " (error " + std::to_string(GetLastError()) + ")");
+}
+} // namespace
+
+MappedFile MappedFile::create(const std::string& path, size_t size)
+{
+  MappedFile file;
+  file.writable_ = true;
+  file.path_ = path;
+  if (path.empty())
+  {
+    char dir[MAX_PATH], name[MAX_PATH];
+    if (!GetTempPathA(MAX_PATH, dir) || !GetTempFileNameA(dir, "gf", 0, name))
+      fail("creating a temporary file", dir);
+    file.path_ = name;
+    file.temporary_ = true;
+  }
+  DWORD flags = file.temporary_ ? FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE : FILE_ATTRIBUTE_NORMAL;
+  file.file_handle_ = CreateFileA(file.path_.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, flags, nullptr);
+  if (file.file_handle_ == INVALID_HANDLE_VALUE)
+  {
+    file.file_handle_ = nullptr;
+    fail("opening", file.path_);
+  }
+  file.resize(size);
+  return file;
+}
+
+MappedFile MappedFile::open(const std::string& path, bool writable)
+{
+  MappedFile file;
+  file.path_ = path;
+  file.writable_ = writable;
+  DWORD access = writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ;
+  file.file_handle_ = CreateFileA(path.c_str(), access, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file.file_handle_ == INVALID_HANDLE_VALUE)
+  {
+    file.file_handle_ = nullptr;
+    fail("opening", path);
+  }
+  LARGE_INTEGER size;
+  GetFileSizeEx(file.file_handle_, &size);
+  file.size_ = size_t(size.QuadPart);
+  file.map();
+  return file;
+}
+
+void MappedFile::map()
+{
+  if (size_ == 0)
+    return;
+  LARGE_INTEGER size;
+  size.QuadPart = size_;
+  mapping_handle_ = CreateFileMappingA(file_handle_, nullptr, writable_ ? PAGE_READWRITE : PAGE_READONLY, size.HighPart, size.LowPart, nullptr);
+  if (!mapping_handle_)
+    fail("mapping", path_);
+  data_ = (char*)MapViewOfFile(mapping_handle_, writable_ ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, size_);
+  if (!data_)
+    fail("mapping", path_);
+}
+
+void MappedFile::unmap()
+{
+  if (data_)
+    UnmapViewOfFile(data_);
+  if (mapping_handle_)
+    CloseHandle(mapping_handle_);
+  data_ = nullptr;
+  mapping_handle_ = nullptr;
+}
+
+void MappedFile::resize(size_t size)
+{
+  unmap();
+  LARGE_INTEGER end;
+  end.QuadPart = size;
+  if (!SetFilePointerEx(file_handle_, end, nullptr, FILE_BEGIN) || !SetEndOfFile(file_handle_))
+    fail("resizing", path_);
+  size_ = size;
+  map();
+}
+
+void MappedFile::flush()
+{
+  if (data_ && writable_)
+    FlushViewOfFile(data_, 0);
+}
+
+void MappedFile::close()
+{
+  flush();
+  unmap();
+  if (file_handle_)
+    CloseHandle(file_handle_);
+  file_handle_ = nullptr;
+  size_ = 0;
+}
+
+void MappedFile::advise(AccessPattern pattern, size_t offset, size_t length) const {}
+
+void MappedFile::prefetch(size_t offset, size_t length) const
+{
+#if _WIN32_WINNT >= 0x0602
+  if (!data_ || offset >= size_)
+    return;
+  WIN32_MEMORY_RANGE_ENTRY range;
+  range.VirtualAddress = data_ + offset;
+  range.NumberOfBytes = std::min(length, size_ - offset);
+  PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#endif
+}
+
+void MappedFile::release(size_t offset, size_t length) const {}
+
+MappedFile::MappedFile(MappedFile&& other)
+{
+  *this = std::move(other);
+}
+MappedFile& MappedFile::operator=(MappedFile&& other)
+{
+  if (this != &other)
+  {
+    close();
+    std::swap(path_, other.path_);
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+    std::swap(writable_, other.writable_);
+    std::swap(temporary_, other.temporary_);
+    std::swap(file_handle_, other.file_handle_);
+    std::swap(mapping_handle_, other.mapping_handle_);
+  }
+  return *this;
+}
+
+#else
+
+namespace
+{
+void fail(const std::string& what, const std::string& path)
+{
+  throw std::runtime_error(what + " failed for " + path);
+}
+int to_advice(AccessPattern pattern)
+{
+  switch (pattern)
+  {
+  case GF_ACCESS_SEQUENTIAL:
+    return MADV_SEQUENTIAL;
+  case GF_ACCESS_RANDOM:
+    return MADV_RANDOM;
+  default:
+    return MADV_NORMAL;
+  }
+}
+} // namespace
+
+MappedFile MappedFile::create(const std::string& path, size_t size)
+{
+  MappedFile file;
+  file.writable_ = true;
+  if (path.empty())
+  {
+    const char* dir = std::getenv("TMPDIR");
+    std::string name = std::string(dir ? dir : "/tmp") + "/geoflow-XXXXXX";
+    file.fd_ = mkstemp(&name[0]);
+    file.path_ = name;
+    file.temporary_ = true;
+    // the file is removed as soon as it is closed
+    if (file.fd_ != -1)
+      unlink(name.c_str());
+  }
+  else
+  {
+    file.path_ = path;
+    file.fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  }
+  if (file.fd_ == -1)
+    fail("opening", file.path_);
+  file.resize(size);
+  return file;
+}
+
+MappedFile MappedFile::open(const std::string& path, bool writable)
+{
+  MappedFile file;
+  file.path_ = path;
+  file.writable_ = writable;
+  file.fd_ = ::open(path.c_str(), writable ? O_RDWR : O_RDONLY);
+  if (file.fd_ == -1)
+    fail("opening", path);
+  struct stat st;
+  if (fstat(file.fd_, &st) == -1)
+    fail("reading the size", path);
+  file.size_ = size_t(st.st_size);
+  file.map();
+  return file;
+}
+
+void MappedFile::map()
+{
+  if (size_ == 0)
+    return;
+  int protection = writable_ ? PROT_READ | PROT_WRITE : PROT_READ;
+  void* data = mmap(nullptr, size_, protection, MAP_SHARED, fd_, 0);
+  if (data == MAP_FAILED)
+    fail("mapping", path_);
+  data_ = (char*)data;
+}
+
+void MappedFile::unmap()
+{
+  if (data_)
+    munmap(data_, size_);
+  data_ = nullptr;
+}
+
+void MappedFile::resize(size_t size)
+{
+  unmap();
+  if (ftruncate(fd_, off_t(size)) == -1)
+    fail("resizing", path_);
+  size_ = size;
+  map();
+}
+
+void MappedFile::flush()
+{
+  if (data_ && writable_)
+    msync(data_, size_, MS_SYNC);
+}
+
+void MappedFile::close()
+{
+  flush();
+  unmap();
+  if (fd_ != -1)
+    ::close(fd_);
+  fd_ = -1;
+  size_ = 0;
+}
+
+namespace
+{
+// madvise needs a page aligned start address
+void page_advise(char* data, size_t size, size_t offset, size_t length, int advice)
+{
+  if (!data || offset >= size)
+    return;
+  size_t page = size_t(sysconf(_SC_PAGESIZE));
+  size_t begin = offset / page * page;
+  size_t end = std::min(size, offset + std::min(length, size - offset));
+  madvise(data + begin, end - begin, advice);
+}
+} // namespace
+
+void MappedFile::advise(AccessPattern pattern, size_t offset, size_t length) const
+{
+  page_advise(data_, size_, offset, length, to_advice(pattern));
+}
+
+void MappedFile::prefetch(size_t offset, size_t length) const
+{
+  page_advise(data_, size_, offset, length, MADV_WILLNEED);
+}
+
+void MappedFile::release(size_t offset, size_t length) const
+{
+  // for a shared file mapping this only drops the pages from this process, the
+  // data stays in the file
+  page_advise(data_, size_, offset, length, MADV_DONTNEED);
+}
+
+MappedFile::MappedFile(MappedFile&& other)
+{
+  *this = std::move(other);
+}
+MappedFile& MappedFile::operator=(MappedFile&& other)
+{
+  if (this != &other)
+  {
+    close();
+    std::swap(path_, other.path_);
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+    std::swap(writable_, other.writable_);
+    std::swap(temporary_, other.temporary_);
+    std::swap(fd_, other.fd_);
+  }
+  return *this;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+  close();
+}
+
+} // namespace geoflow
@@ -0,0 +1,88 @@
+// This file is part of Geoflow
+// Copyright (C) 2018-2019  Ravi Peters, 3D geoinformation TU Delft
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace geoflow
+{
+
+enum AccessPattern {GF_ACCESS_NORMAL, GF_ACCESS_SEQUENTIAL, GF_ACCESS_RANDOM};
+
+// MappedFile maps a file into memory so that data structures larger than RAM can
+// be paged in and out by the operating system. A temporary file is deleted when
+// the mapping is closed. Operations that fail throw std::runtime_error.
+class MappedFile
+{
+  std::string path_;
+  char* data_ = nullptr;
+  size_t size_ = 0;
+  bool writable_ = false;
+  bool temporary_ = false;
+#ifdef _WIN32
+  void* file_handle_ = nullptr;
+  void* mapping_handle_ = nullptr;
+#else
+  int fd_ = -1;
+#endif
+
+  void map();
+  void unmap();
+
+public:
+  MappedFile() {};
+  // creates (or truncates) the file at path with the given size; with an empty
+  // path a temporary file is created
+  static MappedFile create(const std::string& path, size_t size);
+  // maps an existing file
+  static MappedFile open(const std::string& path, bool writable = false);
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  MappedFile(MappedFile&& other);
+  MappedFile& operator=(MappedFile&& other);
+
+#ifdef _WIN32
+  bool is_open() const { return file_handle_ != nullptr; };
+#else
+  bool is_open() const { return fd_ != -1; };
+#endif
+  const std::string& path() const { return path_; };
+  bool is_temporary() const { return temporary_; };
+  bool is_writable() const { return writable_; };
+  size_t size() const { return size_; };
+  char* data() { return data_; };
+  const char* data() const { return data_; };
+
+  // changes the file size, this moves the mapping so earlier pointers become invalid
+  void resize(size_t size);
+  // writes modified pages back to the file
+  void flush();
+  void close();
+
+  // hints to the operating system how a byte range will be accessed. These are
+  // only hints, they are ignored on platforms that do not support them.
+  void advise(AccessPattern pattern, size_t offset = 0, size_t length = size_t(-1)) const;
+  // asks to read a byte range ahead of its use
+  void prefetch(size_t offset, size_t length) const;
+  // tells that a byte range is not needed for now, so its pages can be evicted
+  void release(size_t offset, size_t length) const;
+};
+
+} // namespace geoflow
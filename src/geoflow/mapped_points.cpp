@@ -0,0 +1,244 @@
+// This file is part of Geoflow
+// Copyright (C) 2018-2019  Ravi Peters, 3D geoinformation TU Delft
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include "mapped_points.hpp"
+
+namespace geoflow
+{
+
+// the file starts with a header, followed by the points as packed floats
+struct MappedPointCollection::Header
+{
+  char magic[8];
+  uint64_t size;
+};
+
+namespace
+{
+const char points_magic[8] = {'G', 'F', 'P', 'O', 'I', 'N', 'T', '1'};
+const size_t data_begin = 16;
+
+size_t capacity_of(const MappedFile& file)
+{
+  return (file.size() - data_begin) / sizeof(arr3f);
+}
+} // namespace
+
+MappedPointCollection MappedPointCollection::create(const std::string& path, size_t capacity)
+{
+  static_assert(sizeof(Header) == data_begin, "unexpected header size");
+  MappedPointCollection points;
+  points.file_ = std::make_shared<MappedFile>(MappedFile::create(path, data_begin + capacity * sizeof(arr3f)));
+  std::memcpy(points.header()->magic, points_magic, sizeof(points_magic));
+  points.header()->size = 0;
+  return points;
+}
+
+MappedPointCollection MappedPointCollection::open(const std::string& path, bool writable)
+{
+  MappedPointCollection points;
+  points.file_ = std::make_shared<MappedFile>(MappedFile::open(path, writable));
+  if (points.file_->size() < data_begin || std::memcmp(points.header()->magic, points_magic, sizeof(points_magic)) != 0)
+    throw std::runtime_error(path + " is not a geoflow point file");
+  if (points.header()->size > capacity_of(*points.file_))
+    throw std::runtime_error(path + " is truncated");
+  return points;
+}
+
+MappedPointCollection::Header* MappedPointCollection::header()
+{
+  return reinterpret_cast<Header*>(file_->data());
+}
+const MappedPointCollection::Header* MappedPointCollection::header() const
+{
+  return reinterpret_cast<const Header*>(file_->data());
+}
+
+size_t MappedPointCollection::size() const
+{
+  return file_ ? size_t(header()->size) : 0;
+}
+size_t MappedPointCollection::capacity() const
+{
+  return file_ ? capacity_of(*file_) : 0;
+}
+
+void MappedPointCollection::reserve(size_t capacity)
+{
+  if (!file_)
+    *this = create();
+  if (capacity > this->capacity())
+    file_->resize(data_begin + capacity * sizeof(arr3f));
+}
+void MappedPointCollection::resize(size_t size)
+{
+  reserve(size);
+  header()->size = size;
+}
+void MappedPointCollection::push_back(const arr3f& point)
+{
+  append(&point, 1);
+}
+void MappedPointCollection::append(const arr3f* points, size_t count)
+{
+  size_t n = size();
+  // grow geometrically like std::vector, remapping is expensive
+  if (n + count > capacity())
+    reserve(std::max(n + count, 2 * capacity()));
+  std::memcpy(data() + n, points, count * sizeof(arr3f));
+  header()->size = n + count;
+}
+
+arr3f* MappedPointCollection::data()
+{
+  return file_ ? reinterpret_cast<arr3f*>(file_->data() + data_begin) : nullptr;
+}
+const arr3f* MappedPointCollection::data() const
+{
+  return file_ ? reinterpret_cast<const arr3f*>(file_->data() + data_begin) : nullptr;
+}
+
+PointChunk MappedPointCollection::chunk(size_t first, size_t last) const
+{
+  last = std::min(last, size());
+  first = std::min(first, last);
+  return PointChunk(data() + first, data() + last);
+}
+
+PointCollection MappedPointCollection::to_point_collection(size_t first, size_t last) const
+{
+  auto c = chunk(first, last);
+  PointCollection points;
+  points.insert(points.end(), c.begin(), c.end());
+  return points;
+}
+
+MappedPointCollection MappedPointCollection::read_xyz(const std::string& xyz_path, std::optional<std::array<double, 3>>& offset, const std::string& path, size_t chunk_size)
+{
+  return read_xyz(xyz_path, [&offset](const std::array<double, 3>& first_point) {
+    if (!offset.has_value())
+      offset = first_point;
+    return *offset;
+  }, path, chunk_size);
+}
+MappedPointCollection MappedPointCollection::read_xyz(const std::string& xyz_path, const std::function<std::array<double, 3>(const std::array<double, 3>&)>& resolve_offset, const std::string& path, size_t chunk_size)
+{
+  std::ifstream in(xyz_path);
+  if (!in)
+    throw std::runtime_error("Could not open " + xyz_path);
+  chunk_size = std::max<size_t>(chunk_size, 1);
+  auto points = create(path, chunk_size);
+  // points are parsed into a buffer of one chunk, which is appended and then
+  // released so that the written pages can be evicted
+  PointCollection buffer;
+  buffer.reserve(chunk_size);
+  auto write_buffer = [&]() {
+    auto first = points.size();
+    points.append(buffer);
+    points.release(first, points.size());
+    buffer.clear();
+  };
+  std::optional<std::array<double, 3>> offset;
+  std::string line;
+  size_t line_number = 0;
+  while (std::getline(in, line))
+  {
+    ++line_number;
+    auto begin = line.find_first_not_of(" \t\r");
+    if (begin == std::string::npos || line[begin] == '#')
+      continue;
+    const char* c = line.c_str() + begin;
+    double p[3];
+    for (size_t a = 0; a < 3; ++a)
+    {
+      char* end;
+      p[a] = std::strtod(c, &end);
+      if (end == c)
+        throw std::runtime_error(xyz_path + ":" + std::to_string(line_number) + ": expected 3 coordinates");
+      c = end;
+    }
+    if (!offset.has_value())
+      offset = resolve_offset({p[0], p[1], p[2]});
+    buffer.push_back({float(p[0] - (*offset)[0]), float(p[1] - (*offset)[1]), float(p[2] - (*offset)[2])});
+    if (buffer.size() == chunk_size)
+      write_buffer();
+  }
+  write_buffer();
+  points.flush();
+  return points;
+}
+
+const std::string& MappedPointCollection::path() const
+{
+  static const std::string empty;
+  return file_ ? file_->path() : empty;
+}
+
+void MappedPointCollection::advise(AccessPattern pattern) const
+{
+  if (file_)
+    file_->advise(pattern);
+}
+void MappedPointCollection::prefetch(size_t first, size_t last) const
+{
+  if (file_ && first < last)
+    file_->prefetch(data_begin + first * sizeof(arr3f), (last - first) * sizeof(arr3f));
+}
+void MappedPointCollection::release(size_t first, size_t last) const
+{
+  if (file_ && first < last)
+    file_->release(data_begin + first * sizeof(arr3f), (last - first) * sizeof(arr3f));
+}
+void MappedPointCollection::flush()
+{
+  if (file_)
+    file_->flush();
+}
+
+void for_each_chunk(const PointCollection& points, size_t chunk_size, const std::function<void(size_t, PointChunk)>& f)
+{
+  chunk_size = std::max<size_t>(chunk_size, 1);
+  for (size_t first = 0; first < points.size(); first += chunk_size)
+  {
+    auto last = std::min(first + chunk_size, points.size());
+    f(first, PointChunk(points.data() + first, points.data() + last));
+  }
+}
+
+void for_each_chunk(const MappedPointCollection& points, size_t chunk_size, const std::function<void(size_t, PointChunk)>& f)
+{
+  if (points.empty())
+    return;
+  chunk_size = std::max<size_t>(chunk_size, 1);
+  auto n = points.size();
+  points.advise(GF_ACCESS_SEQUENTIAL);
+  for (size_t first = 0; first < n; first += chunk_size)
+  {
+    auto last = std::min(first + chunk_size, n);
+    points.prefetch(last, std::min(last + chunk_size, n));
+    f(first, points.chunk(first, last));
+    points.release(first, last);
+  }
+  points.advise(GF_ACCESS_NORMAL);
+}
+
+} // namespace geoflow
@@ -0,0 +1,102 @@
+// This file is part of Geoflow
+// Copyright (C) 2018-2019  Ravi Peters, 3D geoinformation TU Delft
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <functional>
+#include <memory>
+
+#include "common.hpp"
+#include "mapped_file.hpp"
+
+namespace geoflow
+{
+
+// a contiguous run of points, from a PointCollection or a MappedPointCollection
+typedef VertexRange<const arr3f> PointChunk;
+
+// MappedPointCollection stores points in a memory-mapped file, so a point cloud
+// can be larger than the available RAM. The file is either temporary or a
+// persistent file that can be opened again later. Like KDTree the data is shared
+// between copies, which keeps it cheap to pass through terminals; changes made
+// through one copy are seen by all of them. Growing the collection may move the
+// mapping, so pointers and chunks obtained before are invalidated.
+//
+// Nodes that process points chunk by chunk with for_each_chunk work on both
+// PointCollection and MappedPointCollection inputs without loading all points.
+class MappedPointCollection
+{
+  std::shared_ptr<MappedFile> file_;
+
+  struct Header;
+  Header* header();
+  const Header* header() const;
+
+public:
+  MappedPointCollection() {};
+  // creates a new collection, in a temporary file if path is empty
+  static MappedPointCollection create(const std::string& path = "", size_t capacity = 0);
+  // opens a collection that was created with a path
+  static MappedPointCollection open(const std::string& path, bool writable = false);
+  // streams an ASCII file with one "x y z" point per line into a new collection,
+  // holding at most chunk_size points in memory. offset is subtracted from the
+  // coordinates; if it is empty it is set to the first point. Empty lines and
+  // lines starting with # are skipped.
+  static MappedPointCollection read_xyz(const std::string& xyz_path, std::optional<std::array<double, 3>>& offset, const std::string& path = "", size_t chunk_size = 1 << 20);
+  // as above, but the offset is obtained by calling resolve_offset with the
+  // first point, eg. to share it through NodeManager::set_data_offset
+  static MappedPointCollection read_xyz(const std::string& xyz_path, const std::function<std::array<double, 3>(const std::array<double, 3>&)>& resolve_offset, const std::string& path = "", size_t chunk_size = 1 << 20);
+
+  bool is_open() const { return file_ != nullptr; };
+  // path of the file, empty if the collection is not open
+  const std::string& path() const;
+
+  size_t size() const;
+  bool empty() const { return size() == 0; };
+  size_t capacity() const;
+  void reserve(size_t capacity);
+  void resize(size_t size);
+  void push_back(const arr3f& point);
+  void append(const arr3f* points, size_t count);
+  void append(const PointCollection& points) { append(points.data(), points.size()); };
+
+  arr3f* data();
+  const arr3f* data() const;
+  arr3f& operator[](size_t i) { return data()[i]; };
+  const arr3f& operator[](size_t i) const { return data()[i]; };
+
+  // points [first, last) without copying them
+  PointChunk chunk(size_t first, size_t last) const;
+  // copies points [first, last) into a PointCollection
+  PointCollection to_point_collection(size_t first, size_t last) const;
+  PointCollection to_point_collection() const { return to_point_collection(0, size()); };
+
+  // how the points will be accessed, see MappedFile::advise
+  void advise(AccessPattern pattern) const;
+  // read points [first, last) ahead, or allow their pages to be evicted
+  void prefetch(size_t first, size_t last) const;
+  void release(size_t first, size_t last) const;
+  void flush();
+};
+
+// Calls f(first, chunk) for consecutive chunks of at most chunk_size points,
+// where first is the index of the first point in the chunk. For a mapped
+// collection the next chunk is read ahead while f runs and the pages of a chunk
+// are released after it has been processed.
+void for_each_chunk(const PointCollection& points, size_t chunk_size, const std::function<void(size_t, PointChunk)>& f);
+void for_each_chunk(const MappedPointCollection& points, size_t chunk_size, const std::function<void(size_t, PointChunk)>& f);
+
+} // namespace geoflow
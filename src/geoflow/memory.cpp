@@ -0,0 +1,205 @@
+// This file is part of Geoflow
+// Copyright (C) 2018-2019  Ravi Peters, 3D geoinformation TU Delft
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+
+#if defined(_WIN32)
+  #define NOMINMAX
+  #include <windows.h>
+  #include <psapi.h>
+#elif defined(__APPLE__)
+  #include <mach/mach.h>
+#else
+  #include <fstream>
+  #include <unistd.h>
+#endif
+
+#include "common.hpp"
+#include "memory.hpp"
+#include "quantized_points.hpp"
+#include "mapped_points.hpp"
+#include "raster.hpp"
+#include "spatial_index.hpp"
+#include "neighbour_index.hpp"
+
+namespace geoflow
+{
+
+size_t resident_memory()
+{
+#if defined(_WIN32)
+  PROCESS_MEMORY_COUNTERS counters;
+  if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    return counters.WorkingSetSize;
+  return 0;
+#elif defined(__APPLE__)
+  mach_task_basic_info_data_t info;
+  mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+  if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) == KERN_SUCCESS)
+    return info.resident_size;
+  return 0;
+#else
+  // second field of statm is the number of resident pages
+  std::ifstream statm("/proc/self/statm");
+  size_t total = 0, resident = 0;
+  if (statm >> total >> resident)
+    return resident * size_t(sysconf(_SC_PAGESIZE));
+  return 0;
+#endif
+}
+
+size_t parse_memory_size(const std::string& text)
+{
+  size_t pos = 0;
+  double value;
+  try {
+    value = std::stod(text, &pos);
+  } catch (const std::exception&) {
+    throw std::invalid_argument("invalid memory size: " + text);
+  }
+  std::string suffix;
+  for (; pos < text.size(); ++pos)
+    if (!std::isspace((unsigned char)text[pos]))
+      suffix += std::toupper((unsigned char)text[pos]);
+  if (suffix.size() > 1 && suffix.back() == 'B')
+    suffix.pop_back();
+
+  double unit;
+  if (suffix.empty() || suffix == "B") unit = 1;
+  else if (suffix == "K") unit = 1024.;
+  else if (suffix == "M") unit = 1024. * 1024;
+  else if (suffix == "G") unit = 1024. * 1024 * 1024;
+  else if (suffix == "T") unit = 1024. * 1024 * 1024 * 1024;
+  else throw std::invalid_argument("invalid memory size: " + text);
+  if (!(value >= 0))
+    throw std::invalid_argument("invalid memory size: " + text);
+  return size_t(std::llround(value * unit));
+}
+
+std::string format_memory_size(size_t bytes)
+{
+  const char* units[] = {"B", "K", "M", "G", "T"};
+  double value = double(bytes);
+  size_t u = 0;
+  for (; value >= 1024 && u < 4; ++u)
+    value /= 1024;
+  char buffer[32];
+  std::snprintf(buffer, sizeof(buffer), u ? "%.1f%s" : "%.0f%s", value, units[u]);
+  return buffer;
+}
+
+namespace
+{
+template <typename T> size_t vector_size(const std::vector<T>& v)
+{
+  return v.capacity() * sizeof(T);
+}
+size_t vector_size(const vec1b& v)
+{
+  return v.capacity() / 8;
+}
+size_t vector_size(const vec1s& v)
+{
+  size_t size = v.capacity() * sizeof(std::string);
+  for (auto& s : v)
+    size += s.capacity();
+  return size;
+}
+size_t ring_size(const LinearRing& ring)
+{
+  size_t size = vector_size<arr3f>(ring) + vector_size(ring.interior_rings());
+  for (auto& hole : ring.interior_rings())
+    size += vector_size(hole);
+  return size;
+}
+size_t ranges_size(const VertexRangeCollection& ranges)
+{
+  return vector_size(ranges.vertices()) + vector_size(ranges.offsets());
+}
+size_t table_size(const AttributeTable& table)
+{
+  size_t size = vector_size(table.column_names());
+  for (size_t c = 0; c < table.column_count(); ++c)
+  {
+    auto& column = table.column(c);
+    // the null flags, the typed values and for strings the dictionary
+    size += column.size() / 8 + vector_size(column.bools()) + vector_size(column.ints())
+      + vector_size(column.floats()) + vector_size(column.string_codes()) + 2 * vector_size(column.dictionary());
+  }
+  return size;
+}
+} // namespace
+
+size_t memory_size(const std::any& data)
+{
+  if (!data.has_value())
+    return 0;
+  auto& type = data.type();
+  if (type == typeid(vec1f)) return vector_size(*std::any_cast<vec1f>(&data));
+  if (type == typeid(vec1i)) return vector_size(*std::any_cast<vec1i>(&data));
+  if (type == typeid(vec1ui)) return vector_size(*std::any_cast<vec1ui>(&data));
+  if (type == typeid(vec1b)) return vector_size(*std::any_cast<vec1b>(&data));
+  if (type == typeid(vec1s)) return vector_size(*std::any_cast<vec1s>(&data));
+  if (type == typeid(vec2f)) return vector_size(*std::any_cast<vec2f>(&data));
+  if (type == typeid(vec3f)) return vector_size(*std::any_cast<vec3f>(&data));
+  if (type == typeid(PointCollection)) return vector_size<arr3f>(*std::any_cast<PointCollection>(&data));
+  if (type == typeid(SegmentCollection)) return vector_size<std::array<arr3f, 2>>(*std::any_cast<SegmentCollection>(&data));
+  if (type == typeid(TriangleCollection)) return vector_size<Triangle>(*std::any_cast<TriangleCollection>(&data));
+  if (type == typeid(LineString)) return vector_size<arr3f>(*std::any_cast<LineString>(&data));
+  if (type == typeid(LinearRing)) return ring_size(*std::any_cast<LinearRing>(&data));
+  if (type == typeid(LinearRingCollection)) return ranges_size(*std::any_cast<LinearRingCollection>(&data));
+  if (type == typeid(LineStringCollection)) return ranges_size(*std::any_cast<LineStringCollection>(&data));
+  if (type == typeid(Mesh)) {
+    auto& mesh = *std::any_cast<Mesh>(&data);
+    size_t size = vector_size(mesh.get_polygons()) + vector_size(mesh.get_labels());
+    for (auto& polygon : mesh.get_polygons())
+      size += ring_size(polygon);
+    return size;
+  }
+  if (type == typeid(IndexedMesh)) {
+    auto& mesh = *std::any_cast<IndexedMesh>(&data);
+    // the offsets are not exposed, count them at one per ring
+    return vector_size(mesh.vertices()) + vector_size(mesh.indices()) + vector_size(mesh.labels())
+      + mesh.face_count() * 2 * sizeof(size_t);
+  }
+  if (type == typeid(AttributeTable)) return table_size(*std::any_cast<AttributeTable>(&data));
+  if (type == typeid(MultiTriangleCollection)) {
+    auto& collection = *std::any_cast<MultiTriangleCollection>(&data);
+    size_t size = vector_size(collection.get_tricollections()) + table_size(collection.get_attributes());
+    for (auto& triangles : collection.get_tricollections())
+      size += vector_size<Triangle>(triangles);
+    return size;
+  }
+  if (type == typeid(QuantizedPointCollection)) return std::any_cast<QuantizedPointCollection>(&data)->memory_size();
+  if (type == typeid(PackedRTree)) return std::any_cast<PackedRTree>(&data)->memory_size();
+  if (type == typeid(KDTree)) return std::any_cast<KDTree>(&data)->memory_size();
+  if (type == typeid(TiledRaster)) {
+    // mapped tiles live in the page cache, which the kernel can evict
+    auto& raster = *std::any_cast<TiledRaster>(&data);
+    if (raster.is_mapped())
+      return 0;
+    return raster.allocated_tile_count() * raster.tile_size() * raster.tile_size() * sizeof(float);
+  }
+  // mapped points live in the page cache too, so they take no heap memory
+  if (type == typeid(MappedPointCollection)) return 0;
+  return 0;
+}
+
+} // namespace geoflow
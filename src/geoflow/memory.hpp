@@ -0,0 +1,42 @@
+// This file is part of Geoflow
+// Copyright (C) 2018-2019  Ravi Peters, 3D geoinformation TU Delft
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <any>
+#include <cstddef>
+#include <string>
+
+namespace geoflow
+{
+
+// Resident set size of this process in bytes, ie. the physical memory it uses
+// right now. Returns 0 where this can not be determined.
+size_t resident_memory();
+
+// Parses a size like "512M", "200G" or "1.5T" (powers of 1024, the suffix is
+// optional and case insensitive, a trailing B is allowed) into a number of
+// bytes. Throws std::invalid_argument for anything else.
+size_t parse_memory_size(const std::string& text);
+std::string format_memory_size(size_t bytes);
+
+// Approximate heap size in bytes of a value held by a terminal, for the vector,
+// geometry and attribute types in common.hpp and the point, raster and index
+// types of the core nodes. Memory-mapped data and unknown types count as 0.
+size_t memory_size(const std::any& data);
+
+} // namespace geoflow
@@ -0,0 +1,302 @@
+// This file is part of Geoflow
+// Copyright (C) 2018-2019  Ravi Peters, 3D geoinformation TU Delft
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <numeric>
+
+#include "neighbour_index.hpp"
+#include "parallel.hpp"
+
+namespace geoflow
+{
+
+// The tree is a complete binary tree of the given depth stored in implicit
+// (heap) order: the children of node i are 2i+1 and 2i+2 and the last 2^depth
+// nodes are the leaves. Every internal node splits its points in halves on the
+// median of the axis with the largest extent, so the leaves all hold about the
+// same number of points. The point coordinates are stored per axis (x, y and z
+// in separate arrays) in leaf order, so that the distance loop over a leaf works
+// on contiguous floats and can be vectorised by the compiler.
+struct KDTree::Tree
+{
+  std::vector<float> x, y, z;
+  std::vector<size_t> index; // original point index of each stored point
+  std::vector<uint8_t> split_axis;
+  std::vector<float> split_value;
+  std::vector<size_t> node_first, node_last; // range of stored points per node
+  size_t first_leaf = 0;
+  size_t max_leaf_size = 0;
+  Box box;
+
+  bool is_leaf(size_t node) const { return node >= first_leaf; };
+  float coordinate(size_t i, size_t axis) const
+  {
+    return axis == 0 ? x[i] : (axis == 1 ? y[i] : z[i]);
+  };
+
+  // squared distances from (qx,qy,qz) to the points of a leaf
+  void leaf_sq_distances(size_t node, float qx, float qy, float qz, float* out) const
+  {
+    const float* px = x.data() + node_first[node];
+    const float* py = y.data() + node_first[node];
+    const float* pz = z.data() + node_first[node];
+    size_t n = node_last[node] - node_first[node];
+    for (size_t i = 0; i < n; ++i)
+    {
+      float dx = px[i] - qx;
+      float dy = py[i] - qy;
+      float dz = pz[i] - qz;
+      out[i] = dx * dx + dy * dy + dz * dz;
+    }
+  };
+
+  typedef std::pair<float, size_t> Candidate;
+
+  // collects the k nearest points of q in a max-heap on squared distance and
+  // sorts it; distances is scratch space for the leaf distances
+  void nearest(const arr3f& q, size_t k, std::vector<Candidate>& heap, std::vector<float>& distances) const
+  {
+    heap.clear();
+    distances.resize(max_leaf_size);
+    nearest(0, q, k, heap, distances);
+    std::sort_heap(heap.begin(), heap.end());
+  };
+  void nearest(size_t node, const arr3f& q, size_t k, std::vector<Candidate>& heap, std::vector<float>& distances) const
+  {
+    if (is_leaf(node))
+    {
+      leaf_sq_distances(node, q[0], q[1], q[2], distances.data());
+      for (size_t i = 0, n = node_last[node] - node_first[node]; i < n; ++i)
+      {
+        if (heap.size() < k)
+        {
+          heap.push_back({distances[i], index[node_first[node] + i]});
+          std::push_heap(heap.begin(), heap.end());
+        }
+        else if (distances[i] < heap.front().first)
+        {
+          std::pop_heap(heap.begin(), heap.end());
+          heap.back() = {distances[i], index[node_first[node] + i]};
+          std::push_heap(heap.begin(), heap.end());
+        }
+      }
+      return;
+    }
+    float d = q[split_axis[node]] - split_value[node];
+    size_t near = d < 0 ? 2 * node + 1 : 2 * node + 2;
+    nearest(near, q, k, heap, distances);
+    if (heap.size() < k || d * d <= heap.front().first)
+      nearest(near == 2 * node + 1 ? 2 * node + 2 : 2 * node + 1, q, k, heap, distances);
+  };
+
+  // appends the points within the squared radius of q to result
+  void within_radius(const arr3f& q, float sq_radius, std::vector<size_t>& result, std::vector<float>& distances) const
+  {
+    distances.resize(max_leaf_size);
+    std::vector<size_t> stack = {0};
+    while (!stack.empty())
+    {
+      auto node = stack.back();
+      stack.pop_back();
+      if (is_leaf(node))
+      {
+        leaf_sq_distances(node, q[0], q[1], q[2], distances.data());
+        for (size_t i = 0, n = node_last[node] - node_first[node]; i < n; ++i)
+          if (distances[i] <= sq_radius)
+            result.push_back(index[node_first[node] + i]);
+        continue;
+      }
+      float d = q[split_axis[node]] - split_value[node];
+      if (d <= 0 || d * d <= sq_radius)
+        stack.push_back(2 * node + 1);
+      if (d >= 0 || d * d <= sq_radius)
+        stack.push_back(2 * node + 2);
+    }
+  };
+};
+
+KDTree::KDTree(const PointCollection& points, size_t leaf_size)
+{
+  auto tree = std::make_shared<Tree>();
+  leaf_size = std::max<size_t>(leaf_size, 1);
+  size_t n = points.size();
+
+  // the larger half of a split has ceil(size/2) points, so the largest leaf at
+  // a given depth holds ceil(n / 2^depth)
+  size_t depth = 0;
+  while (((n + (size_t(1) << depth) - 1) >> depth) > leaf_size)
+    ++depth;
+  size_t node_count = (size_t(2) << depth) - 1;
+  tree->first_leaf = (size_t(1) << depth) - 1;
+  tree->split_axis.resize(tree->first_leaf);
+  tree->split_value.resize(tree->first_leaf);
+  tree->node_first.resize(node_count);
+  tree->node_last.resize(node_count);
+  tree->node_first[0] = 0;
+  tree->node_last[0] = n;
+
+  // split level by level, the nodes of one level cover disjoint ranges of order
+  // and can be split in parallel
+  std::vector<size_t> order(n);
+  std::iota(order.begin(), order.end(), 0);
+  for (size_t level = 0; level < depth; ++level)
+  {
+    size_t level_first = (size_t(1) << level) - 1;
+    size_t level_size = size_t(1) << level;
+    size_t grain = std::max<size_t>(1, (size_t(1) << 16) / std::max<size_t>(n >> level, 1));
+    parallel_for(level_first, level_first + level_size, [&](size_t first_node, size_t last_node) {
+      for (size_t node = first_node; node < last_node; ++node)
+      {
+        auto first = tree->node_first[node];
+        auto last = tree->node_last[node];
+        arr3f pmin = points[order[first]], pmax = pmin;
+        for (size_t i = first + 1; i < last; ++i)
+        {
+          auto& p = points[order[i]];
+          for (size_t a = 0; a < 3; ++a)
+          {
+            pmin[a] = std::min(pmin[a], p[a]);
+            pmax[a] = std::max(pmax[a], p[a]);
+          }
+        }
+        uint8_t axis = 0;
+        for (uint8_t a = 1; a < 3; ++a)
+          if (pmax[a] - pmin[a] > pmax[axis] - pmin[axis])
+            axis = a;
+        auto mid = first + (last - first) / 2;
+        std::nth_element(order.begin() + first, order.begin() + mid, order.begin() + last,
+          [&points, axis](size_t a, size_t b) { return points[a][axis] < points[b][axis]; });
+        tree->split_axis[node] = axis;
+        tree->split_value[node] = points[order[mid]][axis];
+        tree->node_first[2 * node + 1] = first;
+        tree->node_last[2 * node + 1] = mid;
+        tree->node_first[2 * node + 2] = mid;
+        tree->node_last[2 * node + 2] = last;
+      }
+    }, grain);
+  }
+
+  tree->x.resize(n);
+  tree->y.resize(n);
+  tree->z.resize(n);
+  parallel_for(0, n, [&](size_t first, size_t last) {
+    for (size_t i = first; i < last; ++i)
+    {
+      auto& p = points[order[i]];
+      tree->x[i] = p[0];
+      tree->y[i] = p[1];
+      tree->z[i] = p[2];
+    }
+  });
+  tree->index = std::move(order);
+  for (size_t node = tree->first_leaf; node < node_count; ++node)
+    tree->max_leaf_size = std::max(tree->max_leaf_size, tree->node_last[node] - tree->node_first[node]);
+  if (n)
+  {
+    auto [xmin, xmax] = std::minmax_element(tree->x.begin(), tree->x.end());
+    auto [ymin, ymax] = std::minmax_element(tree->y.begin(), tree->y.end());
+    auto [zmin, zmax] = std::minmax_element(tree->z.begin(), tree->z.end());
+    tree->box.set({*xmin, *ymin, *zmin}, {*xmax, *ymax, *zmax});
+  }
+  tree_ = tree;
+}
+
+size_t KDTree::size() const
+{
+  return tree_ ? tree_->index.size() : 0;
+}
+size_t KDTree::memory_size() const
+{
+  if (!tree_)
+    return 0;
+  auto& t = *tree_;
+  return (t.x.capacity() + t.y.capacity() + t.z.capacity() + t.split_value.capacity()) * sizeof(float)
+    + (t.index.capacity() + t.node_first.capacity() + t.node_last.capacity()) * sizeof(size_t)
+    + t.split_axis.capacity();
+}
+bool KDTree::empty() const
+{
+  return size() == 0;
+}
+Box KDTree::bounds() const
+{
+  return tree_ ? tree_->box : Box();
+}
+
+std::vector<size_t> KDTree::nearest(const arr3f& point, size_t k, std::vector<float>* sq_distances) const
+{
+  std::vector<size_t> result;
+  if (sq_distances)
+    sq_distances->clear();
+  if (empty() || k == 0)
+    return result;
+  std::vector<Tree::Candidate> heap;
+  std::vector<float> distances;
+  tree_->nearest(point, k, heap, distances);
+  for (auto& [d, i] : heap)
+  {
+    result.push_back(i);
+    if (sq_distances)
+      sq_distances->push_back(d);
+  }
+  return result;
+}
+
+std::vector<size_t> KDTree::within_radius(const arr3f& point, float radius) const
+{
+  std::vector<size_t> result;
+  if (empty())
+    return result;
+  std::vector<float> distances;
+  tree_->within_radius(point, radius * radius, result, distances);
+  return result;
+}
+
+void KDTree::nearest(const PointCollection& queries, size_t k, std::vector<size_t>& indices, std::vector<float>& sq_distances) const
+{
+  indices.assign(queries.size() * k, npos);
+  sq_distances.assign(queries.size() * k, std::numeric_limits<float>::infinity());
+  if (empty() || k == 0)
+    return;
+  parallel_for(0, queries.size(), [&](size_t first, size_t last) {
+    std::vector<Tree::Candidate> heap;
+    std::vector<float> distances;
+    for (size_t q = first; q < last; ++q)
+    {
+      tree_->nearest(queries[q], k, heap, distances);
+      for (size_t j = 0; j < heap.size(); ++j)
+      {
+        sq_distances[q * k + j] = heap[j].first;
+        indices[q * k + j] = heap[j].second;
+      }
+    }
+  }, 256);
+}
+
+std::vector<std::vector<size_t>> KDTree::within_radius(const PointCollection& queries, float radius) const
+{
+  std::vector<std::vector<size_t>> result(queries.size());
+  if (empty())
+    return result;
+  parallel_for(0, queries.size(), [&](size_t first, size_t last) {
+    std::vector<float> distances;
+    for (size_t q = first; q < last; ++q)
+      tree_->within_radius(queries[q], radius * radius, result[q], distances);
+  }, 256);
+  return result;
+}
+
+} // namespace geoflow
@@ -0,0 +1,65 @@
+// This file is part of Geoflow
+// Copyright (C) 2018-2019  Ravi Peters, 3D geoinformation TU Delft
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <limits>
+#include <memory>
+
+#include "common.hpp"
+
+namespace geoflow
+{
+
+// KDTree is a static 3D kd-tree over the points of a PointCollection, meant to be
+// built once and shared by all nodes that need neighbourhood queries on the same
+// points. Like PackedRTree the tree data is immutable and shared between copies,
+// so a KDTree can be passed through output terminals and queried from multiple
+// threads at once. The points are stored in the tree, the PointCollection does
+// not need to outlive it.
+class KDTree
+{
+  struct Tree;
+  std::shared_ptr<const Tree> tree_;
+
+public:
+  // marks an empty result slot in the batched nearest query
+  static constexpr size_t npos = std::numeric_limits<size_t>::max();
+
+  KDTree() {};
+  // builds the tree in parallel, leaves hold at most leaf_size points
+  KDTree(const PointCollection& points, size_t leaf_size = 32);
+
+  size_t size() const;
+  bool empty() const;
+  Box bounds() const;
+  // bytes used by the tree data, which is shared by all copies
+  size_t memory_size() const;
+
+  // indices of the k points nearest to point, sorted by increasing distance. If
+  // sq_distances is given it receives the corresponding squared distances.
+  std::vector<size_t> nearest(const arr3f& point, size_t k, std::vector<float>* sq_distances = nullptr) const;
+  // indices of the points within radius of point, in no particular order
+  std::vector<size_t> within_radius(const arr3f& point, float radius) const;
+
+  // batched variants that distribute the query points over multiple threads. The
+  // nearest query writes k results per query point to indices and sq_distances
+  // (query i at position i*k), missing results are npos with an infinite distance.
+  void nearest(const PointCollection& queries, size_t k, std::vector<size_t>& indices, std::vector<float>& sq_distances) const;
+  std::vector<std::vector<size_t>> within_radius(const PointCollection& queries, float radius) const;
+};
+
+} // namespace geoflow
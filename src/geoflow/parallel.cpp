@@ -0,0 +1,402 @@
+// This file is part of Geoflow
+// Copyright (C) 2018-2019  Ravi Peters, 3D geoinformation TU Delft
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <future>
+#include <list>
+#include <mutex>
+#include <thread>
+
+#include <taskflow/taskflow.hpp>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "parallel.hpp"
+
+namespace geoflow
+{
+
+namespace
+{
+
+// Binds each worker thread to one of the CPUs the process may run on, the
+// first time the worker runs a task.
+class AffinityObserver : public tf::ExecutorObserverInterface
+{
+  std::vector<int> cpus_;
+
+public:
+  void set_up(unsigned) override
+  {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0)
+      for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        if (CPU_ISSET(cpu, &set))
+          cpus_.push_back(cpu);
+#endif
+  }
+  void on_entry(unsigned worker_id, tf::TaskView) override
+  {
+#ifdef __linux__
+    thread_local bool pinned = false;
+    if (pinned || cpus_.empty())
+      return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpus_[worker_id % cpus_.size()], &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    pinned = true;
+#endif
+  }
+  void on_exit(unsigned, tf::TaskView) override {}
+};
+
+// The executor only accounts a run correctly when it is started from outside
+// its workers: a run started from a worker lands in that worker's queue and is
+// counted against the taskflow the worker is running, so it never completes.
+// Workers therefore hand their taskflows to this thread, which starts them.
+class Dispatcher
+{
+  tf::Executor& executor_;
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  std::deque<std::unique_ptr<tf::Taskflow>> queue_;
+  bool stopping_ = false;
+  std::thread thread_;
+
+  void loop()
+  {
+    std::list<std::pair<std::unique_ptr<tf::Taskflow>, std::future<void>>> running;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true)
+    {
+      changed_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+      if (stopping_)
+        break;
+      auto flow = std::move(queue_.front());
+      queue_.pop_front();
+      lock.unlock();
+      running.remove_if([](auto& run) {
+        return run.second.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+      });
+      auto future = executor_.run(*flow);
+      running.emplace_back(std::move(flow), std::move(future));
+      lock.lock();
+    }
+    // taskflows that were not started yet are dropped, see submit()
+    queue_.clear();
+    lock.unlock();
+    for (auto& run : running)
+      run.second.wait();
+  }
+
+public:
+  Dispatcher(tf::Executor& executor) : executor_(executor), thread_([this] { loop(); }) {}
+  ~Dispatcher()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    changed_.notify_all();
+    thread_.join();
+  }
+  void push(std::unique_ptr<tf::Taskflow> flow)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (stopping_)
+        return;
+      queue_.push_back(std::move(flow));
+    }
+    changed_.notify_all();
+  }
+};
+
+struct Pool
+{
+  std::mutex mutex;
+  size_t thread_count = 0;
+  bool pin_threads = false;
+  std::unique_ptr<tf::Executor> executor;
+  std::unique_ptr<Dispatcher> dispatcher;
+  // submitted taskflows, kept alive until their run has finished
+  std::list<std::pair<std::unique_ptr<tf::Taskflow>, std::future<void>>> running;
+
+  Pool()
+  {
+    // taskflow allocates its nodes from a function local static pool. Creating
+    // a node here constructs that pool first, so that it is destroyed after
+    // this Pool, which still has taskflows to destroy.
+    tf::Taskflow flow;
+    flow.emplace([]() {});
+  }
+  ~Pool()
+  {
+    shut_down();
+  }
+  void shut_down()
+  {
+    dispatcher.reset();
+    if (executor)
+      executor->wait_for_all();
+    running.clear();
+    executor.reset();
+  }
+  size_t threads() const
+  {
+    return thread_count ? thread_count : std::max<size_t>(std::thread::hardware_concurrency(), 1);
+  }
+  tf::Executor& get()
+  {
+    if (!executor)
+    {
+      executor = std::make_unique<tf::Executor>(unsigned(threads()));
+      if (pin_threads)
+        executor->make_observer<AffinityObserver>();
+      dispatcher = std::make_unique<Dispatcher>(*executor);
+    }
+    return *executor;
+  }
+};
+Pool& pool()
+{
+  static Pool pool;
+  return pool;
+}
+
+// Hands tasks to the executor without waiting for them. Callers make sure that
+// tasks which start late, or not at all, find nothing left to do and return.
+void submit(std::vector<std::function<void()>>& tasks)
+{
+  auto& p = pool();
+  std::lock_guard<std::mutex> lock(p.mutex);
+  for (auto it = p.running.begin(); it != p.running.end();)
+  {
+    if (it->second.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+      it = p.running.erase(it);
+    else
+      ++it;
+  }
+  auto flow = std::make_unique<tf::Taskflow>();
+  for (auto& task : tasks)
+    flow->emplace(std::move(task));
+  auto& executor = p.get();
+  if (executor.this_worker_id() >= 0)
+  {
+    p.dispatcher->push(std::move(flow));
+    return;
+  }
+  auto future = executor.run(*flow);
+  p.running.emplace_back(std::move(flow), std::move(future));
+}
+
+} // namespace
+
+size_t thread_count()
+{
+  auto& p = pool();
+  std::lock_guard<std::mutex> lock(p.mutex);
+  return p.threads();
+}
+void set_thread_count(size_t count)
+{
+  auto& p = pool();
+  std::lock_guard<std::mutex> lock(p.mutex);
+  if (count == p.thread_count)
+    return;
+  p.shut_down();
+  p.thread_count = count;
+}
+bool thread_affinity()
+{
+  auto& p = pool();
+  std::lock_guard<std::mutex> lock(p.mutex);
+  return p.pin_threads;
+}
+void set_thread_affinity(bool pin_threads)
+{
+  auto& p = pool();
+  std::lock_guard<std::mutex> lock(p.mutex);
+  if (pin_threads == p.pin_threads)
+    return;
+  p.shut_down();
+  p.pin_threads = pin_threads;
+}
+
+size_t parallel_chunk_count(size_t begin, size_t end, size_t grain_size)
+{
+  if (end <= begin)
+    return 0;
+  size_t n = end - begin;
+  size_t chunks = (n + grain_size - 1) / std::max<size_t>(grain_size, 1);
+  // a few chunks per thread so that stealing can even out uneven chunks
+  return std::max<size_t>(std::min(chunks, 4 * thread_count()), 1);
+}
+
+void parallel_for(size_t begin, size_t end, const std::function<void(size_t, size_t)>& f, size_t grain_size)
+{
+  size_t chunk_count = parallel_chunk_count(begin, end, grain_size);
+  if (chunk_count == 0)
+    return;
+  if (chunk_count == 1)
+  {
+    f(begin, end);
+    return;
+  }
+  size_t chunk_size = (end - begin + chunk_count - 1) / chunk_count;
+
+  // Chunks are claimed from a shared counter by the caller and by helper tasks
+  // on the executor. The caller only waits for chunks that were claimed, and f
+  // is only touched after a successful claim, so a helper that starts after
+  // the caller returned finds nothing to do.
+  struct State
+  {
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> done{0};
+    std::atomic<bool> failed{false};
+    std::mutex mutex;
+    std::condition_variable finished;
+    std::vector<std::exception_ptr> errors;
+  };
+  auto state = std::make_shared<State>();
+  state->errors.resize(chunk_count);
+  auto work = [state, &f, begin, end, chunk_size, chunk_count]() {
+    for (size_t c; (c = state->next.fetch_add(1)) < chunk_count;)
+    {
+      size_t first = begin + c * chunk_size;
+      if (first < end && !state->failed)
+      {
+        try {
+          f(first, std::min(first + chunk_size, end));
+        } catch (...) {
+          state->errors[c] = std::current_exception();
+          state->failed = true;
+        }
+      }
+      if (state->done.fetch_add(1) + 1 == chunk_count)
+      {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->finished.notify_all();
+      }
+    }
+  };
+  std::vector<std::function<void()>> helpers(std::min(chunk_count - 1, thread_count()), work);
+  submit(helpers);
+  work();
+  {
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->finished.wait(lock, [&] { return state->done == chunk_count; });
+  }
+  // rethrow the first error so the caller sees the same exception as in a sequential loop
+  for (auto& e : state->errors)
+    if (e) std::rethrow_exception(e);
+}
+
+struct TaskGroup::State
+{
+  struct Item
+  {
+    std::function<void()> task;
+    std::atomic<bool> claimed{false};
+  };
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::vector<std::shared_ptr<Item>> items;
+  size_t done = 0;
+  std::exception_ptr error;
+
+  void execute(Item& item)
+  {
+    std::exception_ptr e;
+    try {
+      item.task();
+    } catch (...) {
+      e = std::current_exception();
+    }
+    item.task = nullptr;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (e && !error)
+      error = e;
+    ++done;
+    changed.notify_all();
+  }
+};
+
+TaskGroup::TaskGroup() : state_(std::make_shared<State>()) {}
+TaskGroup::~TaskGroup()
+{
+  try {
+    wait();
+  } catch (...) {
+  }
+}
+
+void TaskGroup::run(std::function<void()> task)
+{
+  auto item = std::make_shared<State::Item>();
+  item->task = std::move(task);
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    state_->items.push_back(item);
+    state_->changed.notify_all();
+  }
+  std::vector<std::function<void()>> tasks = {[state = state_, item]() {
+    if (!item->claimed.exchange(true))
+      state->execute(*item);
+  }};
+  submit(tasks);
+}
+
+void TaskGroup::wait()
+{
+  auto& s = *state_;
+  std::unique_lock<std::mutex> lock(s.mutex);
+  size_t next = 0;
+  while (s.done < s.items.size())
+  {
+    // run what nobody started yet, including tasks added by running tasks
+    std::shared_ptr<State::Item> item;
+    for (; next < s.items.size() && !item; ++next)
+      if (!s.items[next]->claimed.exchange(true))
+        item = s.items[next];
+    if (item)
+    {
+      lock.unlock();
+      s.execute(*item);
+      lock.lock();
+    }
+    else
+    {
+      s.changed.wait(lock);
+    }
+  }
+  s.items.clear();
+  s.done = 0;
+  auto error = s.error;
+  s.error = nullptr;
+  if (error)
+    std::rethrow_exception(error);
+}
+
+} // namespace geoflow
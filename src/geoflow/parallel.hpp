@@ -0,0 +1,97 @@
+// This file is part of Geoflow
+// Copyright (C) 2018-2019  Ravi Peters, 3D geoinformation TU Delft
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace geoflow
+{
+
+// All parallel work in geoflow runs on one process wide work-stealing executor
+// (cpp-taskflow), so that nodes and plugins share a single pool of threads
+// instead of each starting their own. The functions below may be called from
+// any thread, including from tasks that already run on the executor: the
+// calling thread always takes part in the work and never waits for work that
+// no thread has started yet, so nesting does not deadlock.
+
+// Number of worker threads of the executor. Set it before any parallel work is
+// started (eg. from the command line), 0 means one per hardware thread. With
+// pin_threads each worker is bound to its own CPU (Linux only).
+size_t thread_count();
+void set_thread_count(size_t count);
+bool thread_affinity();
+void set_thread_affinity(bool pin_threads);
+
+// Number of chunks parallel_for splits [begin, end) in: at most a few per
+// thread and none smaller than grain_size.
+size_t parallel_chunk_count(size_t begin, size_t end, size_t grain_size = 1024);
+
+// Calls f(first, last) for disjoint subranges that together cover [begin, end),
+// using multiple threads when the range is larger than grain_size. f must be
+// safe to call concurrently. The first exception thrown by f is rethrown.
+void parallel_for(size_t begin, size_t end, const std::function<void(size_t, size_t)>& f, size_t grain_size = 1024);
+
+// Reduces [begin, end) with value = reduce(first, last, value) per chunk, each
+// chunk starting from identity, then folds the chunk results in order with
+// combine. combine must be associative; the result does not depend on which
+// thread ran which chunk.
+template <typename T, typename Reduce, typename Combine>
+T parallel_reduce(size_t begin, size_t end, const T& identity, Reduce reduce, Combine combine, size_t grain_size = 1024)
+{
+  if (end <= begin)
+    return identity;
+  size_t chunk_count = parallel_chunk_count(begin, end, grain_size);
+  size_t chunk_size = (end - begin + chunk_count - 1) / chunk_count;
+  std::vector<T> results(chunk_count, identity);
+  parallel_for(0, chunk_count, [&](size_t first, size_t last) {
+    for (size_t c = first; c < last; ++c)
+    {
+      size_t chunk_begin = begin + c * chunk_size;
+      if (chunk_begin < end)
+        results[c] = reduce(chunk_begin, std::min(chunk_begin + chunk_size, end), results[c]);
+    }
+  }, 1);
+  T value = identity;
+  for (auto& r : results)
+    value = combine(value, r);
+  return value;
+}
+
+// A set of tasks that run concurrently on the executor. wait() runs the tasks
+// that have not started yet on the calling thread, waits for the others and
+// rethrows the first exception of any task. The destructor waits as well, but
+// swallows exceptions.
+class TaskGroup
+{
+  struct State;
+  std::shared_ptr<State> state_;
+
+public:
+  TaskGroup();
+  ~TaskGroup();
+  TaskGroup(const TaskGroup&) = delete;
+  TaskGroup& operator=(const TaskGroup&) = delete;
+
+  void run(std::function<void()> task);
+  void wait();
+};
+
+} // namespace geoflow
@@ -0,0 +1,183 @@
+// This file is part of Geoflow
+// Copyright (C) 2018-2019  Ravi Peters, 3D geoinformation TU Delft
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#include "quantized_points.hpp"
+#include "parallel.hpp"
+
+namespace geoflow
+{
+
+namespace
+{
+// x[i] = origin + q[i] * resolution, written as a plain loop over contiguous
+// arrays so the compiler vectorises the conversion and multiply-add
+template<typename T> void decode_axis(const T* q, size_t n, float origin, float resolution, float* out)
+{
+  for (size_t i = 0; i < n; ++i)
+    out[i] = origin + float(q[i]) * resolution;
+}
+} // namespace
+
+QuantizedPointCollection::QuantizedPointCollection(const PointCollection& points, double resolution, std::array<double, 3> offset)
+  : resolution_(resolution), offset_(offset), size_(points.size())
+{
+  if (!(resolution > 0))
+    throw std::invalid_argument("resolution must be positive");
+  size_t block_count = (size_ + block_size - 1) / block_size;
+  blocks_.resize(block_count);
+
+  // find the block extents on the grid in parallel, assign the storage per block
+  // and then encode the blocks in parallel
+  // llround is undefined for NaN and out of range values, so check first
+  auto snap = [resolution](float v) {
+    double g = double(v) / resolution;
+    if (!(std::abs(g) < 0x1p62))
+      throw std::invalid_argument("can not quantize non-finite or out of range coordinate");
+    return int64_t(std::llround(g));
+  };
+  std::vector<std::array<int64_t, 3>> block_max(block_count);
+  parallel_for(0, block_count, [&](size_t first_block, size_t last_block) {
+    for (size_t b = first_block; b < last_block; ++b)
+    {
+      auto& block = blocks_[b];
+      block.origin.fill(std::numeric_limits<int64_t>::max());
+      block_max[b].fill(std::numeric_limits<int64_t>::min());
+      for (size_t i = b * block_size, end = i + block_length(b); i < end; ++i)
+      {
+        for (size_t a = 0; a < 3; ++a)
+        {
+          auto g = snap(points[i][a]);
+          block.origin[a] = std::min(block.origin[a], g);
+          block_max[b][a] = std::max(block_max[b][a], g);
+        }
+      }
+    }
+  }, 1);
+
+  size_t narrow_size = 0, wide_size = 0;
+  for (size_t b = 0; b < block_count; ++b)
+  {
+    auto& block = blocks_[b];
+    int64_t extent = 0;
+    for (size_t a = 0; a < 3; ++a)
+      extent = std::max(extent, block_max[b][a] - block.origin[a]);
+    if (uint64_t(extent) > std::numeric_limits<uint32_t>::max())
+      throw std::invalid_argument("resolution is too fine for the extent of the points");
+    block.is_wide = extent > std::numeric_limits<uint16_t>::max();
+    auto& data_size = block.is_wide ? wide_size : narrow_size;
+    block.data_begin = data_size;
+    data_size += 3 * block_length(b);
+  }
+  narrow_.resize(narrow_size);
+  wide_.resize(wide_size);
+
+  parallel_for(0, block_count, [&](size_t first_block, size_t last_block) {
+    for (size_t b = first_block; b < last_block; ++b)
+    {
+      auto& block = blocks_[b];
+      size_t n = block_length(b);
+      for (size_t i = 0; i < n; ++i)
+      {
+        auto& p = points[b * block_size + i];
+        for (size_t a = 0; a < 3; ++a)
+        {
+          auto q = snap(p[a]) - block.origin[a];
+          if (block.is_wide)
+            wide_[block.data_begin + a * n + i] = uint32_t(q);
+          else
+            narrow_[block.data_begin + a * n + i] = uint16_t(q);
+        }
+      }
+    }
+  }, 1);
+}
+
+size_t QuantizedPointCollection::memory_size() const
+{
+  return narrow_.size() * sizeof(uint16_t) + wide_.size() * sizeof(uint32_t) + blocks_.size() * sizeof(Block);
+}
+
+arr3f QuantizedPointCollection::operator[](size_t i) const
+{
+  size_t b = i / block_size;
+  auto& block = blocks_[b];
+  size_t n = block_length(b);
+  size_t j = block.data_begin + i % block_size;
+  arr3f p;
+  // same arithmetic as the bulk decode, so both give identical results
+  for (size_t a = 0; a < 3; ++a)
+  {
+    float q = block.is_wide ? float(wide_[j + a * n]) : float(narrow_[j + a * n]);
+    p[a] = float(double(block.origin[a]) * resolution_) + q * float(resolution_);
+  }
+  return p;
+}
+
+std::array<double, 3> QuantizedPointCollection::world_point(size_t i) const
+{
+  auto p = (*this)[i];
+  return {p[0] + offset_[0], p[1] + offset_[1], p[2] + offset_[2]};
+}
+
+void QuantizedPointCollection::decode(size_t first, size_t last, float* x, float* y, float* z) const
+{
+  float* out[3] = {x, y, z};
+  float resolution = float(resolution_);
+  last = std::min(last, size_);
+  while (first < last)
+  {
+    size_t b = first / block_size;
+    auto& block = blocks_[b];
+    size_t n = block_length(b);
+    size_t begin = first % block_size;
+    size_t count = std::min(n - begin, last - first);
+    for (size_t a = 0; a < 3; ++a)
+    {
+      float origin = float(double(block.origin[a]) * resolution_);
+      size_t pos = block.data_begin + a * n + begin;
+      if (block.is_wide)
+        decode_axis(wide_.data() + pos, count, origin, resolution, out[a]);
+      else
+        decode_axis(narrow_.data() + pos, count, origin, resolution, out[a]);
+      out[a] += count;
+    }
+    first += count;
+  }
+}
+
+PointCollection QuantizedPointCollection::decode() const
+{
+  PointCollection points;
+  points.resize(size_);
+  parallel_for(0, blocks_.size(), [&](size_t first_block, size_t last_block) {
+    std::vector<float> x(block_size), y(block_size), z(block_size);
+    for (size_t b = first_block; b < last_block; ++b)
+    {
+      size_t first = b * block_size, n = block_length(b);
+      decode(first, first + n, x.data(), y.data(), z.data());
+      for (size_t i = 0; i < n; ++i)
+        points[first + i] = {x[i], y[i], z[i]};
+    }
+  }, 1);
+  return points;
+}
+
+} // namespace geoflow
@@ -0,0 +1,111 @@
+// This file is part of Geoflow
+// Copyright (C) 2018-2019  Ravi Peters, 3D geoinformation TU Delft
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <iterator>
+
+#include "common.hpp"
+
+namespace geoflow
+{
+
+// QuantizedPointCollection is a compact, read-only store for the points of a
+// PointCollection. Coordinates are snapped to a grid with the given resolution
+// (eg. 0.001 for millimetres) and kept as unsigned integer offsets from the
+// minimum corner of their block of block_size points. A block whose extent fits
+// in 16 bit offsets uses 6 bytes per point instead of 12, other blocks fall back
+// to 32 bit offsets. Decoded coordinates differ from the input by at most half
+// the resolution plus the rounding error of decoding to float, so points on the
+// grid are not guaranteed to decode bit for bit. Blocks are only compact if their
+// points are close together, so sort the points spatially first (eg. with
+// SpaceFillingCurveSort).
+//
+// Like a PointCollection the coordinates are relative to offset, normally the
+// NodeManager::data_offset of the flowchart, so world_point adds it back.
+class QuantizedPointCollection
+{
+public:
+  static constexpr size_t block_size = 4096;
+
+private:
+  struct Block
+  {
+    std::array<int64_t, 3> origin; // in grid units
+    bool is_wide;
+    size_t data_begin; // position of the x offsets in narrow_ or wide_, followed by y and z
+  };
+  double resolution_ = 0.001;
+  std::array<double, 3> offset_ = {0, 0, 0};
+  size_t size_ = 0;
+  std::vector<Block> blocks_;
+  std::vector<uint16_t> narrow_;
+  std::vector<uint32_t> wide_;
+
+  size_t block_length(size_t b) const { return std::min(block_size, size_ - b * block_size); };
+
+public:
+  class const_iterator
+  {
+    const QuantizedPointCollection* collection_ = nullptr;
+    size_t i_ = 0;
+
+  public:
+    typedef std::input_iterator_tag iterator_category;
+    typedef arr3f value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const arr3f* pointer;
+    typedef arr3f reference;
+
+    const_iterator() {};
+    const_iterator(const QuantizedPointCollection* collection, size_t i) : collection_(collection), i_(i) {};
+    arr3f operator*() const { return (*collection_)[i_]; };
+    const_iterator& operator++() { ++i_; return *this; };
+    const_iterator operator++(int) { auto it = *this; ++i_; return it; };
+    bool operator==(const const_iterator& other) const { return i_ == other.i_; };
+    bool operator!=(const const_iterator& other) const { return i_ != other.i_; };
+  };
+
+  QuantizedPointCollection() {};
+  // throws std::invalid_argument if the resolution is not positive, if a point
+  // has a non-finite coordinate or if the resolution is too fine to express the
+  // extent of a block in 32 bits
+  QuantizedPointCollection(const PointCollection& points, double resolution = 0.001, std::array<double, 3> offset = {0, 0, 0});
+
+  size_t size() const { return size_; };
+  bool empty() const { return size_ == 0; };
+  double resolution() const { return resolution_; };
+  const std::array<double, 3>& offset() const { return offset_; };
+  size_t block_count() const { return blocks_.size(); };
+  // bytes used by the encoded coordinates and block headers
+  size_t memory_size() const;
+
+  // decoded point i
+  arr3f operator[](size_t i) const;
+  std::array<double, 3> world_point(size_t i) const;
+  const_iterator begin() const { return const_iterator(this, 0); };
+  const_iterator end() const { return const_iterator(this, size_); };
+
+  // decodes the points [first, last) into separate coordinate arrays of at least
+  // last-first floats each
+  void decode(size_t first, size_t last, float* x, float* y, float* z) const;
+  // decodes all points, in parallel
+  PointCollection decode() const;
+};
+
+} // namespace geoflow
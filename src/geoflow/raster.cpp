@@ -0,0 +1,222 @@
+// This file is part of Geoflow
+// Copyright (C) 2018-2019  Ravi Peters, 3D geoinformation TU Delft
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <mutex>
+#include <stdexcept>
+
+#include "raster.hpp"
+#include "mapped_file.hpp"
+#include "parallel.hpp"
+
+namespace geoflow
+{
+
+// Tile pointers are published atomically so that reads need no lock, allocation
+// takes the mutex and checks again. In memory-mapped mode tile t lives at a fixed
+// place in the file; untouched parts of a sparse file take no disk space.
+struct TiledRaster::Storage
+{
+  size_t tile_cells;
+  float nodata;
+  std::unique_ptr<std::atomic<float*>[]> tiles;
+  std::vector<std::unique_ptr<float[]>> owned_tiles;
+  std::unique_ptr<MappedFile> file;
+  std::mutex mutex;
+
+  Storage(size_t tile_count, size_t tile_cells, float nodata)
+    : tile_cells(tile_cells), nodata(nodata), tiles(new std::atomic<float*>[tile_count])
+  {
+    for (size_t t = 0; t < tile_count; ++t)
+      tiles[t].store(nullptr, std::memory_order_relaxed);
+  };
+
+  float* get(size_t t) const { return tiles[t].load(std::memory_order_acquire); };
+  float* allocate(size_t t)
+  {
+    if (auto tile = get(t))
+      return tile;
+    std::lock_guard<std::mutex> lock(mutex);
+    float* tile = tiles[t].load(std::memory_order_relaxed);
+    if (tile)
+      return tile;
+    if (file)
+    {
+      tile = reinterpret_cast<float*>(file->data()) + t * tile_cells;
+    }
+    else
+    {
+      owned_tiles.emplace_back(new float[tile_cells]);
+      tile = owned_tiles.back().get();
+    }
+    std::fill(tile, tile + tile_cells, nodata);
+    tiles[t].store(tile, std::memory_order_release);
+    return tile;
+  };
+};
+
+TiledRaster::TiledRaster(size_t width, size_t height, arr2f origin, float cell_size, float nodata, size_t tile_size)
+  : width_(width), height_(height), tile_size_(std::max<size_t>(tile_size, 1)), origin_(origin), cell_size_(cell_size), nodata_(nodata)
+{
+  if (!(cell_size > 0))
+    throw std::invalid_argument("raster cell size must be positive");
+  tile_cols_ = (width_ + tile_size_ - 1) / tile_size_;
+  tile_rows_ = (height_ + tile_size_ - 1) / tile_size_;
+  storage_ = std::make_shared<Storage>(tile_count(), tile_size_ * tile_size_, nodata_);
+}
+
+TiledRaster TiledRaster::mapped(size_t width, size_t height, arr2f origin, float cell_size, float nodata, size_t tile_size, const std::string& path)
+{
+  TiledRaster raster(width, height, origin, cell_size, nodata, tile_size);
+  size_t bytes = raster.tile_count() * raster.storage_->tile_cells * sizeof(float);
+  raster.storage_->file = std::make_unique<MappedFile>(MappedFile::create(path, bytes));
+  return raster;
+}
+
+bool TiledRaster::is_mapped() const
+{
+  return storage_ && storage_->file;
+}
+
+Box TiledRaster::box() const
+{
+  Box box;
+  box.set({origin_[0], origin_[1], 0}, {origin_[0] + width_ * cell_size_, origin_[1] + height_ * cell_size_, 0});
+  return box;
+}
+
+bool TiledRaster::is_nodata(float value) const
+{
+  return std::isnan(nodata_) ? std::isnan(value) : value == nodata_;
+}
+
+float TiledRaster::get(size_t col, size_t row) const
+{
+  auto tile = storage_->get(tile_index(col, row));
+  return tile ? tile[tile_offset(col, row)] : nodata_;
+}
+void TiledRaster::set(size_t col, size_t row, float value)
+{
+  storage_->allocate(tile_index(col, row))[tile_offset(col, row)] = value;
+}
+
+bool TiledRaster::locate(float x, float y, size_t& col, size_t& row) const
+{
+  float c = std::floor((x - origin_[0]) / cell_size_);
+  float r = std::floor((y - origin_[1]) / cell_size_);
+  if (!(c >= 0 && r >= 0 && c < width_ && r < height_))
+    return false;
+  col = size_t(c);
+  row = size_t(r);
+  return true;
+}
+arr2f TiledRaster::cell_center(size_t col, size_t row) const
+{
+  return {origin_[0] + (col + 0.5f) * cell_size_, origin_[1] + (row + 0.5f) * cell_size_};
+}
+
+RasterTile TiledRaster::tile(size_t index)
+{
+  size_t col = (index % tile_cols_) * tile_size_;
+  size_t row = (index / tile_cols_) * tile_size_;
+  return {this, index, col, row, std::min(tile_size_, width_ - col), std::min(tile_size_, height_ - row)};
+}
+bool TiledRaster::is_allocated(size_t tile_index) const
+{
+  return storage_->get(tile_index) != nullptr;
+}
+size_t TiledRaster::allocated_tile_count() const
+{
+  size_t count = 0;
+  for (size_t t = 0; t < tile_count(); ++t)
+    count += is_allocated(t);
+  return count;
+}
+const float* TiledRaster::tile_data(size_t tile_index) const
+{
+  return storage_->get(tile_index);
+}
+float* TiledRaster::tile_data(size_t tile_index)
+{
+  return storage_->allocate(tile_index);
+}
+
+void TiledRaster::for_each_tile(const std::function<void(RasterTile&)>& f, bool allocated_only)
+{
+  parallel_for(0, tile_count(), [&](size_t first, size_t last) {
+    for (size_t t = first; t < last; ++t)
+    {
+      if (allocated_only && !is_allocated(t))
+        continue;
+      auto raster_tile = tile(t);
+      f(raster_tile);
+      if (is_mapped() && is_allocated(t))
+      {
+        size_t tile_bytes = storage_->tile_cells * sizeof(float);
+        storage_->file->release(t * tile_bytes, tile_bytes);
+      }
+    }
+  }, 1);
+}
+
+vec1f TiledRaster::to_vec1f() const
+{
+  vec1f values(width_ * height_);
+  for (size_t row = 0; row < height_; ++row)
+    for (size_t col = 0; col < width_; ++col)
+      values[row * width_ + col] = get(col, row);
+  return values;
+}
+
+bool RasterTile::is_allocated() const
+{
+  return raster->is_allocated(index);
+}
+float RasterTile::get(size_t c, size_t r) const
+{
+  return raster->get(col + c, row + r);
+}
+void RasterTile::set(size_t c, size_t r, float value)
+{
+  raster->set(col + c, row + r, value);
+}
+
+RasterWindow::RasterWindow(TiledRaster& raster, size_t col, size_t row, size_t width, size_t height)
+  : raster_(&raster), col_(col), row_(row), width_(width), height_(height)
+{
+  if (col + width > raster.width() || row + height > raster.height())
+    throw std::out_of_range("raster window exceeds the raster");
+}
+float RasterWindow::get(size_t c, size_t r) const
+{
+  return raster_->get(col_ + c, row_ + r);
+}
+void RasterWindow::set(size_t c, size_t r, float value)
+{
+  raster_->set(col_ + c, row_ + r, value);
+}
+vec1f RasterWindow::to_vec1f() const
+{
+  vec1f values(width_ * height_);
+  for (size_t r = 0; r < height_; ++r)
+    for (size_t c = 0; c < width_; ++c)
+      values[r * width_ + c] = get(c, r);
+  return values;
+}
+
+} // namespace geoflow
@@ -0,0 +1,131 @@
+// This file is part of Geoflow
+// Copyright (C) 2018-2019  Ravi Peters, 3D geoinformation TU Delft
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "common.hpp"
+
+namespace geoflow
+{
+
+class TiledRaster;
+
+// RasterTile is one tile of a TiledRaster as handed out by for_each_tile. Cell
+// coordinates are local to the tile.
+struct RasterTile
+{
+  TiledRaster* raster;
+  size_t index;
+  size_t col, row;       // first raster cell covered by the tile
+  size_t width, height;  // smaller than the tile size for tiles on the right and top edges
+
+  bool is_allocated() const;
+  float get(size_t c, size_t r) const;
+  void set(size_t c, size_t r, float value);
+};
+
+// RasterWindow is a rectangular part of a TiledRaster that is accessed through
+// the raster, without copying cells. Cell coordinates are local to the window.
+class RasterWindow
+{
+  TiledRaster* raster_;
+  size_t col_, row_, width_, height_;
+
+public:
+  RasterWindow(TiledRaster& raster, size_t col, size_t row, size_t width, size_t height);
+
+  size_t col() const { return col_; };
+  size_t row() const { return row_; };
+  size_t width() const { return width_; };
+  size_t height() const { return height_; };
+  float get(size_t c, size_t r) const;
+  void set(size_t c, size_t r, float value);
+  // copies the cells row by row, starting at the bottom row
+  vec1f to_vec1f() const;
+};
+
+// TiledRaster is a grid of float cells stored in square tiles of tile_size by
+// tile_size cells. Tiles are only allocated when a cell in them is first set, a
+// tile that was never written reads as nodata. Cell (0,0) is the cell with the
+// lowest x and y, columns run along x and rows along y.
+//
+// With memory mapping the tiles are kept in a (temporary or named) file so that
+// the raster can be larger than RAM. The raster storage is shared between
+// copies, like MappedPointCollection, so copies are cheap and see the same
+// cells. Different tiles can be written from different threads at the same time.
+class TiledRaster
+{
+  struct Storage;
+  std::shared_ptr<Storage> storage_;
+  size_t width_ = 0, height_ = 0, tile_size_ = 256;
+  size_t tile_cols_ = 0, tile_rows_ = 0;
+  arr2f origin_ = {0, 0};
+  float cell_size_ = 1;
+  float nodata_ = -9999;
+
+  size_t tile_index(size_t col, size_t row) const { return (row / tile_size_) * tile_cols_ + col / tile_size_; };
+  size_t tile_offset(size_t col, size_t row) const { return (row % tile_size_) * tile_size_ + col % tile_size_; };
+
+public:
+  TiledRaster() {};
+  // origin is the lower left corner of cell (0,0)
+  TiledRaster(size_t width, size_t height, arr2f origin, float cell_size, float nodata = -9999, size_t tile_size = 256);
+  // as above, but stores the tiles in a memory-mapped file; a temporary file if path is empty
+  static TiledRaster mapped(size_t width, size_t height, arr2f origin, float cell_size, float nodata = -9999, size_t tile_size = 256, const std::string& path = "");
+
+  size_t width() const { return width_; };
+  size_t height() const { return height_; };
+  arr2f origin() const { return origin_; };
+  float cell_size() const { return cell_size_; };
+  float nodata() const { return nodata_; };
+  size_t tile_size() const { return tile_size_; };
+  size_t tile_cols() const { return tile_cols_; };
+  size_t tile_rows() const { return tile_rows_; };
+  size_t tile_count() const { return tile_cols_ * tile_rows_; };
+  bool is_mapped() const;
+  Box box() const;
+
+  // nodata is compared by value, or with isnan if nodata is NaN
+  bool is_nodata(float value) const;
+  float get(size_t col, size_t row) const;
+  void set(size_t col, size_t row, float value);
+  // the cell that contains point (x, y), returns false if it is outside the raster
+  bool locate(float x, float y, size_t& col, size_t& row) const;
+  arr2f cell_center(size_t col, size_t row) const;
+
+  RasterTile tile(size_t index);
+  bool is_allocated(size_t tile_index) const;
+  size_t allocated_tile_count() const;
+  // cells of a tile, tile_size cells per row; nullptr if the tile is not allocated
+  const float* tile_data(size_t tile_index) const;
+  // allocates the tile if needed
+  float* tile_data(size_t tile_index);
+
+  // Calls f for every tile, in parallel. If allocated_only is set tiles that were
+  // never written are skipped. For a memory-mapped raster the pages of a tile are
+  // released after f returns, which keeps the resident memory bounded.
+  void for_each_tile(const std::function<void(RasterTile&)>& f, bool allocated_only = false);
+
+  RasterWindow window(size_t col, size_t row, size_t width, size_t height) { return RasterWindow(*this, col, row, width, height); };
+  // all cells, row by row starting at the bottom row
+  vec1f to_vec1f() const;
+};
+
+} // namespace geoflow
@@ -0,0 +1,214 @@
+// This file is part of Geoflow
+// Copyright (C) 2018-2019  Ravi Peters, 3D geoinformation TU Delft
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <iterator>
+
+#include "selection.hpp"
+
+namespace geoflow
+{
+
+namespace
+{
+size_t popcount(const std::vector<uint64_t>& words)
+{
+  size_t count = 0;
+  for (auto w : words)
+    count += std::bitset<64>(w).count();
+  return count;
+}
+void check_universe(const Selection& a, const Selection& b)
+{
+  if (a.universe_size() != b.universe_size())
+    throw std::invalid_argument("selections have different universe sizes");
+}
+} // namespace
+
+Selection::Selection(size_t universe_size, bool all)
+  : universe_size_(universe_size)
+{
+  if (all)
+  {
+    mask_.assign((universe_size + 63) / 64, ~uint64_t(0));
+    if (universe_size % 64)
+      mask_.back() = (uint64_t(1) << (universe_size % 64)) - 1;
+    is_mask_ = true;
+    count_ = universe_size;
+    optimise();
+  }
+}
+Selection::Selection(size_t universe_size, vec1ui indices)
+  : universe_size_(universe_size), indices_(std::move(indices))
+{
+  if (!std::is_sorted(indices_.begin(), indices_.end()))
+    std::sort(indices_.begin(), indices_.end());
+  indices_.erase(std::unique(indices_.begin(), indices_.end()), indices_.end());
+  if (!indices_.empty() && indices_.back() >= universe_size)
+    throw std::out_of_range("selection index exceeds universe size");
+  count_ = indices_.size();
+  optimise();
+}
+Selection::Selection(const vec1b& mask)
+{
+  *this = where(mask.size(), [&mask](size_t i) { return bool(mask[i]); });
+}
+
+Selection Selection::from_mask_words(size_t universe_size, std::vector<uint64_t> words)
+{
+  Selection s;
+  s.universe_size_ = universe_size;
+  s.count_ = popcount(words);
+  s.mask_ = std::move(words);
+  s.is_mask_ = true;
+  s.optimise();
+  return s;
+}
+
+// an index list costs 64 bits per selected element, a mask 1 bit per element
+void Selection::optimise()
+{
+  bool use_mask = count_ > universe_size_ / 64;
+  if (use_mask == is_mask_)
+    return;
+  if (use_mask)
+  {
+    to_mask();
+  }
+  else
+  {
+    indices_ = indices();
+    mask_.clear();
+    mask_.shrink_to_fit();
+    is_mask_ = false;
+  }
+}
+void Selection::to_mask()
+{
+  if (is_mask_)
+    return;
+  mask_.assign((universe_size_ + 63) / 64, 0);
+  for (auto i : indices_)
+    mask_[i / 64] |= uint64_t(1) << (i % 64);
+  indices_.clear();
+  indices_.shrink_to_fit();
+  is_mask_ = true;
+}
+
+bool Selection::contains(size_t i) const
+{
+  if (i >= universe_size_)
+    return false;
+  if (is_mask_)
+    return (mask_[i / 64] >> (i % 64)) & 1;
+  return std::binary_search(indices_.begin(), indices_.end(), i);
+}
+
+vec1ui Selection::indices() const
+{
+  if (!is_mask_)
+    return indices_;
+  vec1ui result;
+  result.reserve(count_);
+  for_each([&result](size_t i) { result.push_back(i); });
+  return result;
+}
+
+Selection Selection::operator&(const Selection& other) const
+{
+  check_universe(*this, other);
+  if (is_mask_ && other.is_mask_)
+  {
+    std::vector<uint64_t> words(mask_.size());
+    for (size_t w = 0; w < words.size(); ++w)
+      words[w] = mask_[w] & other.mask_[w];
+    return from_mask_words(universe_size_, std::move(words));
+  }
+  if (!is_mask_ && !other.is_mask_)
+  {
+    vec1ui indices;
+    std::set_intersection(indices_.begin(), indices_.end(), other.indices_.begin(), other.indices_.end(), std::back_inserter(indices));
+    return Selection(universe_size_, std::move(indices));
+  }
+  // look up the elements of the list in the mask
+  auto& list = is_mask_ ? other : *this;
+  auto& mask = is_mask_ ? *this : other;
+  vec1ui indices;
+  for (auto i : list.indices_)
+    if (mask.contains(i))
+      indices.push_back(i);
+  return Selection(universe_size_, std::move(indices));
+}
+Selection Selection::operator|(const Selection& other) const
+{
+  check_universe(*this, other);
+  if (!is_mask_ && !other.is_mask_)
+  {
+    vec1ui indices;
+    std::set_union(indices_.begin(), indices_.end(), other.indices_.begin(), other.indices_.end(), std::back_inserter(indices));
+    return Selection(universe_size_, std::move(indices));
+  }
+  auto& list = is_mask_ ? other : *this;
+  auto& mask = is_mask_ ? *this : other;
+  auto words = mask.mask_;
+  if (list.is_mask_)
+  {
+    for (size_t w = 0; w < words.size(); ++w)
+      words[w] |= list.mask_[w];
+  }
+  else
+  {
+    for (auto i : list.indices_)
+      words[i / 64] |= uint64_t(1) << (i % 64);
+  }
+  return from_mask_words(universe_size_, std::move(words));
+}
+Selection Selection::operator-(const Selection& other) const
+{
+  check_universe(*this, other);
+  if (!is_mask_)
+  {
+    vec1ui indices;
+    for (auto i : indices_)
+      if (!other.contains(i))
+        indices.push_back(i);
+    return Selection(universe_size_, std::move(indices));
+  }
+  return *this & ~other;
+}
+Selection Selection::operator~() const
+{
+  Selection all(universe_size_, true);
+  all.to_mask();
+  auto words = std::move(all.mask_);
+  if (is_mask_)
+  {
+    for (size_t w = 0; w < words.size(); ++w)
+      words[w] &= ~mask_[w];
+  }
+  else
+  {
+    for (auto i : indices_)
+      words[i / 64] &= ~(uint64_t(1) << (i % 64));
+  }
+  return from_mask_words(universe_size_, std::move(words));
+}
+bool Selection::operator==(const Selection& other) const
+{
+  return universe_size_ == other.universe_size_ && count_ == other.count_ && indices() == other.indices();
+}
+
+} // namespace geoflow
@@ -0,0 +1,173 @@
+// This file is part of Geoflow
+// Copyright (C) 2018-2019  Ravi Peters, 3D geoinformation TU Delft
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <bitset>
+#include <cstdint>
+#include <stdexcept>
+
+#include "common.hpp"
+#include "parallel.hpp"
+
+namespace geoflow
+{
+
+// Selection is a subset of the elements of a collection with universe_size
+// elements, identified by index. Filter nodes can output a Selection instead of
+// a filtered copy of their input, the elements are only copied when a consumer
+// needs contiguous data (see materialize). Depending on how many elements are
+// selected the subset is stored as a sorted index list or as a bitmask,
+// whichever is smaller.
+class Selection
+{
+  size_t universe_size_ = 0;
+  size_t count_ = 0;
+  bool is_mask_ = false;
+  vec1ui indices_;
+  std::vector<uint64_t> mask_;
+
+  static size_t lowest_bit(uint64_t bits) { return std::bitset<64>((bits & (~bits + 1)) - 1).count(); };
+  // picks the smallest representation for the current count
+  void optimise();
+  void to_mask();
+  static Selection from_mask_words(size_t universe_size, std::vector<uint64_t> words);
+
+public:
+  Selection() {};
+  // selects nothing, or everything if all is true
+  explicit Selection(size_t universe_size, bool all = false);
+  // indices do not have to be sorted or unique
+  Selection(size_t universe_size, vec1ui indices);
+  explicit Selection(const vec1b& mask);
+
+  // selection of the elements i in [0, universe_size) for which pred(i) is true
+  template<typename Predicate> static Selection where(size_t universe_size, Predicate pred)
+  {
+    std::vector<uint64_t> words((universe_size + 63) / 64);
+    parallel_for(0, words.size(), [&](size_t first, size_t last) {
+      for (size_t w = first; w < last; ++w)
+      {
+        uint64_t word = 0;
+        for (size_t i = w * 64, end = std::min(universe_size, i + 64); i < end; ++i)
+          if (pred(i))
+            word |= uint64_t(1) << (i % 64);
+        words[w] = word;
+      }
+    }, 64);
+    return from_mask_words(universe_size, std::move(words));
+  }
+  // the selected elements for which pred(i) is true
+  template<typename Predicate> Selection filter(Predicate pred) const
+  {
+    if (!is_mask_)
+    {
+      vec1ui indices;
+      for (auto i : indices_)
+        if (pred(i))
+          indices.push_back(i);
+      return Selection(universe_size_, std::move(indices));
+    }
+    std::vector<uint64_t> words(mask_.size());
+    parallel_for(0, words.size(), [&](size_t first, size_t last) {
+      for (size_t w = first; w < last; ++w)
+      {
+        uint64_t word = mask_[w];
+        for (uint64_t bits = word; bits; bits &= bits - 1)
+        {
+          auto b = lowest_bit(bits);
+          if (!pred(w * 64 + b))
+            word &= ~(uint64_t(1) << b);
+        }
+        words[w] = word;
+      }
+    }, 64);
+    return from_mask_words(universe_size_, std::move(words));
+  }
+
+  size_t universe_size() const { return universe_size_; };
+  // number of selected elements
+  size_t size() const { return count_; };
+  bool empty() const { return count_ == 0; };
+  bool is_mask() const { return is_mask_; };
+  bool contains(size_t i) const;
+
+  // calls f(i) for every selected index i in increasing order
+  template<typename F> void for_each(F f) const
+  {
+    if (!is_mask_)
+    {
+      for (auto i : indices_)
+        f(i);
+      return;
+    }
+    for (size_t w = 0; w < mask_.size(); ++w)
+      for (uint64_t bits = mask_[w]; bits; bits &= bits - 1)
+        f(w * 64 + lowest_bit(bits));
+  }
+  // the selected indices in increasing order
+  vec1ui indices() const;
+
+  // set operations, both operands must have the same universe_size
+  Selection operator&(const Selection& other) const;
+  Selection operator|(const Selection& other) const;
+  Selection operator-(const Selection& other) const;
+  Selection operator~() const;
+  Selection& operator&=(const Selection& other) { return *this = *this & other; };
+  Selection& operator|=(const Selection& other) { return *this = *this | other; };
+  bool operator==(const Selection& other) const;
+};
+
+// copies the selected elements of collection into a new collection
+template<typename Collection> Collection materialize(const Collection& collection, const Selection& selection)
+{
+  if (selection.universe_size() != collection.size())
+    throw std::invalid_argument("selection does not match the size of the collection");
+  Collection result;
+  result.reserve(selection.size());
+  selection.for_each([&](size_t i) { result.push_back(collection[i]); });
+  return result;
+}
+
+// SelectionView presents the selected elements of a collection without copying
+// them. It refers to the collection, so the collection must outlive the view.
+template<typename Collection> class SelectionView
+{
+  const Collection* parent_;
+  Selection selection_;
+
+public:
+  SelectionView(const Collection& parent, Selection selection)
+    : parent_(&parent), selection_(std::move(selection))
+  {
+    if (selection_.universe_size() != parent.size())
+      throw std::invalid_argument("selection does not match the size of the collection");
+  };
+
+  const Collection& parent() const { return *parent_; };
+  const Selection& selection() const { return selection_; };
+  size_t size() const { return selection_.size(); };
+  bool empty() const { return selection_.empty(); };
+
+  // calls f(element) for every selected element in collection order
+  template<typename F> void for_each(F f) const
+  {
+    selection_.for_each([&](size_t i) { f((*parent_)[i]); });
+  }
+  Collection materialize() const { return geoflow::materialize(*parent_, selection_); };
+};
+
+} // namespace geoflow
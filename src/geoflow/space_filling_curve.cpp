@@ -0,0 +1,199 @@
+// This file is part of Geoflow
+// Copyright (C) 2018-2019  Ravi Peters, 3D geoinformation TU Delft
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+#include "space_filling_curve.hpp"
+#include "parallel.hpp"
+
+namespace geoflow
+{
+
+namespace
+{
+const int curve_bits = 21;
+
+// spreads the lower 21 bits of v so that there are two zero bits between each bit
+inline uint64_t spread_bits(uint32_t v)
+{
+  uint64_t x = v & 0x1fffff;
+  x = (x | x << 32) & 0x1f00000000ffff;
+  x = (x | x << 16) & 0x1f0000ff0000ff;
+  x = (x | x << 8) & 0x100f00f00f00f00f;
+  x = (x | x << 4) & 0x10c30c30c30c30c3;
+  x = (x | x << 2) & 0x1249249249249249;
+  return x;
+}
+} // namespace
+
+uint64_t morton_key(uint32_t x, uint32_t y, uint32_t z)
+{
+  return spread_bits(x) << 2 | spread_bits(y) << 1 | spread_bits(z);
+}
+
+// Uses Skilling's transform (Programming the Hilbert curve, 2004) to convert the
+// coordinates to the transposed Hilbert index, whose interleaved bits are the key.
+uint64_t hilbert_key(uint32_t x, uint32_t y, uint32_t z)
+{
+  std::array<uint32_t, 3> X = {x, y, z};
+  const uint32_t M = 1u << (curve_bits - 1);
+  // inverse undo
+  for (uint32_t Q = M; Q > 1; Q >>= 1)
+  {
+    uint32_t P = Q - 1;
+    for (size_t i = 0; i < 3; ++i)
+    {
+      if (X[i] & Q)
+        X[0] ^= P;
+      else
+      {
+        uint32_t t = (X[0] ^ X[i]) & P;
+        X[0] ^= t;
+        X[i] ^= t;
+      }
+    }
+  }
+  // Gray encode
+  X[1] ^= X[0];
+  X[2] ^= X[1];
+  uint32_t t = 0;
+  for (uint32_t Q = M; Q > 1; Q >>= 1)
+    if (X[2] & Q)
+      t ^= Q - 1;
+  for (auto& v : X)
+    v ^= t;
+  return morton_key(X[0], X[1], X[2]);
+}
+
+// Each pass sorts on 8 bits of the key. The keys are split in a fixed number of
+// chunks; every chunk counts its digits, the counts are turned into scatter
+// positions for each (digit, chunk) pair and then the chunks scatter their keys
+// independently. Passes where all keys have the same digit are skipped.
+void radix_sort(std::vector<uint64_t>& keys, vec1ui& values)
+{
+  size_t n = keys.size();
+  if (n < 2)
+    return;
+  size_t chunk_count = std::clamp<size_t>(n / (size_t(1) << 16), 1, std::max<size_t>(thread_count(), 1));
+  size_t chunk_size = (n + chunk_count - 1) / chunk_count;
+  std::vector<std::array<size_t, 256>> counts(chunk_count);
+  std::vector<uint64_t> keys_tmp(n);
+  vec1ui values_tmp(n);
+
+  for (int shift = 0; shift < 64; shift += 8)
+  {
+    parallel_for(0, chunk_count, [&](size_t first_chunk, size_t last_chunk) {
+      for (size_t c = first_chunk; c < last_chunk; ++c)
+      {
+        auto& count = counts[c];
+        count.fill(0);
+        for (size_t i = c * chunk_size, end = std::min(n, (c + 1) * chunk_size); i < end; ++i)
+          ++count[(keys[i] >> shift) & 0xff];
+      }
+    }, 1);
+
+    size_t offset = 0;
+    bool single_digit = false;
+    for (size_t d = 0; d < 256; ++d)
+    {
+      size_t digit_begin = offset;
+      for (auto& count : counts)
+      {
+        auto c = count[d];
+        count[d] = offset;
+        offset += c;
+      }
+      single_digit |= (offset - digit_begin) == n;
+    }
+    if (single_digit)
+      continue;
+
+    parallel_for(0, chunk_count, [&](size_t first_chunk, size_t last_chunk) {
+      for (size_t c = first_chunk; c < last_chunk; ++c)
+      {
+        auto& position = counts[c];
+        for (size_t i = c * chunk_size, end = std::min(n, (c + 1) * chunk_size); i < end; ++i)
+        {
+          auto p = position[(keys[i] >> shift) & 0xff]++;
+          keys_tmp[p] = keys[i];
+          values_tmp[p] = values[i];
+        }
+      }
+    }, 1);
+    keys.swap(keys_tmp);
+    values.swap(values_tmp);
+  }
+}
+
+vec1ui curve_order(const PointCollection& points, SpaceFillingCurve curve)
+{
+  size_t n = points.size();
+  vec1ui order(n);
+  std::iota(order.begin(), order.end(), 0);
+  if (n < 2)
+    return order;
+
+  // the extent of the finite coordinates; non-finite ones are put in the last
+  // cell below, casting them to an integer would be undefined
+  arr3f pmin, pmax;
+  pmin.fill(std::numeric_limits<float>::infinity());
+  pmax.fill(-std::numeric_limits<float>::infinity());
+  for (auto& p : points)
+  {
+    for (size_t a = 0; a < 3; ++a)
+    {
+      if (!std::isfinite(p[a])) continue;
+      pmin[a] = std::min(pmin[a], p[a]);
+      pmax[a] = std::max(pmax[a], p[a]);
+    }
+  }
+  // same scale on every axis, so that the curve cells are cubes
+  double extent = std::max({double(pmax[0]) - pmin[0], double(pmax[1]) - pmin[1], double(pmax[2]) - pmin[2]});
+  const double max_cell = double((1u << curve_bits) - 1);
+  double scale = extent > 0 ? max_cell / extent : 0;
+
+  std::vector<uint64_t> keys(n);
+  parallel_for(0, n, [&](size_t first, size_t last) {
+    for (size_t i = first; i < last; ++i)
+    {
+      auto& p = points[i];
+      uint32_t q[3];
+      for (size_t a = 0; a < 3; ++a)
+      {
+        double cell = (double(p[a]) - pmin[a]) * scale;
+        q[a] = std::isfinite(cell) ? uint32_t(std::clamp(cell, 0.0, max_cell)) : uint32_t(max_cell);
+      }
+      keys[i] = curve == GF_CURVE_HILBERT ? hilbert_key(q[0], q[1], q[2]) : morton_key(q[0], q[1], q[2]);
+    }
+  });
+  radix_sort(keys, order);
+  return order;
+}
+
+PointCollection permute(const PointCollection& points, const vec1ui& permutation)
+{
+  PointCollection result;
+  result.reserve(permutation.size());
+  for (auto i : permutation)
+    result.push_back(points[i]);
+  return result;
+}
+
+} // namespace geoflow
@@ -0,0 +1,54 @@
+// This file is part of Geoflow
+// Copyright (C) 2018-2019  Ravi Peters, 3D geoinformation TU Delft
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstdint>
+
+#include "common.hpp"
+
+namespace geoflow
+{
+
+enum SpaceFillingCurve {GF_CURVE_MORTON, GF_CURVE_HILBERT};
+
+// Keys of a point with integer coordinates of at most 21 bits each on a 3D
+// Morton (Z-order) or Hilbert curve. Sorting on these keys puts points that are
+// close in space close together in memory.
+uint64_t morton_key(uint32_t x, uint32_t y, uint32_t z);
+uint64_t hilbert_key(uint32_t x, uint32_t y, uint32_t z);
+
+// Sorts keys in ascending order and applies the same reordering to values, using
+// a parallel least significant digit radix sort. The sort is stable.
+void radix_sort(std::vector<uint64_t>& keys, vec1ui& values);
+
+// Order of the points along the curve: element i of the result is the index of
+// the point that goes to position i. Coordinates are quantized on a uniform grid
+// over the bounding box of the points.
+vec1ui curve_order(const PointCollection& points, SpaceFillingCurve curve = GF_CURVE_HILBERT);
+
+// reorders values with a permutation as returned by curve_order
+template<typename T> std::vector<T> permute(const std::vector<T>& values, const vec1ui& permutation)
+{
+  std::vector<T> result;
+  result.reserve(permutation.size());
+  for (auto i : permutation)
+    result.push_back(values[i]);
+  return result;
+}
+PointCollection permute(const PointCollection& points, const vec1ui& permutation);
+
+} // namespace geoflow
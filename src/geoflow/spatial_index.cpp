@@ -0,0 +1,278 @@
+// This file is part of Geoflow
+// Copyright (C) 2018-2019  Ravi Peters, 3D geoinformation TU Delft
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <queue>
+
+#include "spatial_index.hpp"
+
+namespace geoflow
+{
+
+// The tree is stored level by level in flat arrays, leaves first. Entry i has
+// box boxes[i]; for a leaf entry index[i] is the item index, for other entries
+// it is the position of the first child entry. The children of a node are the
+// (at most node_size) consecutive entries starting there.
+struct PackedRTree::Tree
+{
+  typedef std::array<float, 4> Rect; // xmin, ymin, xmax, ymax
+  std::vector<Rect> boxes;
+  std::vector<size_t> index;
+  std::vector<size_t> level_bounds; // end position of each level
+  size_t node_size;
+  size_t item_count;
+
+  bool is_leaf(size_t pos) const { return pos < item_count; };
+  size_t children_end(size_t pos) const
+  {
+    auto first = index[pos];
+    auto level_end = *std::upper_bound(level_bounds.begin(), level_bounds.end(), first);
+    return std::min(first + node_size, level_end);
+  };
+};
+
+namespace
+{
+typedef std::array<float, 4> Rect;
+
+inline bool intersects(const Rect& a, const Rect& b)
+{
+  return a[0] <= b[2] && a[2] >= b[0] && a[1] <= b[3] && a[3] >= b[1];
+}
+inline float sq_distance(const Rect& r, float x, float y)
+{
+  float dx = std::max(std::max(r[0] - x, 0.f), x - r[2]);
+  float dy = std::max(std::max(r[1] - y, 0.f), y - r[3]);
+  return dx * dx + dy * dy;
+}
+inline Rect to_rect(const Box& box)
+{
+  auto pmin = box.min();
+  auto pmax = box.max();
+  return {pmin[0], pmin[1], pmax[0], pmax[1]};
+}
+} // namespace
+
+PackedRTree::PackedRTree(const std::vector<Box>& boxes, size_t node_size)
+{
+  auto tree = std::make_shared<Tree>();
+  tree->node_size = std::max<size_t>(node_size, 2);
+  // items without geometry have no place in the tree
+  std::vector<size_t> order;
+  order.reserve(boxes.size());
+  for (size_t i = 0; i < boxes.size(); ++i)
+  {
+    if (!boxes[i].isEmpty())
+      order.push_back(i);
+  }
+  tree->item_count = order.size();
+  if (order.empty())
+  {
+    tree_ = tree;
+    return;
+  }
+
+  // Sort-Tile-Recursive: sort on x into vertical slices, then each slice on y
+  std::vector<Rect> rects(boxes.size());
+  std::transform(boxes.begin(), boxes.end(), rects.begin(), to_rect);
+  auto cx = [&rects](size_t i) { return rects[i][0] + rects[i][2]; };
+  auto cy = [&rects](size_t i) { return rects[i][1] + rects[i][3]; };
+
+  size_t n = order.size();
+  size_t leaf_count = (n + tree->node_size - 1) / tree->node_size;
+  size_t slice_count = size_t(std::ceil(std::sqrt(double(leaf_count))));
+  size_t slice_size = slice_count * tree->node_size;
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return cx(a) < cx(b); });
+  for (size_t first = 0; first < n; first += slice_size)
+  {
+    auto last = std::min(first + slice_size, n);
+    std::sort(order.begin() + first, order.begin() + last, [&](size_t a, size_t b) { return cy(a) < cy(b); });
+  }
+
+  for (auto i : order)
+  {
+    tree->boxes.push_back(rects[i]);
+    tree->index.push_back(i);
+  }
+  tree->level_bounds.push_back(n);
+
+  // build the upper levels by grouping consecutive entries
+  size_t level_begin = 0, level_end = n;
+  while (level_end - level_begin > 1)
+  {
+    for (size_t first = level_begin; first < level_end; first += tree->node_size)
+    {
+      auto last = std::min(first + tree->node_size, level_end);
+      Rect r = tree->boxes[first];
+      for (size_t i = first + 1; i < last; ++i)
+      {
+        auto& b = tree->boxes[i];
+        r = {std::min(r[0], b[0]), std::min(r[1], b[1]), std::max(r[2], b[2]), std::max(r[3], b[3])};
+      }
+      tree->boxes.push_back(r);
+      tree->index.push_back(first);
+    }
+    level_begin = level_end;
+    level_end = tree->boxes.size();
+    tree->level_bounds.push_back(level_end);
+  }
+  tree_ = tree;
+}
+
+size_t PackedRTree::size() const
+{
+  return tree_ ? tree_->item_count : 0;
+}
+size_t PackedRTree::memory_size() const
+{
+  if (!tree_)
+    return 0;
+  return tree_->boxes.capacity() * sizeof(Tree::Rect) + tree_->index.capacity() * sizeof(size_t)
+    + tree_->level_bounds.capacity() * sizeof(size_t);
+}
+bool PackedRTree::empty() const
+{
+  return size() == 0;
+}
+Box PackedRTree::bounds() const
+{
+  Box box;
+  if (!empty())
+  {
+    auto& r = tree_->boxes.back();
+    box.set({r[0], r[1], 0}, {r[2], r[3], 0});
+  }
+  return box;
+}
+
+void PackedRTree::query(const Box& window, const std::function<bool(size_t)>& visitor) const
+{
+  if (empty() || window.isEmpty())
+    return;
+  auto& t = *tree_;
+  auto w = to_rect(window);
+  std::vector<size_t> stack = {t.boxes.size() - 1};
+  while (!stack.empty())
+  {
+    auto pos = stack.back();
+    stack.pop_back();
+    if (!intersects(t.boxes[pos], w))
+      continue;
+    if (t.is_leaf(pos))
+    {
+      if (!visitor(t.index[pos]))
+        return;
+    }
+    else
+    {
+      for (size_t c = t.index[pos], end = t.children_end(pos); c < end; ++c)
+        stack.push_back(c);
+    }
+  }
+}
+std::vector<size_t> PackedRTree::query(const Box& window) const
+{
+  std::vector<size_t> result;
+  query(window, [&result](size_t i) {
+    result.push_back(i);
+    return true;
+  });
+  return result;
+}
+
+std::vector<size_t> PackedRTree::nearest(const arr3f& point, size_t k, float max_distance) const
+{
+  std::vector<size_t> result;
+  if (empty() || k == 0)
+    return result;
+  auto& t = *tree_;
+  float max_sq_distance = max_distance * max_distance;
+
+  // best first search, ordered on the distance to the entry boxes
+  typedef std::pair<float, size_t> Candidate;
+  std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> queue;
+  queue.push({sq_distance(t.boxes.back(), point[0], point[1]), t.boxes.size() - 1});
+  while (!queue.empty() && result.size() < k)
+  {
+    auto [d, pos] = queue.top();
+    queue.pop();
+    if (d > max_sq_distance)
+      break;
+    if (t.is_leaf(pos))
+    {
+      result.push_back(t.index[pos]);
+    }
+    else
+    {
+      for (size_t c = t.index[pos], end = t.children_end(pos); c < end; ++c)
+        queue.push({sq_distance(t.boxes[c], point[0], point[1]), c});
+    }
+  }
+  return result;
+}
+
+std::vector<Box> element_boxes(const PointCollection& points)
+{
+  std::vector<Box> boxes(points.size());
+  for (size_t i = 0; i < points.size(); ++i)
+    boxes[i].set(points[i], points[i]);
+  return boxes;
+}
+std::vector<Box> element_boxes(const TriangleCollection& triangles)
+{
+  std::vector<Box> boxes(triangles.size());
+  for (size_t i = 0; i < triangles.size(); ++i)
+  {
+    for (auto& p : triangles[i])
+      boxes[i].add(p);
+  }
+  return boxes;
+}
+std::vector<Box> element_boxes(const SegmentCollection& segments)
+{
+  std::vector<Box> boxes(segments.size());
+  for (size_t i = 0; i < segments.size(); ++i)
+  {
+    boxes[i].add(segments[i][0]);
+    boxes[i].add(segments[i][1]);
+  }
+  return boxes;
+}
+std::vector<Box> element_boxes(const VertexRangeCollection& ranges)
+{
+  std::vector<Box> boxes(ranges.size());
+  for (size_t i = 0; i < ranges.size(); ++i)
+  {
+    for (auto& p : ranges[i])
+      boxes[i].add(p);
+  }
+  return boxes;
+}
+std::vector<Box> element_boxes(const IndexedMesh& mesh)
+{
+  std::vector<Box> boxes(mesh.face_count());
+  auto& vertices = mesh.vertices();
+  for (size_t f = 0; f < mesh.face_count(); ++f)
+  {
+    for (auto& i : mesh.face_ring(f))
+      boxes[f].add(vertices[i]);
+  }
+  return boxes;
+}
+
+} // namespace geoflow
@@ -0,0 +1,65 @@
+// This file is part of Geoflow
+// Copyright (C) 2018-2019  Ravi Peters, 3D geoinformation TU Delft
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <functional>
+#include <limits>
+#include <memory>
+
+#include "common.hpp"
+
+namespace geoflow
+{
+
+// PackedRTree is a static R-tree over the 2D (xy) bounding boxes of a set of
+// items, bulk loaded with the Sort-Tile-Recursive algorithm. The tree can not be
+// modified after it is built, so it is safe to query from multiple threads. The
+// tree data is shared between copies, which makes it cheap to pass a PackedRTree
+// through output terminals to several nodes. Items with an empty box are left
+// out, they are never returned and size() does not count them.
+class PackedRTree
+{
+  struct Tree;
+  std::shared_ptr<const Tree> tree_;
+
+public:
+  PackedRTree() {};
+  PackedRTree(const std::vector<Box>& boxes, size_t node_size = 16);
+
+  size_t size() const;
+  bool empty() const;
+  Box bounds() const;
+  // bytes used by the tree data, which is shared by all copies
+  size_t memory_size() const;
+
+  // indices of the items whose box intersects (or touches) the window
+  std::vector<size_t> query(const Box& window) const;
+  // calls visitor for each intersecting item until the visitor returns false
+  void query(const Box& window, const std::function<bool(size_t)>& visitor) const;
+  // indices of the k items nearest to point (in xy, measured to the item boxes),
+  // sorted by increasing distance
+  std::vector<size_t> nearest(const arr3f& point, size_t k = 1, float max_distance = std::numeric_limits<float>::infinity()) const;
+};
+
+// bounding box of every element of a collection, in the order of the elements
+std::vector<Box> element_boxes(const PointCollection& points);
+std::vector<Box> element_boxes(const TriangleCollection& triangles);
+std::vector<Box> element_boxes(const SegmentCollection& segments);
+std::vector<Box> element_boxes(const VertexRangeCollection& ranges);
+std::vector<Box> element_boxes(const IndexedMesh& mesh);
+
+} // namespace geoflow
@@ -0,0 +1,630 @@
+// This file is part of Geoflow
+// Copyright (C) 2018-2019  Ravi Peters, 3D geoinformation TU Delft
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "triangulate.hpp"
+#include "parallel.hpp"
+
+namespace geoflow
+{
+
+// The ear clipping follows mapbox/earcut (ISC license): holes are joined to the
+// exterior ring through a bridge to their leftmost vertex, and when no more ears
+// are found the list is filtered, then local self-intersections are cured and
+// finally the polygon is split in two along a valid diagonal.
+
+namespace
+{
+const uint32_t none = std::numeric_limits<uint32_t>::max();
+
+inline bool point_in_triangle(float ax, float ay, float bx, float by, float cx, float cy, float px, float py)
+{
+  return (cx - px) * (ay - py) >= (ax - px) * (cy - py) &&
+         (ax - px) * (by - py) >= (bx - px) * (ay - py) &&
+         (bx - px) * (cy - py) >= (cx - px) * (by - py);
+}
+inline int sign(float v)
+{
+  return (v > 0) - (v < 0);
+}
+} // namespace
+
+float Triangulator::area(uint32_t p, uint32_t q, uint32_t r) const
+{
+  auto &P = vertices_[p], &Q = vertices_[q], &R = vertices_[r];
+  return (Q.y - P.y) * (R.x - Q.x) - (Q.x - P.x) * (R.y - Q.y);
+}
+bool Triangulator::equals(uint32_t a, uint32_t b) const
+{
+  return vertices_[a].x == vertices_[b].x && vertices_[a].y == vertices_[b].y;
+}
+void Triangulator::add_triangle(uint32_t a, uint32_t b, uint32_t c)
+{
+  triangles_->push_back(vertices_[a].i);
+  triangles_->push_back(vertices_[b].i);
+  triangles_->push_back(vertices_[c].i);
+}
+
+uint32_t Triangulator::insert_vertex(uint32_t i, float x, float y, uint32_t last)
+{
+  uint32_t p = uint32_t(vertices_.size());
+  vertices_.push_back({i, x, y, p, p, false});
+  if (last != none)
+  {
+    auto& v = vertices_[p];
+    v.next = vertices_[last].next;
+    v.prev = last;
+    vertices_[vertices_[last].next].prev = p;
+    vertices_[last].next = p;
+  }
+  return p;
+}
+void Triangulator::remove_vertex(uint32_t p)
+{
+  auto& v = vertices_[p];
+  vertices_[v.next].prev = v.prev;
+  vertices_[v.prev].next = v.next;
+}
+
+// links a and b with a diagonal, splitting the list in two; returns the copy of b
+uint32_t Triangulator::split_polygon(uint32_t a, uint32_t b)
+{
+  uint32_t a2 = uint32_t(vertices_.size());
+  vertices_.push_back({vertices_[a].i, vertices_[a].x, vertices_[a].y, none, none, false});
+  uint32_t b2 = uint32_t(vertices_.size());
+  vertices_.push_back({vertices_[b].i, vertices_[b].x, vertices_[b].y, none, none, false});
+  uint32_t an = vertices_[a].next, bp = vertices_[b].prev;
+  vertices_[a].next = b;
+  vertices_[b].prev = a;
+  vertices_[a2].next = an;
+  vertices_[an].prev = a2;
+  vertices_[b2].next = a2;
+  vertices_[a2].prev = b2;
+  vertices_[bp].next = b2;
+  vertices_[b2].prev = bp;
+  return b2;
+}
+
+uint32_t Triangulator::linked_list(const std::vector<arr2f>& points, uint32_t begin, uint32_t end, bool clockwise)
+{
+  float sum = 0;
+  for (uint32_t i = begin, j = end - 1; i < end; j = i++)
+    sum += (points[j][0] - points[i][0]) * (points[i][1] + points[j][1]);
+  uint32_t last = none;
+  if (clockwise == (sum > 0))
+  {
+    for (uint32_t i = begin; i < end; ++i)
+      last = insert_vertex(i, points[i][0], points[i][1], last);
+  }
+  else
+  {
+    for (uint32_t i = end; i-- > begin;)
+      last = insert_vertex(i, points[i][0], points[i][1], last);
+  }
+  if (last != none && equals(last, vertices_[last].next))
+  {
+    auto next = vertices_[last].next;
+    remove_vertex(last);
+    last = next;
+  }
+  return last;
+}
+
+// removes duplicate and collinear vertices
+uint32_t Triangulator::filter_points(uint32_t start, uint32_t end)
+{
+  if (start == none)
+    return start;
+  uint32_t p = start;
+  bool again;
+  do
+  {
+    again = false;
+    if (!vertices_[p].steiner && (equals(p, vertices_[p].next) || area(vertices_[p].prev, p, vertices_[p].next) == 0))
+    {
+      remove_vertex(p);
+      p = end = vertices_[p].prev;
+      if (p == vertices_[p].next)
+        break;
+      again = true;
+    }
+    else
+    {
+      p = vertices_[p].next;
+    }
+  } while (again || p != end);
+  return end;
+}
+
+void Triangulator::earcut_linked(uint32_t ear, int pass)
+{
+  if (ear == none)
+    return;
+  uint32_t stop = ear;
+  while (vertices_[ear].prev != vertices_[ear].next)
+  {
+    uint32_t prev = vertices_[ear].prev, next = vertices_[ear].next;
+    if (is_ear(ear))
+    {
+      add_triangle(prev, ear, next);
+      remove_vertex(ear);
+      ear = stop = vertices_[next].next;
+      continue;
+    }
+    ear = next;
+    if (ear == stop)
+    {
+      if (pass == 0)
+      {
+        earcut_linked(filter_points(ear), 1);
+      }
+      else if (pass == 1)
+      {
+        ear = cure_local_intersections(filter_points(ear));
+        earcut_linked(ear, 2);
+      }
+      else
+      {
+        split_earcut(ear);
+      }
+      break;
+    }
+  }
+}
+
+bool Triangulator::is_ear(uint32_t ear) const
+{
+  uint32_t a = vertices_[ear].prev, b = ear, c = vertices_[ear].next;
+  if (area(a, b, c) >= 0)
+    return false; // reflex
+  auto &A = vertices_[a], &B = vertices_[b], &C = vertices_[c];
+  float x0 = std::min({A.x, B.x, C.x}), y0 = std::min({A.y, B.y, C.y});
+  float x1 = std::max({A.x, B.x, C.x}), y1 = std::max({A.y, B.y, C.y});
+  for (uint32_t p = C.next; p != a; p = vertices_[p].next)
+  {
+    auto& P = vertices_[p];
+    if (P.x >= x0 && P.x <= x1 && P.y >= y0 && P.y <= y1 &&
+        point_in_triangle(A.x, A.y, B.x, B.y, C.x, C.y, P.x, P.y) &&
+        area(P.prev, p, P.next) >= 0)
+      return false;
+  }
+  return true;
+}
+
+uint32_t Triangulator::cure_local_intersections(uint32_t start)
+{
+  uint32_t p = start;
+  do
+  {
+    uint32_t a = vertices_[p].prev, b = vertices_[vertices_[p].next].next;
+    auto segments_intersect = [this](uint32_t p1, uint32_t q1, uint32_t p2, uint32_t q2) {
+      int o1 = sign(area(p1, q1, p2)), o2 = sign(area(p1, q1, q2));
+      int o3 = sign(area(p2, q2, p1)), o4 = sign(area(p2, q2, q1));
+      return o1 != o2 && o3 != o4;
+    };
+    if (!equals(a, b) && segments_intersect(a, p, vertices_[p].next, b) && locally_inside(a, b) && locally_inside(b, a))
+    {
+      add_triangle(a, p, b);
+      remove_vertex(vertices_[p].next);
+      remove_vertex(p);
+      p = start = b;
+    }
+    p = vertices_[p].next;
+  } while (p != start);
+  return filter_points(p);
+}
+
+void Triangulator::split_earcut(uint32_t start)
+{
+  uint32_t a = start;
+  do
+  {
+    uint32_t b = vertices_[vertices_[a].next].next;
+    while (b != vertices_[a].prev)
+    {
+      if (vertices_[a].i != vertices_[b].i && is_valid_diagonal(a, b))
+      {
+        uint32_t c = split_polygon(a, b);
+        a = filter_points(a, vertices_[a].next);
+        c = filter_points(c, vertices_[c].next);
+        earcut_linked(a, 0);
+        earcut_linked(c, 0);
+        return;
+      }
+      b = vertices_[b].next;
+    }
+    a = vertices_[a].next;
+  } while (a != start);
+}
+
+uint32_t Triangulator::leftmost(uint32_t start) const
+{
+  uint32_t p = start, left = start;
+  do
+  {
+    if (vertices_[p].x < vertices_[left].x || (vertices_[p].x == vertices_[left].x && vertices_[p].y < vertices_[left].y))
+      left = p;
+    p = vertices_[p].next;
+  } while (p != start);
+  return left;
+}
+
+uint32_t Triangulator::eliminate_hole(uint32_t hole, uint32_t outer)
+{
+  uint32_t bridge = find_hole_bridge(hole, outer);
+  if (bridge == none)
+    return outer;
+  uint32_t bridge_reverse = split_polygon(bridge, hole);
+  filter_points(bridge_reverse, vertices_[bridge_reverse].next);
+  return filter_points(bridge, vertices_[bridge].next);
+}
+
+// finds a vertex of the outer ring that the leftmost vertex of the hole can be
+// connected to without crossing any edge
+uint32_t Triangulator::find_hole_bridge(uint32_t hole, uint32_t outer) const
+{
+  uint32_t p = outer, m = none;
+  float hx = vertices_[hole].x, hy = vertices_[hole].y;
+  float qx = -std::numeric_limits<float>::infinity();
+  // the segment left of the hole vertex on a horizontal ray, closest to it
+  do
+  {
+    auto &P = vertices_[p], &N = vertices_[P.next];
+    if (hy <= P.y && hy >= N.y && N.y != P.y)
+    {
+      float x = P.x + (hy - P.y) * (N.x - P.x) / (N.y - P.y);
+      if (x <= hx && x > qx)
+      {
+        qx = x;
+        m = P.x < N.x ? p : P.next;
+        if (x == hx)
+          return m;
+      }
+    }
+    p = P.next;
+  } while (p != outer);
+  if (m == none)
+    return none;
+
+  // look for vertices inside the triangle (hole vertex, ray hit, m), the one
+  // with the smallest angle to the ray is the bridge
+  uint32_t stop = m;
+  float mx = vertices_[m].x, my = vertices_[m].y;
+  float tan_min = std::numeric_limits<float>::infinity();
+  p = m;
+  do
+  {
+    auto& P = vertices_[p];
+    if (hx >= P.x && P.x >= mx && hx != P.x &&
+        point_in_triangle(hy < my ? hx : qx, hy, mx, my, hy < my ? qx : hx, hy, P.x, P.y))
+    {
+      float tan = std::abs(hy - P.y) / (hx - P.x);
+      if (locally_inside(p, hole) &&
+          (tan < tan_min || (tan == tan_min && (P.x > vertices_[m].x || (P.x == vertices_[m].x && sector_contains_sector(m, p))))))
+      {
+        m = p;
+        tan_min = tan;
+      }
+    }
+    p = P.next;
+  } while (p != stop);
+  return m;
+}
+
+bool Triangulator::sector_contains_sector(uint32_t m, uint32_t p) const
+{
+  return area(vertices_[m].prev, m, vertices_[p].prev) < 0 && area(vertices_[p].next, m, vertices_[m].next) < 0;
+}
+
+bool Triangulator::is_valid_diagonal(uint32_t a, uint32_t b) const
+{
+  auto &A = vertices_[a], &B = vertices_[b];
+  return vertices_[A.next].i != B.i && vertices_[A.prev].i != B.i && !intersects_polygon(a, b) &&
+         ((locally_inside(a, b) && locally_inside(b, a) && middle_inside(a, b) &&
+           (area(A.prev, a, B.prev) != 0 || area(a, B.prev, b) != 0)) ||
+          (equals(a, b) && area(A.prev, a, A.next) > 0 && area(B.prev, b, B.next) > 0));
+}
+
+bool Triangulator::intersects_polygon(uint32_t a, uint32_t b) const
+{
+  auto on_segment = [this](uint32_t p, uint32_t q, uint32_t r) {
+    auto &P = vertices_[p], &Q = vertices_[q], &R = vertices_[r];
+    return Q.x <= std::max(P.x, R.x) && Q.x >= std::min(P.x, R.x) && Q.y <= std::max(P.y, R.y) && Q.y >= std::min(P.y, R.y);
+  };
+  auto intersects = [&](uint32_t p1, uint32_t q1, uint32_t p2, uint32_t q2) {
+    int o1 = sign(area(p1, q1, p2)), o2 = sign(area(p1, q1, q2));
+    int o3 = sign(area(p2, q2, p1)), o4 = sign(area(p2, q2, q1));
+    if (o1 != o2 && o3 != o4)
+      return true;
+    return (o1 == 0 && on_segment(p1, p2, q1)) || (o2 == 0 && on_segment(p1, q2, q1)) ||
+           (o3 == 0 && on_segment(p2, p1, q2)) || (o4 == 0 && on_segment(p2, q1, q2));
+  };
+  uint32_t p = a;
+  do
+  {
+    auto& P = vertices_[p];
+    if (P.i != vertices_[a].i && vertices_[P.next].i != vertices_[a].i && P.i != vertices_[b].i && vertices_[P.next].i != vertices_[b].i &&
+        intersects(p, P.next, a, b))
+      return true;
+    p = P.next;
+  } while (p != a);
+  return false;
+}
+
+bool Triangulator::locally_inside(uint32_t a, uint32_t b) const
+{
+  auto& A = vertices_[a];
+  return area(A.prev, a, A.next) < 0 ?
+    area(a, b, A.next) >= 0 && area(a, A.prev, b) >= 0 :
+    area(a, b, A.prev) < 0 || area(a, A.next, b) < 0;
+}
+
+bool Triangulator::middle_inside(uint32_t a, uint32_t b) const
+{
+  uint32_t p = a;
+  bool inside = false;
+  float px = (vertices_[a].x + vertices_[b].x) / 2, py = (vertices_[a].y + vertices_[b].y) / 2;
+  do
+  {
+    auto &P = vertices_[p], &N = vertices_[P.next];
+    if (((P.y > py) != (N.y > py)) && N.y != P.y && (px < (N.x - P.x) * (py - P.y) / (N.y - P.y) + P.x))
+      inside = !inside;
+    p = P.next;
+  } while (p != a);
+  return inside;
+}
+
+void Triangulator::triangulate(const std::vector<ConstRingView>& rings, std::vector<uint32_t>& triangles)
+{
+  if (rings.empty() || rings[0].size() < 3)
+    return;
+  vertices_.clear();
+  hole_starts_.clear();
+  points_.clear();
+
+  // project on the plane orthogonal to the dominant axis of the Newell normal
+  arr3f normal = {0, 0, 0};
+  auto& exterior = rings[0];
+  for (size_t i = 0, j = exterior.size() - 1; i < exterior.size(); j = i++)
+  {
+    auto &a = exterior[j], &b = exterior[i];
+    normal[0] += (a[1] - b[1]) * (a[2] + b[2]);
+    normal[1] += (a[2] - b[2]) * (a[0] + b[0]);
+    normal[2] += (a[0] - b[0]) * (a[1] + b[1]);
+  }
+  size_t axis = 2;
+  if (std::abs(normal[0]) > std::abs(normal[axis])) axis = 0;
+  if (std::abs(normal[1]) > std::abs(normal[axis])) axis = 1;
+  size_t u = (axis + 1) % 3, v = (axis + 2) % 3;
+  for (auto& ring : rings)
+  {
+    for (auto& p : ring)
+      points_.push_back({p[u], p[v]});
+    hole_starts_.push_back(uint32_t(points_.size()));
+  }
+
+  uint32_t outer = linked_list(points_, 0, hole_starts_[0], true);
+  if (outer == none || vertices_[outer].next == vertices_[outer].prev)
+    return;
+  if (rings.size() > 1)
+  {
+    // start a list per hole and join the holes from left to right
+    std::vector<uint32_t> queue;
+    for (size_t r = 1; r < rings.size(); ++r)
+    {
+      if (rings[r].size() < 3)
+        continue;
+      uint32_t list = linked_list(points_, hole_starts_[r - 1], hole_starts_[r], false);
+      if (list == none)
+        continue;
+      if (list == vertices_[list].next)
+        vertices_[list].steiner = true;
+      queue.push_back(leftmost(list));
+    }
+    std::sort(queue.begin(), queue.end(), [this](uint32_t a, uint32_t b) { return vertices_[a].x < vertices_[b].x; });
+    for (auto hole : queue)
+      outer = eliminate_hole(hole, outer);
+  }
+
+  size_t first_triangle = triangles.size();
+  triangles_ = &triangles;
+  earcut_linked(outer, 0);
+  triangles_ = nullptr;
+
+  // give the triangles the orientation of the exterior ring
+  if (triangles.size() > first_triangle)
+  {
+    float ring_area = 0;
+    for (uint32_t i = 0, j = hole_starts_[0] - 1; i < hole_starts_[0]; j = i++)
+      ring_area += points_[j][0] * points_[i][1] - points_[i][0] * points_[j][1];
+    auto &a = points_[triangles[first_triangle]], &b = points_[triangles[first_triangle + 1]], &c = points_[triangles[first_triangle + 2]];
+    float triangle_area = (b[0] - a[0]) * (c[1] - a[1]) - (c[0] - a[0]) * (b[1] - a[1]);
+    if ((ring_area > 0) != (triangle_area > 0))
+      for (size_t t = first_triangle; t < triangles.size(); t += 3)
+        std::swap(triangles[t + 1], triangles[t + 2]);
+  }
+}
+
+void Triangulator::triangulate(const LinearRing& polygon, std::vector<uint32_t>& triangles)
+{
+  rings_.clear();
+  rings_.emplace_back(polygon.data(), polygon.data() + polygon.size());
+  for (auto& interior : polygon.interior_rings())
+    rings_.emplace_back(interior.data(), interior.data() + interior.size());
+  auto rings = std::move(rings_);
+  triangulate(rings, triangles);
+  rings_ = std::move(rings);
+}
+
+void Triangulator::triangulate(const IndexedMesh& mesh, size_t face, std::vector<uint32_t>& triangles)
+{
+  face_vertices_.clear();
+  face_indices_.clear();
+  auto& vertices = mesh.vertices();
+  std::vector<size_t> ends;
+  for (size_t r = 0; r < mesh.ring_count(face); ++r)
+  {
+    for (auto i : mesh.face_ring(face, r))
+    {
+      face_vertices_.push_back(vertices[i]);
+      face_indices_.push_back(i);
+    }
+    ends.push_back(face_vertices_.size());
+  }
+  rings_.clear();
+  for (size_t r = 0, begin = 0; r < ends.size(); begin = ends[r++])
+    rings_.emplace_back(face_vertices_.data() + begin, face_vertices_.data() + ends[r]);
+  auto rings = std::move(rings_);
+  size_t first = triangles.size();
+  triangulate(rings, triangles);
+  rings_ = std::move(rings);
+  for (size_t t = first; t < triangles.size(); ++t)
+    triangles[t] = face_indices_[triangles[t]];
+}
+
+namespace
+{
+// Triangulates polygons 0..count-1 in parallel. rings_of(i, rings) fills the
+// rings of polygon i, emit(i, rings, triangles) receives its triangles. The
+// results are collected per block of polygons and merged in order.
+template<typename Result, typename RingsOf, typename Emit>
+Result triangulate_all(size_t count, RingsOf rings_of, Emit emit, void (*merge)(Result&, Result&))
+{
+  const size_t block = 1024;
+  std::vector<Result> results((count + block - 1) / block);
+  parallel_for(0, results.size(), [&](size_t first_block, size_t last_block) {
+    Triangulator triangulator;
+    std::vector<ConstRingView> rings;
+    std::vector<uint32_t> triangles;
+    for (size_t b = first_block; b < last_block; ++b)
+    {
+      for (size_t i = b * block, end = std::min(count, i + block); i < end; ++i)
+      {
+        rings.clear();
+        triangles.clear();
+        rings_of(i, rings);
+        triangulator.triangulate(rings, triangles);
+        emit(results[b], i, rings, triangles);
+      }
+    }
+  }, 1);
+  Result result;
+  for (auto& r : results)
+    merge(result, r);
+  return result;
+}
+
+// position of index i in the concatenated rings
+inline const arr3f& ring_vertex(const std::vector<ConstRingView>& rings, uint32_t i)
+{
+  for (auto& ring : rings)
+  {
+    if (i < ring.size())
+      return ring[i];
+    i -= uint32_t(ring.size());
+  }
+  return rings.back().back();
+}
+
+void emit_triangles(TriangleCollection& result, size_t, const std::vector<ConstRingView>& rings, const std::vector<uint32_t>& triangles)
+{
+  for (size_t t = 0; t < triangles.size(); t += 3)
+    result.push_back({ring_vertex(rings, triangles[t]), ring_vertex(rings, triangles[t + 1]), ring_vertex(rings, triangles[t + 2])});
+}
+void merge_triangles(TriangleCollection& result, TriangleCollection& part)
+{
+  result.insert(result.end(), part.begin(), part.end());
+}
+
+void emit_mesh(IndexedMesh& result, size_t polygon, const std::vector<ConstRingView>& rings, const std::vector<uint32_t>& triangles)
+{
+  uint32_t offset = uint32_t(result.vertex_count());
+  for (auto& ring : rings)
+    for (auto& p : ring)
+      result.push_vertex(p);
+  std::vector<uint32_t> face(3);
+  for (size_t t = 0; t < triangles.size(); t += 3)
+  {
+    for (size_t k = 0; k < 3; ++k)
+      face[k] = offset + triangles[t + k];
+    result.push_face(face, int(polygon));
+  }
+}
+void merge_mesh(IndexedMesh& result, IndexedMesh& part)
+{
+  uint32_t offset = uint32_t(result.vertex_count());
+  for (auto& p : part.vertices())
+    result.push_vertex(p);
+  std::vector<uint32_t> face(3);
+  for (size_t f = 0; f < part.face_count(); ++f)
+  {
+    auto ring = part.face_ring(f);
+    face.assign(ring.begin(), ring.end());
+    for (auto& i : face)
+      i += offset;
+    result.push_face(face, part.face_label(f));
+  }
+}
+
+void rings_of(const LinearRing& polygon, std::vector<ConstRingView>& rings)
+{
+  rings.emplace_back(polygon.data(), polygon.data() + polygon.size());
+  for (auto& interior : polygon.interior_rings())
+    rings.emplace_back(interior.data(), interior.data() + interior.size());
+}
+} // namespace
+
+TriangleCollection triangulate(const LinearRingCollection& polygons)
+{
+  return triangulate_all<TriangleCollection>(polygons.size(),
+    [&](size_t i, std::vector<ConstRingView>& rings) { rings.push_back(polygons[i]); },
+    emit_triangles, merge_triangles);
+}
+TriangleCollection triangulate(const std::vector<LinearRing>& polygons)
+{
+  return triangulate_all<TriangleCollection>(polygons.size(),
+    [&](size_t i, std::vector<ConstRingView>& rings) { rings_of(polygons[i], rings); },
+    emit_triangles, merge_triangles);
+}
+TriangleCollection triangulate(const std::vector<const LinearRing*>& polygons)
+{
+  return triangulate_all<TriangleCollection>(polygons.size(),
+    [&](size_t i, std::vector<ConstRingView>& rings) { rings_of(*polygons[i], rings); },
+    emit_triangles, merge_triangles);
+}
+IndexedMesh triangulate_mesh(const LinearRingCollection& polygons)
+{
+  return triangulate_all<IndexedMesh>(polygons.size(),
+    [&](size_t i, std::vector<ConstRingView>& rings) { rings.push_back(polygons[i]); },
+    emit_mesh, merge_mesh);
+}
+IndexedMesh triangulate_mesh(const std::vector<LinearRing>& polygons)
+{
+  return triangulate_all<IndexedMesh>(polygons.size(),
+    [&](size_t i, std::vector<ConstRingView>& rings) { rings_of(polygons[i], rings); },
+    emit_mesh, merge_mesh);
+}
+IndexedMesh triangulate_mesh(const std::vector<const LinearRing*>& polygons)
+{
+  return triangulate_all<IndexedMesh>(polygons.size(),
+    [&](size_t i, std::vector<ConstRingView>& rings) { rings_of(*polygons[i], rings); },
+    emit_mesh, merge_mesh);
+}
+
+} // namespace geoflow
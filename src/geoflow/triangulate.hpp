@@ -0,0 +1,94 @@
+// This file is part of Geoflow
+// Copyright (C) 2018-2019  Ravi Peters, 3D geoinformation TU Delft
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstdint>
+
+#include "common.hpp"
+
+namespace geoflow
+{
+
+// Triangulator triangulates polygons with holes by ear clipping, with the holes
+// first bridged to the exterior ring. Polygons in 3D are projected on the plane
+// orthogonal to the largest component of their normal. The triangles have the
+// same orientation as the exterior ring.
+//
+// A Triangulator keeps its scratch memory between calls, so triangulating many
+// polygons with one Triangulator per thread does not allocate per polygon. It
+// is not safe to use one Triangulator from several threads at once.
+class Triangulator
+{
+  // the rings are circular doubly linked lists of vertices, linked by position
+  // in vertices_
+  struct Vertex
+  {
+    uint32_t i;  // index of the vertex in the input rings
+    float x, y;
+    uint32_t prev, next;
+    bool steiner;
+  };
+  std::vector<Vertex> vertices_;
+  std::vector<arr2f> points_;
+  std::vector<uint32_t> hole_starts_;
+  std::vector<ConstRingView> rings_;
+  vec3f face_vertices_;
+  std::vector<uint32_t> face_indices_;
+  std::vector<uint32_t>* triangles_ = nullptr;
+
+  uint32_t insert_vertex(uint32_t i, float x, float y, uint32_t last);
+  void remove_vertex(uint32_t p);
+  uint32_t split_polygon(uint32_t a, uint32_t b);
+  uint32_t linked_list(const std::vector<arr2f>& points, uint32_t begin, uint32_t end, bool clockwise);
+  uint32_t filter_points(uint32_t start, uint32_t end);
+  uint32_t filter_points(uint32_t start) { return filter_points(start, start); };
+  void earcut_linked(uint32_t ear, int pass);
+  bool is_ear(uint32_t ear) const;
+  uint32_t cure_local_intersections(uint32_t start);
+  void split_earcut(uint32_t start);
+  uint32_t eliminate_hole(uint32_t hole, uint32_t outer);
+  uint32_t find_hole_bridge(uint32_t hole, uint32_t outer) const;
+  uint32_t leftmost(uint32_t start) const;
+  bool is_valid_diagonal(uint32_t a, uint32_t b) const;
+  bool intersects_polygon(uint32_t a, uint32_t b) const;
+  bool locally_inside(uint32_t a, uint32_t b) const;
+  bool middle_inside(uint32_t a, uint32_t b) const;
+  bool sector_contains_sector(uint32_t m, uint32_t p) const;
+  float area(uint32_t p, uint32_t q, uint32_t r) const;
+  bool equals(uint32_t a, uint32_t b) const;
+  void add_triangle(uint32_t a, uint32_t b, uint32_t c);
+
+public:
+  // Triangulates the polygon with exterior ring rings[0] and holes rings[1..].
+  // Vertices are numbered over the rings in order, three indices per triangle
+  // are appended to triangles.
+  void triangulate(const std::vector<ConstRingView>& rings, std::vector<uint32_t>& triangles);
+  void triangulate(const LinearRing& polygon, std::vector<uint32_t>& triangles);
+  // triangulates one face of a mesh, the indices refer to the mesh vertices
+  void triangulate(const IndexedMesh& mesh, size_t face, std::vector<uint32_t>& triangles);
+};
+
+// Triangulate all polygons, in parallel. The indexed mesh has one triangle face
+// per triangle, labelled with the index of the polygon it came from.
+TriangleCollection triangulate(const LinearRingCollection& polygons);
+TriangleCollection triangulate(const std::vector<LinearRing>& polygons);
+TriangleCollection triangulate(const std::vector<const LinearRing*>& polygons);
+IndexedMesh triangulate_mesh(const LinearRingCollection& polygons);
+IndexedMesh triangulate_mesh(const std::vector<LinearRing>& polygons);
+IndexedMesh triangulate_mesh(const std::vector<const LinearRing*>& polygons);
+
+} // namespace geoflow
@@ -144,11 +144,11 @@ void Buffer::init()
 
 void Buffer::activate()
 {
-    glBindBuffer(GL_ARRAY_BUFFER, mBuffer);
+    glBindBuffer(target, mBuffer);
 }
 void Buffer::deactivate()
 {
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(target, 0);
 }
 
 // void Buffer::add_field(size_t dim) {
@@ -174,11 +174,12 @@ template<typename T> void Buffer::set_data(T* d, size_t length_, size_t stride_)
     stride = stride_;
     
     activate();
-    glBufferData(GL_ARRAY_BUFFER, element_size*stride*length, d, GL_STATIC_DRAW);
+    glBufferData(target, element_size*stride*length, d, GL_STATIC_DRAW);
     deactivate();
     has_data = true;
 }
 template void Buffer::set_data(GLfloat*, size_t, size_t);
+template void Buffer::set_data(GLuint*, size_t, size_t);
 // template void Buffer::set_data(double*, size_t);
 template<typename T> void Buffer::reserve_data(size_t length_, size_t dim) {
     element_size = sizeof(T);
@@ -186,7 +187,7 @@ template<typename T> void Buffer::reserve_data(size_t length_, size_t dim) {
     stride = dim;
     
     activate();
-    glBufferData(GL_ARRAY_BUFFER, element_size*stride*length, nullptr, GL_STATIC_DRAW);
+    glBufferData(target, element_size*stride*length, nullptr, GL_STATIC_DRAW);
     deactivate();
     has_data = false;
 }
@@ -195,7 +196,7 @@ template<typename T> void Buffer::set_subdata(T* d, size_t offset, size_t length
     element_size = sizeof(T);
     
     activate();
-    glBufferSubData(GL_ARRAY_BUFFER, element_size*stride*offset, element_size*stride*length_, d);
+    glBufferSubData(target, element_size*stride*offset, element_size*stride*length_, d);
     deactivate();
     has_data = true;
 }
@@ -297,6 +298,7 @@ void hudPainter::render(glm::mat4 & model, glm::mat4 & view, glm::mat4 & project
 void Painter::set_attribute(std::string name, GLfloat* data, size_t n, size_t stride) {
     if(name == "position") {
         subdata_pairs.clear();
+        indices->set_data<GLuint>(nullptr, 0, 0);
         bbox.clear();
         for(size_t i=0; i<n/3; i++) {
             bbox.add(&data[i*3]);
@@ -320,25 +322,38 @@ void Painter::end_sub_attributes(std::string& name) {
 bool Painter::has_subdata() {
     return subdata_pairs.size()>0;
 }
-void Painter::set_geometry(GeometryCollection<vec3f>& geoms) {
-    if (geoms.size()==0) return;
+void Painter::set_geometry(VertexRangeCollection& geoms) {
+    if (geoms.vertex_count()==0) return;
     subdata_pairs.clear();
+    indices->set_data<GLuint>(nullptr, 0, 0);
     bbox.clear();
-    
-    attributes["position"]->reserve_data<GLfloat>(geoms.vertex_count(), geoms.dimension());
-    size_t offset=0;
-    for (auto& geom : geoms) {
-        size_t n = geom.size();
-        attributes["position"]->set_subdata(geom[0].data(), offset, n);
-        subdata_pairs.push_back(std::make_pair(offset, n));
-        offset += n;
-        bbox.add(geom);
+    bbox.add(geoms.box());
+
+    // all ranges live in one buffer, so we can upload them at once
+    attributes["position"]->set_data(geoms.get_data_ptr(), geoms.vertex_count(), geoms.dimension());
+    auto& offsets = geoms.offsets();
+    for (size_t i=0; i<geoms.size(); ++i) {
+        subdata_pairs.push_back(std::make_pair(offsets[i], offsets[i+1]-offsets[i]));
     }
     enable_attribute("position");
 }
+void Painter::set_geometry(IndexedMesh& mesh, bool edges) {
+    if (mesh.vertex_count()==0) return;
+    subdata_pairs.clear();
+    bbox.clear();
+    bbox.add(mesh.box());
+
+    attributes["position"]->set_data(mesh.get_data_ptr(), mesh.vertex_count(), mesh.dimension());
+    auto index_data = edges ? mesh.edge_indices() : mesh.triangle_indices();
+    indices->set_data(index_data.data(), index_data.size(), 1);
+    set_drawmode(edges ? GL_LINES : GL_TRIANGLES);
+
+    enable_attribute("position");
+}
 void Painter::set_geometry(GeometryCollection<arr3f>& geoms) {
     if (geoms.size()==0) return;
     subdata_pairs.clear();
+    indices->set_data<GLuint>(nullptr, 0, 0);
     bbox.clear();
     bbox.add(geoms.box());
     
@@ -349,6 +364,7 @@ void Painter::set_geometry(GeometryCollection<arr3f>& geoms) {
 void Painter::set_geometry(GeometryCollection< std::array<arr3f,3> >& geoms) {
     if (geoms.size()==0) return;
     subdata_pairs.clear();
+    indices->set_data<GLuint>(nullptr, 0, 0);
     bbox.clear();
     bbox.add(geoms.box());
     
@@ -359,6 +375,7 @@ void Painter::set_geometry(GeometryCollection< std::array<arr3f,3> >& geoms) {
 void Painter::set_geometry(GeometryCollection< std::array<arr3f,2> >& geoms) {
     if (geoms.size()==0) return;
     subdata_pairs.clear();
+    indices->set_data<GLuint>(nullptr, 0, 0);
     bbox.clear();
     bbox.add(geoms.box());
     
@@ -368,6 +385,7 @@ void Painter::set_geometry(GeometryCollection< std::array<arr3f,2> >& geoms) {
 }
 void Painter::begin_sub_geometries(size_t vertex_count, size_t dim) {
     subdata_pairs.clear();
+    indices->set_data<GLuint>(nullptr, 0, 0);
     bbox.clear();
     attributes["position"]->reserve_data<GLfloat>(vertex_count, dim);
 }
@@ -386,6 +404,7 @@ void Painter::clear_attribute(const std::string name) {
     if(name == "position"){
         bbox.clear();
         subdata_pairs.clear();
+        indices->set_data<GLuint>(nullptr, 0, 0);
         attributes["position"]->set_data<GLfloat>(nullptr, 0, 0);
     }
     disable_attribute(name);
@@ -502,6 +521,8 @@ void Painter::init() {
     attributes["color"] = std::make_unique<Buffer>();
     attributes["value"] = std::make_unique<Buffer>();
     attributes["identifier"] = std::make_unique<Buffer>();
+    indices->init();
+    indices->deactivate();
 
     for(auto& a : attributes) {
         if(!a.second->is_initialised()) {
@@ -540,7 +561,10 @@ void Painter::render(glm::mat4 & model, glm::mat4 & view, glm::mat4 & projection
 
     glBindVertexArray(mVertexArray);
     if (attributes["position"]->get_length()>0) {
-        if(has_subdata()){
+        if(indices->get_length()>0) {
+            indices->activate();
+            glDrawElements(draw_mode, indices->get_length(), GL_UNSIGNED_INT, nullptr);
+        } else if(has_subdata()){
             for (auto& [offset, len] : subdata_pairs) {
                 glDrawArrays(draw_mode, offset, len);
             }
@@ -118,7 +118,7 @@ private:
 class Buffer
 {
 public:
-    Buffer() { }
+    Buffer(GLenum target=GL_ARRAY_BUFFER) : target(target) { }
     ~Buffer() { glDeleteBuffers(1, &mBuffer); }
 
     void init();
@@ -139,6 +139,7 @@ public:
 
 private:
     GLfloat* data;
+    GLenum target;
     GLuint mBuffer=0;
     size_t element_size, length=0, stride=0;
     // name, type, dim
@@ -323,7 +324,8 @@ class Painter : public BasePainter {
     }
     void set_attribute(std::string name, GLfloat* data, size_t n, size_t stride);
     bool has_subdata();
-    void set_geometry(GeometryCollection<vec3f>& geoms);
+    void set_geometry(VertexRangeCollection& geoms);
+    void set_geometry(IndexedMesh& mesh, bool edges=false);
     void set_geometry(GeometryCollection<arr3f>& geoms);
     void set_geometry(GeometryCollection< std::array<arr3f,3> >& geoms);
     void set_geometry(GeometryCollection< std::array<arr3f,2> >& geoms);
@@ -349,6 +351,8 @@ class Painter : public BasePainter {
 
     private:
     std::vector<std::pair<size_t,size_t>> subdata_pairs;
+    // vertex indices for glDrawElements, only used for indexed geometries
+    std::unique_ptr<Buffer> indices = std::make_unique<Buffer>(GL_ELEMENT_ARRAY_BUFFER);
     void init();
     geoflow::Box bbox;
     std::weak_ptr<Texture1D> texture;